@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include "recordrenderer.h"
+#include "thumbnailbatch.h"
+
+/*
+ * NihilBench [options] scene files...
+ *   -s WxH         the size of the view, 1280x720 by default
+ *   -n count       the frames around each scene, 60 by default
+ *   -p count       the picks on each side of a grid over the view, 16 by default
+ *   -t count       the worker threads of the core, the hardware threads by default
+ * Each scene loads headless into the recording renderer, then the camera turns around it a step a frame,
+ * then the grid of the view is picked. The times and the counters of the renderer print a line a scene.
+ * The exit code is the count of the scenes failed.
+ */
+
+struct NihilBenchOptions
+{
+    int                     width = 1280;
+    int                     height = 720;
+    int                     frames = 60;
+    int                     picks = 16;
+    int                     workers = -1;
+};
+
+static NihilString nihilToString(const char* str)
+{
+    // the paths in the locale of the console, so that it runs the same without the win32 conversions
+    size_t len = mbstowcs(nullptr, str, 0);
+    if (len == (size_t)-1 || !len)
+        return NihilString();
+    NihilString s;
+    s.resize((int)len);
+    mbstowcs(&s.front(), str, len);
+    return s;
+}
+
+static bool nihilRunBench(const NihilString& path, const NihilBenchOptions& options)
+{
+    NihilRecordRenderer* renderer = new NihilRecordRenderer(options.width, options.height);
+    NihilCore core;
+    if (!core.setupHeadless(renderer, options.workers))
+        return false;
+    // 1.load, count the uploads of the streams from here
+    double startTime = nihilGetMilliseconds();
+    NihilString src;
+    NihilBoundingBox box;
+    if (!nihilReadSceneFile(path, src) || !core.loadFromTextStream(src) || !core.getSceneBoundingBox(box))
+        return false;
+    double loadTime = nihilGetMilliseconds() - startTime;
+    long long loadedBytes = renderer->getStats().uploadedBytes;
+    renderer->resetStats();
+    // 2.turn around the bounding sphere, each frame culls and sorts the scene again
+    gs::vec3 center = box.getCenter();
+    gs::vec3 diagonal;
+    diagonal.sub(box.maxpt, box.minpt);
+    float radius = std::max(diagonal.length() * 0.5f, 1e-3f);
+    NihilSceneConfig& sceneConfig = core.getSceneConfig();
+    float distance = sceneConfig.calcFitDistance(radius, options.width, options.height);
+    startTime = nihilGetMilliseconds();
+    for (int i = 0; i < options.frames; i ++)
+    {
+        sceneConfig.setupOrbit(PI * 2.f * i / options.frames, 0.4f, distance, center);
+        core.invalidate();
+        core.render();
+    }
+    double frameTime = (nihilGetMilliseconds() - startTime) / std::max(options.frames, 1);
+    const NihilRecordStats& stats = renderer->getStats();
+    int frames = std::max(stats.frames, 1);
+    // 3.pick the grid of the view from the last angle
+    int hits = 0;
+    startTime = nihilGetMilliseconds();
+    for (int y = 0; y < options.picks; y ++)
+    {
+        for (int x = 0; x < options.picks; x ++)
+        {
+            gs::vec2 pt((x + 0.5f) * options.width / options.picks, (y + 0.5f) * options.height / options.picks);
+            NihilPickResult result;
+            if (core.pickObject(pt, options.width, options.height, result))
+                hits ++;
+        }
+    }
+    int pickCount = std::max(options.picks * options.picks, 1);
+    double pickTime = (nihilGetMilliseconds() - startTime) / pickCount;
+    wprintf(L"%ls: load %.1fms %lldKB, frame %.3fms %d packets %d draws %d states %lld indices, pick %.3fms %d/%d hit\n",
+        path.c_str(), loadTime, loadedBytes / 1024, frameTime, stats.packets / frames, stats.drawCalls / frames,
+        stats.stateChanges / frames, stats.drawnIndices / frames, pickTime, hits, pickCount);
+    return true;
+}
+
+static void nihilPrintUsage()
+{
+    wprintf(L"usage: NihilBench [-s WxH] [-n frames] [-p picks] [-t threads] scenes...\n");
+}
+
+int main(int argc, char* argv[])
+{
+    NihilBenchOptions options;
+    std::vector<NihilString> scenes;
+    for (int i = 1; i < argc; i ++)
+    {
+        const char* arg = argv[i];
+        if (arg[0] != '-')
+        {
+            scenes.push_back(nihilToString(arg));
+            continue;
+        }
+        if (i + 1 >= argc)
+        {
+            nihilPrintUsage();
+            return 1;
+        }
+        const char* value = argv[++ i];
+        if (!strcmp(arg, "-s"))
+        {
+            if (sscanf(value, "%dx%d", &options.width, &options.height) != 2 || options.width <= 0 || options.height <= 0)
+            {
+                nihilPrintUsage();
+                return 1;
+            }
+        }
+        else if (!strcmp(arg, "-n"))
+            options.frames = std::max(atoi(value), 1);
+        else if (!strcmp(arg, "-p"))
+            options.picks = std::max(atoi(value), 1);
+        else if (!strcmp(arg, "-t"))
+            options.workers = atoi(value);
+        else
+        {
+            nihilPrintUsage();
+            return 1;
+        }
+    }
+    if (scenes.empty())
+    {
+        nihilPrintUsage();
+        return 1;
+    }
+    int failed = 0;
+    for (const auto& path : scenes)
+    {
+        if (!nihilRunBench(path, options))
+        {
+            wprintf(L"%ls: failed\n", path.c_str());
+            failed ++;
+        }
+    }
+    return failed;
+}
@@ -0,0 +1,38 @@
+#-------------------------------------------------
+#
+# Headless self checks of the core, exits with the count of the failed ones
+#
+#-------------------------------------------------
+
+QT       -= core gui
+
+TARGET = NihilSelfTest
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+DEFINES += UNICODE \
+            _UNICODE
+
+SOURCES += \
+        main.cpp
+
+INCLUDEPATH += ../NihilStudioCore/NihilStudioCore
+INCLUDEPATH += ../NihilStudioCore/NihilStudioCore/gslib
+
+win32:CONFIG(release, debug|release): LIBS += -L$$PWD/../NihilStudioCore/release/ -lNihilStudioCore
+else:win32:CONFIG(debug, debug|release): LIBS += -L$$PWD/../NihilStudioCore/debug/ -lNihilStudioCore
+
+INCLUDEPATH += $$PWD/../NihilStudioCore/Debug
+DEPENDPATH += $$PWD/../NihilStudioCore/Debug
+
+win32-g++:CONFIG(release, debug|release): PRE_TARGETDEPS += $$PWD/../NihilStudioCore/release/libNihilStudioCore.a
+else:win32-g++:CONFIG(debug, debug|release): PRE_TARGETDEPS += $$PWD/../NihilStudioCore/debug/libNihilStudioCore.a
+else:win32:!win32-g++:CONFIG(release, debug|release): PRE_TARGETDEPS += $$PWD/../NihilStudioCore/release/NihilStudioCore.lib
+else:win32:!win32-g++:CONFIG(debug, debug|release): PRE_TARGETDEPS += $$PWD/../NihilStudioCore/debug/NihilStudioCore.lib
+
+# the core links the d3d11 renderer as well, though it was never created here
+win32: LIBS += -lUser32
+win32: LIBS += -lGdi32
+win32: LIBS += -lD3d11
+win32: LIBS += -ldxgi
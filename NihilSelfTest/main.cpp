@@ -0,0 +1,714 @@
+#include <stdio.h>
+#include <vector>
+#include "idbuffer.h"
+#include "lasso.h"
+#include "pointgrid.h"
+#include "nurbs.h"
+#include "softrenderer.h"
+
+/*
+ * NihilSelfTest
+ * Runs the checks of the core that need neither a window nor a device, prints the failed ones.
+ * The scenes are drawn by the soft renderer.
+ * The exit code is the count of the failed checks, 0 if all pass.
+ */
+
+static int nihilFailures = 0;
+
+#define NIHIL_CHECK(expr) \
+    do { if (!(expr)) { nihilFailures ++; printf("%s(%d): failed: %s\n", __FILE__, __LINE__, #expr); } } while (0)
+
+#define NIHIL_TEST_WIDTH    128
+#define NIHIL_TEST_HEIGHT   96
+
+// the eye at the origin looking at +z, the near plane at z = 0.1
+static void nihilSetupTestView(gs::matrix& viewProj)
+{
+    viewProj.perspectivefovlh(PI / 2.f, (float)NIHIL_TEST_WIDTH / NIHIL_TEST_HEIGHT, 0.1f, 100.f);
+}
+
+// a rect facing the eye at the depth z, the front face for the id buffer
+static void nihilAddTestQuad(NihilIdBuffer& idBuffer, int object, float left, float bottom, float right, float top, float z, const gs::matrix& viewProj)
+{
+    gs::vec3 points[4] = { gs::vec3(left, bottom, z), gs::vec3(left, top, z), gs::vec3(right, top, z), gs::vec3(right, bottom, z) };
+    int indices[6] = { 0, 1, 2, 0, 2, 3 };
+    idBuffer.addMesh(object, points, sizeof(gs::vec3), 4, indices, 2, viewProj, nullptr);
+}
+
+// the same sequence on every run, so that a failure repeats
+static float nihilTestRandom(unsigned int& seed, float lower, float upper)
+{
+    seed = seed * 1664525u + 1013904223u;
+    return lower + (upper - lower) * (float)(seed >> 8) / (float)(1 << 24);
+}
+
+static void nihilTestPointGrid()
+{
+    // some of the points off the screen, they go to the border cells
+    const int count = 3000, width = 640, height = 480;
+    std::vector<float> xs(count), ys(count);
+    unsigned int seed = 1;
+    for (int i = 0; i < count; i ++)
+    {
+        xs.at(i) = nihilTestRandom(seed, -40.f, width + 40.f);
+        ys.at(i) = nihilTestRandom(seed, -40.f, height + 40.f);
+    }
+    NihilPointGrid grid;
+    grid.build(xs.data(), ys.data(), count, width, height);
+    NIHIL_CHECK(!grid.isEmpty());
+    // the rects against a linear scan, the ones crossing the borders and covering the whole screen as well
+    gs::pink::rectf rects[] = {
+        gs::pink::rectf(10.f, 10.f, 1.f, 1.f),
+        gs::pink::rectf(100.f, 50.f, 200.f, 120.f),
+        gs::pink::rectf(-30.f, -30.f, 90.f, 60.f),
+        gs::pink::rectf(600.f, 400.f, 100.f, 100.f),
+        gs::pink::rectf(-50.f, -50.f, width + 100.f, height + 100.f),
+    };
+    gs::vbitset hits;
+    hits.resize(count);
+    for (const auto& rc : rects)
+    {
+        hits.reset(false);
+        grid.query(rc, xs.data(), ys.data(), hits);
+        int mismatches = 0;
+        for (int i = 0; i < count; i ++)
+        {
+            if (hits.test(i) != rc.in_rect(gs::pink::pointf(xs.at(i), ys.at(i))))
+                mismatches ++;
+        }
+        NIHIL_CHECK(mismatches == 0);
+    }
+    // the picks against the nearest one by a linear scan
+    const float radius = 6.f;
+    int mismatches = 0;
+    for (int k = 0; k < 200; k ++)
+    {
+        float x = nihilTestRandom(seed, 0.f, (float)width), y = nihilTestRandom(seed, 0.f, (float)height);
+        int nearest = -1;
+        float nearestDist = radius * radius;
+        for (int i = 0; i < count; i ++)
+        {
+            float dx = xs.at(i) - x, dy = ys.at(i) - y;
+            float d = dx * dx + dy * dy;
+            if (d <= nearestDist)
+            {
+                nearest = i;
+                nearestDist = d;
+            }
+        }
+        int picked = grid.pick(x, y, radius, xs.data(), ys.data());
+        if (picked != nearest)
+        {
+            // a tie may pick either
+            float dx = picked < 0 ? 0.f : xs.at(picked) - x, dy = picked < 0 ? 0.f : ys.at(picked) - y;
+            if (picked < 0 || nearest < 0 || dx * dx + dy * dy != nearestDist)
+                mismatches ++;
+        }
+    }
+    NIHIL_CHECK(mismatches == 0);
+}
+
+// Moller-Trumbore, the reference of the mesh bvh tests every triangle by it
+static bool nihilTestRayTriangle(const gs::vec3& origin, const gs::vec3& dir, const gs::vec3& p1, const gs::vec3& p2, const gs::vec3& p3, float& distance)
+{
+    gs::vec3 e1, e2, pv, tv, qv;
+    e1.sub(p2, p1);
+    e2.sub(p3, p1);
+    pv.cross(dir, e2);
+    float det = e1.dot(pv);
+    if (fabsf(det) < FLT_MIN)
+        return false;
+    tv.sub(origin, p1);
+    float u = tv.dot(pv) / det;
+    if (u < 0.f || u > 1.f)
+        return false;
+    qv.cross(tv, e1);
+    float v = dir.dot(qv) / det;
+    if (v < 0.f || u + v > 1.f)
+        return false;
+    distance = e2.dot(qv) / det;
+    return distance >= 0.f;
+}
+
+static int nihilTestRaycastMismatches(const NihilMeshBvh& bvh, const std::vector<NihilVertex>& points, const std::vector<int>& indices, unsigned int& seed)
+{
+    int mismatches = 0;
+    for (int k = 0; k < 300; k ++)
+    {
+        // from a sphere around the mesh to a point inside it, some of them miss everything
+        gs::vec3 origin(nihilTestRandom(seed, -1.f, 1.f), nihilTestRandom(seed, -1.f, 1.f), nihilTestRandom(seed, -1.f, 1.f));
+        origin.normalize();
+        origin.scale(30.f);
+        gs::vec3 target(nihilTestRandom(seed, -12.f, 12.f), nihilTestRandom(seed, -12.f, 12.f), nihilTestRandom(seed, -12.f, 12.f));
+        gs::vec3 dir;
+        dir.sub(target, origin);
+        NihilRayHit hit;
+        // a nearer hit given before, half of the rays, the farther triangles don't count then
+        float limit = (k & 1) ? FLT_MAX : nihilTestRandom(seed, 0.3f, 1.f);
+        hit.distance = limit;
+        bool found = bvh.raycast(points.data(), indices.data(), origin, dir, hit);
+        int nearest = -1;
+        float nearestDist = limit;
+        for (int t = 0; t < (int)indices.size() / 3; t ++)
+        {
+            float distance;
+            if (nihilTestRayTriangle(origin, dir, points.at(indices.at(t * 3)).pos, points.at(indices.at(t * 3 + 1)).pos, points.at(indices.at(t * 3 + 2)).pos, distance) && distance < nearestDist)
+            {
+                nearest = t;
+                nearestDist = distance;
+            }
+        }
+        if (found != (nearest >= 0))
+            mismatches ++;
+        else if (found && hit.triangle != nearest && fabsf(hit.distance - nearestDist) > 1e-5f)
+            mismatches ++;
+    }
+    return mismatches;
+}
+
+static void nihilTestMeshBvhRaycast()
+{
+    // a soup of small triangles, some of them overlap
+    const int triangleCount = 2000;
+    std::vector<NihilVertex> points(triangleCount * 3);
+    std::vector<int> indices(triangleCount * 3);
+    unsigned int seed = 7;
+    for (int t = 0; t < triangleCount; t ++)
+    {
+        gs::vec3 center(nihilTestRandom(seed, -10.f, 10.f), nihilTestRandom(seed, -10.f, 10.f), nihilTestRandom(seed, -10.f, 10.f));
+        for (int j = 0; j < 3; j ++)
+        {
+            NihilVertex& vertex = points.at(t * 3 + j);
+            vertex.pos = gs::vec3(center.x + nihilTestRandom(seed, -1.f, 1.f), center.y + nihilTestRandom(seed, -1.f, 1.f), center.z + nihilTestRandom(seed, -1.f, 1.f));
+            vertex.normal = gs::vec3(0.f, 0.f, 1.f);
+            indices.at(t * 3 + j) = t * 3 + j;
+        }
+    }
+    NihilMeshBvh bvh;
+    bvh.build(points.data(), indices.data(), triangleCount);
+    NIHIL_CHECK(!bvh.isEmpty());
+    NIHIL_CHECK(nihilTestRaycastMismatches(bvh, points, indices, seed) == 0);
+    // the points moved, only refit
+    for (auto& vertex : points)
+        vertex.pos = gs::vec3(vertex.pos.x * 1.1f + nihilTestRandom(seed, -0.5f, 0.5f), vertex.pos.y, vertex.pos.z - 1.f);
+    bvh.refit(points.data(), indices.data());
+    NIHIL_CHECK(nihilTestRaycastMismatches(bvh, points, indices, seed) == 0);
+}
+
+static void nihilSetupTestLasso(NihilLasso& lasso, const float* coords, int count)
+{
+    lasso.clear();
+    for (int i = 0; i < count; i ++)
+        lasso.addPoint(gs::vec2(coords[i * 2], coords[i * 2 + 1]));
+    lasso.prepare();
+}
+
+// even-odd over all the edges, the reference of the lasso, which only tests the edges of a row
+static bool nihilTestLassoContains(const NihilLasso& lasso, float x, float y)
+{
+    bool inside = false;
+    for (int i = 0, count = lasso.size(); i < count; i ++)
+    {
+        const gs::vec2& a = lasso.getPoint(i);
+        const gs::vec2& b = lasso.getPoint((i + 1) % count);
+        if ((a.y > y) != (b.y > y) && x < a.x + (y - a.y) * (b.x - a.x) / (b.y - a.y))
+            inside = !inside;
+    }
+    return inside;
+}
+
+static int nihilTestLassoMismatches(const NihilLasso& lasso, unsigned int& seed)
+{
+    const gs::pink::rectf& rc = lasso.getBoundingRect();
+    int mismatches = 0;
+    for (int k = 0; k < 2000; k ++)
+    {
+        float x = nihilTestRandom(seed, rc.left - 10.f, rc.right + 10.f);
+        float y = nihilTestRandom(seed, rc.top - 10.f, rc.bottom + 10.f);
+        if (lasso.contains(x, y) != nihilTestLassoContains(lasso, x, y))
+            mismatches ++;
+    }
+    return mismatches;
+}
+
+static void nihilTestLasso()
+{
+    NihilLasso lasso;
+    unsigned int seed = 3;
+    // a square
+    const float square[] = { 10.f, 10.f, 50.f, 10.f, 50.f, 50.f, 10.f, 50.f };
+    nihilSetupTestLasso(lasso, square, 4);
+    NIHIL_CHECK(lasso.isValid());
+    NIHIL_CHECK(lasso.contains(30.f, 30.f) && lasso.contains(11.f, 49.f));
+    NIHIL_CHECK(!lasso.contains(5.f, 30.f) && !lasso.contains(60.f, 30.f) && !lasso.contains(30.f, 55.f));
+    NIHIL_CHECK(nihilTestLassoMismatches(lasso, seed) == 0);
+    // a concave one, a U open at the bottom of the screen
+    const float u[] = { 0.f, 0.f, 60.f, 0.f, 60.f, 60.f, 40.f, 60.f, 40.f, 20.f, 20.f, 20.f, 20.f, 60.f, 0.f, 60.f };
+    nihilSetupTestLasso(lasso, u, 8);
+    NIHIL_CHECK(lasso.contains(10.f, 40.f) && lasso.contains(50.f, 40.f) && lasso.contains(30.f, 10.f));
+    NIHIL_CHECK(!lasso.contains(30.f, 40.f) && !lasso.contains(30.f, 59.f) && !lasso.contains(30.f, 70.f));
+    NIHIL_CHECK(nihilTestLassoMismatches(lasso, seed) == 0);
+    // a triangle in the notch and out of it overlaps nothing, one crossing the base or around the whole U does
+    NIHIL_CHECK(!lasso.overlapsTriangle(gs::vec2(25.f, 30.f), gs::vec2(35.f, 30.f), gs::vec2(30.f, 80.f)));
+    NIHIL_CHECK(lasso.overlapsTriangle(gs::vec2(25.f, -10.f), gs::vec2(35.f, -10.f), gs::vec2(30.f, 30.f)));
+    NIHIL_CHECK(lasso.overlapsTriangle(gs::vec2(-100.f, -100.f), gs::vec2(200.f, -100.f), gs::vec2(30.f, 200.f)));
+    // a pentagram crossing itself, the center is outside by the even-odd rule
+    float star[10];
+    for (int i = 0; i < 5; i ++)
+    {
+        float angle = -PI * 0.5f + PI * 0.8f * i;
+        star[i * 2] = 100.f + 50.f * cosf(angle);
+        star[i * 2 + 1] = 100.f + 50.f * sinf(angle);
+    }
+    nihilSetupTestLasso(lasso, star, 5);
+    NIHIL_CHECK(lasso.contains(100.f, 60.f) && !lasso.contains(100.f, 100.f));
+    NIHIL_CHECK(nihilTestLassoMismatches(lasso, seed) == 0);
+    // a wavy stroke of many points, so that the edges spread over many rows
+    std::vector<float> wave;
+    for (int i = 0; i < 200; i ++)
+    {
+        float angle = PI * 2.f * i / 200;
+        float radius = 100.f + 30.f * sinf(angle * 9.f);
+        wave.push_back(200.f + radius * cosf(angle));
+        wave.push_back(200.f + radius * sinf(angle));
+    }
+    nihilSetupTestLasso(lasso, wave.data(), 200);
+    NIHIL_CHECK(lasso.size() > 100);
+    NIHIL_CHECK(lasso.contains(200.f, 200.f) && !lasso.contains(200.f, 60.f));
+    NIHIL_CHECK(nihilTestLassoMismatches(lasso, seed) == 0);
+}
+
+static void nihilTestIdBufferOcclusion()
+{
+    gs::matrix viewProj;
+    nihilSetupTestView(viewProj);
+    NihilIdBuffer idBuffer;
+    idBuffer.setup(NIHIL_TEST_WIDTH, NIHIL_TEST_HEIGHT);
+    // the object 0 behind the object 1, which only covers the left half of the view
+    nihilAddTestQuad(idBuffer, 0, -20.f, -20.f, 20.f, 20.f, 10.f, viewProj);
+    nihilAddTestQuad(idBuffer, 1, -10.f, -10.f, 0.f, 10.f, 5.f, viewProj);
+    idBuffer.rasterize(nullptr);
+    float cy = NIHIL_TEST_HEIGHT * 0.5f;
+    NIHIL_CHECK(idBuffer.getObject(NIHIL_TEST_WIDTH * 0.25f, cy) == 1);
+    NIHIL_CHECK(idBuffer.getObject(NIHIL_TEST_WIDTH * 0.75f, cy) == 0);
+    NIHIL_CHECK(idBuffer.getDepth(NIHIL_TEST_WIDTH * 0.25f, cy) > idBuffer.getDepth(NIHIL_TEST_WIDTH * 0.75f, cy));
+    NIHIL_CHECK(idBuffer.getObject(-1.f, cy) == -1);
+    // the rect over the left half sees the front object only, the one over the center sees both
+    gs::vbitset objects;
+    objects.resize(2);
+    idBuffer.collectObjects(gs::pink::rectf(0.f, 0.f, NIHIL_TEST_WIDTH * 0.4f, (float)NIHIL_TEST_HEIGHT), nullptr, objects);
+    NIHIL_CHECK(!objects.test(0) && objects.test(1));
+    objects.reset(false);
+    idBuffer.collectObjects(gs::pink::rectf(NIHIL_TEST_WIDTH * 0.4f, 0.f, NIHIL_TEST_WIDTH * 0.2f, (float)NIHIL_TEST_HEIGHT), nullptr, objects);
+    NIHIL_CHECK(objects.test(0) && objects.test(1));
+    // a lasso around the right quarter only
+    NihilLasso lasso;
+    lasso.addPoint(gs::vec2(NIHIL_TEST_WIDTH * 0.7f, cy - 10.f));
+    lasso.addPoint(gs::vec2(NIHIL_TEST_WIDTH * 0.8f, cy - 10.f));
+    lasso.addPoint(gs::vec2(NIHIL_TEST_WIDTH * 0.8f, cy + 10.f));
+    lasso.addPoint(gs::vec2(NIHIL_TEST_WIDTH * 0.7f, cy + 10.f));
+    lasso.prepare();
+    objects.reset(false);
+    idBuffer.collectObjects(lasso.getBoundingRect(), &lasso, objects);
+    NIHIL_CHECK(objects.test(0) && !objects.test(1));
+}
+
+static void nihilTestIdBufferNearClipping()
+{
+    gs::matrix viewProj;
+    nihilSetupTestView(viewProj);
+    NihilIdBuffer idBuffer;
+    idBuffer.setup(NIHIL_TEST_WIDTH, NIHIL_TEST_HEIGHT);
+    // a floor from behind the eye to the far side, it crosses the near plane but still covers the lower half
+    gs::vec3 points[4] = { gs::vec3(-50.f, -1.f, -10.f), gs::vec3(-50.f, -1.f, 50.f), gs::vec3(50.f, -1.f, 50.f), gs::vec3(50.f, -1.f, -10.f) };
+    int indices[6] = { 0, 1, 2, 0, 2, 3 };
+    idBuffer.addMesh(0, points, sizeof(gs::vec3), 4, indices, 2, viewProj, nullptr);
+    // a wall under the floor, hidden by it
+    nihilAddTestQuad(idBuffer, 1, -50.f, -20.f, 50.f, -2.f, 20.f, viewProj);
+    idBuffer.rasterize(nullptr);
+    NIHIL_CHECK(idBuffer.getObject(NIHIL_TEST_WIDTH * 0.5f, NIHIL_TEST_HEIGHT - 1.f) == 0);
+    NIHIL_CHECK(idBuffer.getObject(NIHIL_TEST_WIDTH * 0.5f, NIHIL_TEST_HEIGHT * 0.75f) == 0);
+    NIHIL_CHECK(idBuffer.getObject(NIHIL_TEST_WIDTH * 0.5f, NIHIL_TEST_HEIGHT * 0.25f) == -1);
+    // the depth of the clipped part stays in the range of the near plane
+    NIHIL_CHECK(idBuffer.getDepth(NIHIL_TEST_WIDTH * 0.5f, NIHIL_TEST_HEIGHT - 1.f) <= 1.f / 0.1f);
+}
+
+static void nihilTestDrawKeys()
+{
+    // each field reads back what is packed, even at the widest values
+    NihilDrawPacket packet;
+    packet.key = NihilDrawPacket::makeKey(NihilDrawPacket::Pass_UI, 3, 0xff, 0x7fffffff, 0xff);
+    NIHIL_CHECK(packet.getPass() == NihilDrawPacket::Pass_UI);
+    NIHIL_CHECK(packet.getTopology() == 3);
+    NIHIL_CHECK(packet.getMaterial() == 0xff);
+    NIHIL_CHECK(packet.getStreams() == 0x7fffffff);
+    NIHIL_CHECK(packet.getLevel() == 0xff);
+    packet.key = NihilDrawPacket::makeKey(NihilDrawPacket::Pass_InstancedGeometry, 1, NihilDrawPacket::Mat_Selected, 5, 2);
+    NIHIL_CHECK(packet.getPass() == NihilDrawPacket::Pass_InstancedGeometry);
+    NIHIL_CHECK(packet.getTopology() == 1);
+    NIHIL_CHECK(packet.getMaterial() == NihilDrawPacket::Mat_Selected);
+    NIHIL_CHECK(packet.getStreams() == 5);
+    NIHIL_CHECK(packet.getLevel() == 2);
+    // the pass ordered before the others, then the state, then the streams and the level
+    NihilDrawPacket a, b;
+    a.key = NihilDrawPacket::makeKey(NihilDrawPacket::Pass_Geometry, 3, 0xff, 0x7fffffff, 0xff);
+    b.key = NihilDrawPacket::makeKey(NihilDrawPacket::Pass_InstancedGeometry, 0, 0, 0, 0);
+    NIHIL_CHECK(a.key < b.key);
+    a.key = NihilDrawPacket::makeKey(NihilDrawPacket::Pass_Geometry, 0, NihilDrawPacket::Mat_Default, 9, 3);
+    b.key = NihilDrawPacket::makeKey(NihilDrawPacket::Pass_Geometry, 0, NihilDrawPacket::Mat_Selected, 0, 0);
+    NIHIL_CHECK(a.key < b.key && !a.isSameState(b));
+    b.key = NihilDrawPacket::makeKey(NihilDrawPacket::Pass_Geometry, 0, NihilDrawPacket::Mat_Default, 9, 4);
+    NIHIL_CHECK(a.isSameState(b) && !a.isSameStreams(b));
+}
+
+static const gs::gchar nihilTestScene[] =
+    _t("Polygon {\n\t.Points {\n\t\t0 0 0(0)\n\t\t1 0 0(1)\n\t\t0 1 0(2)\n\t}\n\t.Faces {\n\t\t0 1 2(0)\n\t}\n}\n")
+    _t("Polygon {\n\t.Points {\n\t\t0 0 1(0)\n\t\t1 0 1(1)\n\t\t0 1 1(2)\n\t\t1 1 1(3)\n\t}\n\t.Faces {\n\t\t0 1 2(0)\n\t\t2 1 3(1)\n\t}\n}\n");
+
+static void nihilTestCommandList()
+{
+    NihilCore core;
+    NIHIL_CHECK(core.setupHeadless(new NihilSoftRenderer(64, 64), 0));
+    NIHIL_CHECK(core.loadFromTextStream(nihilTestScene));
+    core.render();
+    const NihilCommandList& commands = core.getCommandList();
+    NIHIL_CHECK(commands.size() == 2);
+    if (commands.size() != 2)
+        return;
+    // the streams are numbered by the order they are added, the slots, not by their addresses
+    std::vector<unsigned long long> keys;
+    for (int i = 0; i < commands.size(); i ++)
+    {
+        const NihilDrawPacket& packet = commands.getPacket(i);
+        NIHIL_CHECK(packet.getPass() == NihilDrawPacket::Pass_Geometry);
+        NIHIL_CHECK(packet.getStreams() == i);
+        NIHIL_CHECK(packet.geometry && (!i || packet.geometry != commands.getPacket(i - 1).geometry));
+        NIHIL_CHECK(!i || commands.getPacket(i - 1).key <= packet.key);
+        keys.push_back(packet.key);
+    }
+    NIHIL_CHECK(commands.getStateChanges() == 1);
+    // selecting the second one moves it after the first by its material, the streams keep their numbers
+    NihilGeometry* second = commands.getPacket(1).geometry;
+    second->setSelected(true);
+    core.invalidate();
+    core.render();
+    NIHIL_CHECK(commands.getPacket(1).geometry == second && commands.getPacket(1).getMaterial() == NihilDrawPacket::Mat_Selected);
+    NIHIL_CHECK(commands.getPacket(1).getStreams() == 1);
+    NIHIL_CHECK(commands.getStateChanges() == 2);
+    // the same scene draws in the same order
+    second->setSelected(false);
+    core.invalidate();
+    core.render();
+    for (int i = 0; i < commands.size(); i ++)
+        NIHIL_CHECK(commands.getPacket(i).key == keys.at(i));
+}
+
+static void nihilTestSceneBoundingBox()
+{
+    NihilCore core;
+    NIHIL_CHECK(core.setupHeadless(new NihilSoftRenderer(64, 64), 0));
+    NIHIL_CHECK(core.loadFromTextStream(nihilTestScene));
+    NihilBoundingBox box;
+    NIHIL_CHECK(core.getSceneBoundingBox(box));
+    NIHIL_CHECK(box.minpt.z == 0.f && box.maxpt.z == 1.f && box.maxpt.x == 1.f);
+    // a parented object still counts by its world box
+    NIHIL_CHECK(core.parentObject(1, 0));
+    NIHIL_CHECK(core.getSceneBoundingBox(box));
+    NIHIL_CHECK(box.minpt.z == 0.f && box.maxpt.z == 1.f && box.maxpt.x == 1.f);
+}
+
+// the points of each slot and the offsets of the objects, moved by the journal as the core does
+class NihilTestJournalTarget:
+    public NihilJournalTarget
+{
+public:
+    std::vector<std::vector<gs::vec3>> points;
+    std::vector<gs::vec3> objects;
+    std::vector<int>    lastIndices;
+    int                 pointCalls = 0;
+    int                 objectCalls = 0;
+
+public:
+    virtual void translatePoints(int slot, const int indices[], int count, const gs::vec3& offset) override
+    {
+        lastIndices.assign(indices, indices + count);
+        for (int i = 0; i < count; i ++)
+            points.at(slot).at(indices[i]) += offset;
+        pointCalls ++;
+    }
+    virtual void translateObject(int slot, const gs::vec3& offset) override
+    {
+        objects.at(slot) += offset;
+        objectCalls ++;
+    }
+};
+
+static bool nihilTestSamePoints(const std::vector<gs::vec3>& p1, const std::vector<gs::vec3>& p2)
+{
+    if (p1.size() != p2.size())
+        return false;
+    for (size_t i = 0; i < p1.size(); i ++)
+    {
+        if (p1.at(i).x != p2.at(i).x || p1.at(i).y != p2.at(i).y || p1.at(i).z != p2.at(i).z)
+            return false;
+    }
+    return true;
+}
+
+static void nihilTestJournal()
+{
+    NihilTestJournalTarget target;
+    target.points.resize(2);
+    for (int i = 0; i < 8; i ++)
+        target.points.at(0).push_back(gs::vec3((float)i, 0.f, 0.f));
+    target.objects.resize(2, gs::vec3(0.f, 0.f, 0.f));
+    auto original = target.points;
+    NihilEditJournal journal;
+    // a drag of 50 moves over two points and an object, the offsets are exact in binary so the sums are too
+    const int dragged[] = { 5, 2 };
+    gs::vec3 step(0.25f, -0.5f, 0.125f);
+    journal.beginEdit();
+    for (int k = 0; k < 50; k ++)
+    {
+        target.translatePoints(0, dragged, 2, step);
+        journal.recordPoints(0, dragged, 2, step);
+        target.translateObject(1, step);
+        journal.recordObject(1, step);
+    }
+    journal.endEdit();
+    auto moved = target.points;
+    gs::vec3 movedObject = target.objects.at(1);
+    NIHIL_CHECK(journal.getUndoCount() == 1 && !journal.canRedo());
+    // one change for each object, so the undo moves each of them once
+    target.pointCalls = target.objectCalls = 0;
+    NIHIL_CHECK(journal.undo(&target));
+    NIHIL_CHECK(target.pointCalls == 1 && target.objectCalls == 1);
+    NIHIL_CHECK(target.lastIndices.size() == 2 && target.lastIndices.at(0) == 2 && target.lastIndices.at(1) == 5);
+    NIHIL_CHECK(nihilTestSamePoints(target.points.at(0), original.at(0)));
+    NIHIL_CHECK(target.objects.at(1).x == 0.f && target.objects.at(1).y == 0.f && target.objects.at(1).z == 0.f);
+    NIHIL_CHECK(journal.redo(&target));
+    NIHIL_CHECK(nihilTestSamePoints(target.points.at(0), moved.at(0)));
+    NIHIL_CHECK(target.objects.at(1).x == movedObject.x && target.objects.at(1).y == movedObject.y && target.objects.at(1).z == movedObject.z);
+    NIHIL_CHECK(!journal.redo(&target));
+    // the gaps across the varint lengths, 127 and 128 at the one byte limit, 16384 past the two bytes
+    const int gaps[] = { 0, 1, 127, 128, 16383, 16384, 2097152 };
+    std::vector<int> indices;
+    int last = 0;
+    for (int gap : gaps)
+        indices.push_back(last += gap);
+    target.points.at(1).assign(last + 1, gs::vec3(0.f, 0.f, 0.f));
+    // recorded in the reverse order, the journal sorts them
+    std::vector<int> reversed(indices.rbegin(), indices.rend());
+    journal.recordPoints(1, reversed.data(), (int)reversed.size(), step);
+    NIHIL_CHECK(journal.undo(&target));
+    NIHIL_CHECK(target.lastIndices == indices);
+    NIHIL_CHECK(journal.redo(&target));
+    NIHIL_CHECK(target.lastIndices == indices);
+    // over the budget the oldest edits are dropped, the newest one is kept even if it alone is over
+    NIHIL_CHECK(journal.getUndoCount() == 2);
+    target.translateObject(0, step);
+    journal.recordObject(0, step);
+    NIHIL_CHECK(journal.getUndoCount() == 3);
+    journal.setBudget(1);
+    NIHIL_CHECK(journal.getUndoCount() == 1 && journal.getMemoryUsage() > 0);
+    target.pointCalls = target.objectCalls = 0;
+    NIHIL_CHECK(journal.undo(&target));
+    NIHIL_CHECK(target.pointCalls == 0 && target.objectCalls == 1 && target.objects.at(0).x == 0.f);
+    NIHIL_CHECK(!journal.canUndo());
+}
+
+// Cox-de Boor by its recursion in double, the end of the domain belongs to the last span that is not empty
+static double nihilTestBasis(const std::vector<float>& knots, int k, int p, double t, double upper)
+{
+    if (!p)
+    {
+        if (t >= knots.at(k) && t < knots.at(k + 1))
+            return 1.0;
+        return (t == upper && knots.at(k) < knots.at(k + 1) && knots.at(k + 1) == upper) ? 1.0 : 0.0;
+    }
+    double r = 0.0;
+    double d1 = knots.at(k + p) - knots.at(k), d2 = knots.at(k + p + 1) - knots.at(k + 1);
+    if (d1 > 0.0)
+        r += (t - knots.at(k)) / d1 * nihilTestBasis(knots, k, p - 1, t, upper);
+    if (d2 > 0.0)
+        r += (knots.at(k + p + 1) - t) / d2 * nihilTestBasis(knots, k + 1, p - 1, t, upper);
+    return r;
+}
+
+static double nihilTestBasisDeriv(const std::vector<float>& knots, int k, int p, double t, double upper)
+{
+    double r = 0.0;
+    double d1 = knots.at(k + p) - knots.at(k), d2 = knots.at(k + p + 1) - knots.at(k + 1);
+    if (d1 > 0.0)
+        r += p * nihilTestBasis(knots, k, p - 1, t, upper) / d1;
+    if (d2 > 0.0)
+        r -= p * nihilTestBasis(knots, k + 1, p - 1, t, upper) / d2;
+    return r;
+}
+
+struct NihilTestNurbs
+{
+    int                     udegree;
+    int                     vdegree;
+    int                     ucvs;
+    int                     vcvs;
+    std::vector<float>      uknots;
+    std::vector<float>      vknots;
+    std::vector<gs::vec3>   cvs;
+    std::vector<float>      weights;                // empty if non-rational
+
+    // the point and the normal, not normalized, of the reference at (u, v)
+    void evaluate(double u, double v, double S[3], double N[3]) const
+    {
+        double h[4] = { 0.0 }, hu[4] = { 0.0 }, hv[4] = { 0.0 };
+        for (int a = 0; a < ucvs; a ++)
+        {
+            double Na = nihilTestBasis(uknots, a, udegree, u, uknots.back());
+            double Da = nihilTestBasisDeriv(uknots, a, udegree, u, uknots.back());
+            for (int b = 0; b < vcvs; b ++)
+            {
+                double Nb = nihilTestBasis(vknots, b, vdegree, v, vknots.back());
+                double Db = nihilTestBasisDeriv(vknots, b, vdegree, v, vknots.back());
+                const gs::vec3& cv = cvs.at(a * vcvs + b);
+                double w = weights.empty() ? 1.0 : weights.at(a * vcvs + b);
+                double P[4] = { cv.x * w, cv.y * w, cv.z * w, w };
+                for (int c = 0; c < 4; c ++)
+                {
+                    h[c] += Na * Nb * P[c];
+                    hu[c] += Da * Nb * P[c];
+                    hv[c] += Na * Db * P[c];
+                }
+            }
+        }
+        double Su[3], Sv[3];
+        for (int c = 0; c < 3; c ++)
+        {
+            S[c] = h[c] / h[3];
+            Su[c] = (hu[c] - hu[3] * S[c]) / h[3];
+            Sv[c] = (hv[c] - hv[3] * S[c]) / h[3];
+        }
+        N[0] = Su[1] * Sv[2] - Su[2] * Sv[1];
+        N[1] = Su[2] * Sv[0] - Su[0] * Sv[2];
+        N[2] = Su[0] * Sv[1] - Su[1] * Sv[0];
+    }
+};
+
+// clamped, with an interior knot doubled above the degree 1, the domain is [0, 4]
+static void nihilSetupTestKnots(std::vector<float>& knots, int degree)
+{
+    knots.assign(degree + 1, 0.f);
+    knots.push_back(1.f);
+    knots.push_back(degree > 1 ? 1.f : 3.f);
+    knots.insert(knots.end(), degree + 1, 4.f);
+}
+
+static void nihilSetupTestNurbs(NihilTestNurbs& nurbs, int udegree, int vdegree, bool rational, unsigned int& seed)
+{
+    nurbs.udegree = udegree;
+    nurbs.vdegree = vdegree;
+    nihilSetupTestKnots(nurbs.uknots, udegree);
+    nihilSetupTestKnots(nurbs.vknots, vdegree);
+    nurbs.ucvs = (int)nurbs.uknots.size() - udegree - 1;
+    nurbs.vcvs = (int)nurbs.vknots.size() - vdegree - 1;
+    nurbs.cvs.clear();
+    nurbs.weights.clear();
+    for (int a = 0; a < nurbs.ucvs; a ++)
+    {
+        for (int b = 0; b < nurbs.vcvs; b ++)
+        {
+            nurbs.cvs.push_back(gs::vec3(a + nihilTestRandom(seed, -0.2f, 0.2f), b + nihilTestRandom(seed, -0.2f, 0.2f), nihilTestRandom(seed, -1.f, 1.f)));
+            if (rational)
+                nurbs.weights.push_back(nihilTestRandom(seed, 0.5f, 2.f));
+        }
+    }
+}
+
+static double nihilTestLength(const double v[3])
+{
+    return sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+}
+
+// the normals of the evaluator are unit and face the reference one, the vanished ones taken a thousandth inside
+static int nihilTestNurbsMismatches(const NihilTestNurbs& nurbs, int steps)
+{
+    NihilNurbsEvaluator evaluator;
+    if (!evaluator.setup(nurbs.udegree, nurbs.vdegree, nurbs.uknots, nurbs.vknots, steps, steps))
+        return 1;
+    int samples = steps + 1;
+    std::vector<gs::vec3> points(samples * samples), normals(samples * samples);
+    evaluator.evaluate(nurbs.cvs.data(), nurbs.weights.empty() ? nullptr : nurbs.weights.data(), points.data(), normals.data(), sizeof(gs::vec3));
+    int mismatches = 0;
+    for (int i = 0; i < samples; i ++)
+    {
+        for (int j = 0; j < samples; j ++)
+        {
+            // the same params as the evaluator, the domain is [0, 4]
+            float u = ((float)j / steps) * 4.f, v = ((float)i / steps) * 4.f;
+            double S[3], N[3];
+            nurbs.evaluate(u, v, S, N);
+            const gs::vec3& p = points.at(i * samples + j);
+            if (fabs(p.x - S[0]) > 1e-4 * (1.0 + fabs(S[0])) || fabs(p.y - S[1]) > 1e-4 * (1.0 + fabs(S[1])) || fabs(p.z - S[2]) > 1e-4 * (1.0 + fabs(S[2])))
+                mismatches ++;
+            if (nihilTestLength(N) < 1e-9)
+            {
+                u += (u < 2.f) ? 4e-3f : -4e-3f;
+                v += (v < 2.f) ? 4e-3f : -4e-3f;
+                nurbs.evaluate(u, v, S, N);
+            }
+            const gs::vec3& n = normals.at(i * samples + j);
+            double length = nihilTestLength(N);
+            // written as the passing case, so that a NaN fails
+            if (!(fabsf(n.length() - 1.f) <= 1e-4f && length > 0.0 && (n.x * N[0] + n.y * N[1] + n.z * N[2]) / length >= 0.9999))
+                mismatches ++;
+        }
+    }
+    return mismatches;
+}
+
+static void nihilTestNurbsEvaluator()
+{
+    // the degrees 1 to 3 by the unrolled kernels, 4 and 5 by the loop, in both directions
+    const int degrees[][2] = { { 1, 2 }, { 2, 3 }, { 3, 1 }, { 4, 4 }, { 3, 5 }, { 5, 2 } };
+    unsigned int seed = 11;
+    NihilTestNurbs nurbs;
+    for (const auto& d : degrees)
+    {
+        nihilSetupTestNurbs(nurbs, d[0], d[1], false, seed);
+        NIHIL_CHECK(nihilTestNurbsMismatches(nurbs, 8) == 0);
+        nihilSetupTestNurbs(nurbs, d[0], d[1], true, seed);
+        NIHIL_CHECK(nihilTestNurbsMismatches(nurbs, 8) == 0);
+    }
+    // the cvs of the first column collapsed to a pole, where the normals vanish and are taken inside
+    nihilSetupTestNurbs(nurbs, 3, 3, true, seed);
+    for (int b = 0; b < nurbs.vcvs; b ++)
+        nurbs.cvs.at(b) = gs::vec3(0.f, 2.f, 0.f);
+    double S[3], N[3];
+    nurbs.evaluate(0.0, 1.0, S, N);
+    NIHIL_CHECK(nihilTestLength(N) < 1e-9);
+    NIHIL_CHECK(nihilTestNurbsMismatches(nurbs, 8) == 0);
+    // the knots that don't fit
+    NihilNurbsEvaluator evaluator;
+    std::vector<float> knots = { 0.f, 0.f, 1.f, 1.f };
+    NIHIL_CHECK(!evaluator.setup(2, 1, knots, knots, 4, 4));
+    std::vector<float> descending = { 0.f, 0.f, 2.f, 1.f, 3.f, 3.f };
+    NIHIL_CHECK(!evaluator.setup(1, 1, descending, knots, 4, 4));
+}
+
+int main(int argc, char* argv[])
+{
+    nihilTestPointGrid();
+    nihilTestMeshBvhRaycast();
+    nihilTestLasso();
+    nihilTestIdBufferOcclusion();
+    nihilTestIdBufferNearClipping();
+    nihilTestDrawKeys();
+    nihilTestCommandList();
+    nihilTestSceneBoundingBox();
+    nihilTestJournal();
+    nihilTestNurbsEvaluator();
+    if (nihilFailures)
+        printf("%d checks failed\n", nihilFailures);
+    else
+        printf("all checks passed\n");
+    return nihilFailures;
+}
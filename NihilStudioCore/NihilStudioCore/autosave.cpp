@@ -0,0 +1,269 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unordered_set>
+#include <gslib/file.h>
+#include "core.h"
+
+#define ASSERT assert
+
+static void nihilAppendFormat(std::string& text, const char* fmt, ...)
+{
+    char buf[256];
+    va_list ap;
+    va_start(ap, fmt);
+    int len = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    ASSERT(len >= 0 && len < (int)sizeof(buf));
+    text.append(buf, len);
+}
+
+static void nihilFormatPoints(std::string& text, const gs::vec3* points, int stride, int count)
+{
+    for (int i = 0; i < count; i ++)
+    {
+        const gs::vec3& p = *(const gs::vec3*)((const char*)points + stride * i);
+        nihilAppendFormat(text, "\t\t%f %f %f(%d)\n", p.x, p.y, p.z, i);
+    }
+}
+
+static void nihilFormatWeightedPoints(std::string& text, const gs::vec3* points, const float* weights, int count)
+{
+    for (int i = 0; i < count; i ++)
+        nihilAppendFormat(text, "\t\t%f %f %f %f(%d)\n", points[i].x, points[i].y, points[i].z, weights[i], i);
+}
+
+static void nihilFormatKnots(std::string& text, const char* name, const std::vector<float>& knots)
+{
+    // 10 knots a line, as the exporter does
+    nihilAppendFormat(text, "\t.%s {\n", name);
+    for (int i = 0; i < (int)knots.size(); i ++)
+    {
+        if (i % 10 == 0)
+            text.append("\t\t");
+        nihilAppendFormat(text, "%f ", knots.at(i));
+        if (i % 10 == 9 || i + 1 == (int)knots.size())
+            text.append("\n");
+    }
+    text.append("\t}\n");
+}
+
+void nihilFormatLocalSection(std::string& text, const gs::matrix& mat)
+{
+    text.append("\t.Local {\n");
+    for (int i = 0; i < 4; i ++)
+        nihilAppendFormat(text, "\t\t%f %f %f %f\n", mat.m[i][0], mat.m[i][1], mat.m[i][2], mat.m[i][3]);
+    text.append("\t}\n");
+}
+
+void nihilFormatObjectSnapshot(std::string& text, const NihilObjectSnapshot& object)
+{
+    switch (object.type)
+    {
+    case NihilObject::OT_Polygon:
+        {
+            ASSERT(object.points && object.indices);
+            const NihilPointList& points = *object.points;
+            const NihilIndexList& indices = *object.indices;
+            text.append("Polygon {\n\t.Points {\n");
+            if (!points.empty())
+                nihilFormatPoints(text, &points.front().pos, sizeof(NihilVertex), (int)points.size());
+            text.append("\t}\n\t.Faces {\n");
+            for (int i = 0; i + 2 < (int)indices.size(); i += 3)
+                nihilAppendFormat(text, "\t\t%d %d %d(%d)\n", indices.at(i), indices.at(i + 1), indices.at(i + 2), i / 3);
+            text.append("\t}\n");
+            break;
+        }
+    case NihilObject::OT_BiCubicBezierPatch:
+        {
+            ASSERT(object.cvs && object.cvs->size() == 16);
+            text.append("BiCubicBezier {\n\t.Cvs {\n");
+            nihilFormatPoints(text, object.cvs->data(), sizeof(gs::vec3), 16);
+            text.append("\t}\n");
+            break;
+        }
+    case NihilObject::OT_BiCubicNURBS:
+        {
+            ASSERT(object.cvs && (int)object.cvs->size() == object.ucvs * object.vcvs);
+            text.append("NURBS {\n");
+            nihilAppendFormat(text, "\t.NumCVs {\n\t\t%d %d\n\t}\n", object.ucvs, object.vcvs);
+            nihilAppendFormat(text, "\t.Degrees {\n\t\t%d %d\n\t}\n", object.udegrees, object.vdegrees);
+            text.append("\t.Cvs {\n");
+            // the weights follow the positions of the rational ones
+            bool rational = object.weights && !object.weights->empty();
+            ASSERT(!rational || object.weights->size() == object.cvs->size());
+            if (rational)
+                nihilFormatWeightedPoints(text, object.cvs->data(), object.weights->data(), (int)object.cvs->size());
+            else if (!object.cvs->empty())
+                nihilFormatPoints(text, object.cvs->data(), sizeof(gs::vec3), (int)object.cvs->size());
+            text.append("\t}\n");
+            nihilFormatKnots(text, "UKnots", object.uknots);
+            nihilFormatKnots(text, "VKnots", object.vknots);
+            break;
+        }
+    default:
+        ASSERT(!"Unexpected type.");
+        break;
+    }
+}
+
+void NihilAutosave::destroy()
+{
+    if (!m_thread.joinable())
+        return;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_wakeup.notify_one();
+    m_thread.join();
+    m_quit = false;
+    m_busy = false;
+    m_pending.reset();
+    m_texts.clear();
+    m_lastSignatures.clear();
+    m_lastPath.clear();
+}
+
+bool NihilAutosave::save(const NihilSceneSnapshotPtr& snapshot, const gs::string& path)
+{
+    ASSERT(snapshot && !path.empty());
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_busy)
+            return false;
+        m_pending = snapshot;
+        m_pendingPath = path;
+        m_busy = true;
+    }
+    if (!m_thread.joinable())
+        m_thread = std::thread(&NihilAutosave::saverProc, this);
+    m_wakeup.notify_one();
+    return true;
+}
+
+void NihilAutosave::wait()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_finished.wait(lock, [this]() { return !m_busy; });
+}
+
+bool NihilAutosave::isBusy() const
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_busy;
+}
+
+bool NihilAutosave::getLastResult() const
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_lastResult;
+}
+
+int NihilAutosave::getWrittenCount() const
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_writtenCount;
+}
+
+void NihilAutosave::saverProc()
+{
+    for (;;)
+    {
+        NihilSceneSnapshotPtr snapshot;
+        gs::string path;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wakeup.wait(lock, [this]() { return m_quit || m_pending; });
+            // finish the one in hand before quitting
+            if (!m_pending)
+                return;
+            snapshot.swap(m_pending);
+            path.swap(m_pendingPath);
+        }
+        bool written = false;
+        bool succeeded = true;
+        if (!isUnchanged(*snapshot, path))
+        {
+            succeeded = writeSnapshot(*snapshot, path);
+            written = succeeded;
+        }
+        // release the lists before the next edits, so that they needn't copy them
+        snapshot.reset();
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_lastResult = succeeded;
+            if (written)
+                m_writtenCount ++;
+            m_busy = false;
+        }
+        m_finished.notify_all();
+    }
+}
+
+bool NihilAutosave::isUnchanged(const NihilSceneSnapshot& snapshot, const gs::string& path) const
+{
+    if (path != m_lastPath || snapshot.objects.size() != m_lastSignatures.size())
+        return false;
+    for (int i = 0; i < (int)snapshot.objects.size(); i ++)
+    {
+        const NihilObjectSnapshot& object = snapshot.objects.at(i);
+        const Signature& signature = m_lastSignatures.at(i);
+        if (object.version != signature.version || memcmp(&object.worldMat, &signature.worldMat, sizeof(gs::matrix)))
+            return false;
+    }
+    return true;
+}
+
+const std::string& NihilAutosave::formatObject(const NihilObjectSnapshot& object)
+{
+    auto f = m_texts.find(object.version);
+    if (f != m_texts.end())
+        return f->second;
+    std::string& text = m_texts[object.version];
+    nihilFormatObjectSnapshot(text, object);
+    return text;
+}
+
+bool NihilAutosave::writeSnapshot(const NihilSceneSnapshot& snapshot, const gs::string& path)
+{
+    // 1.format the edited objects, the rest comes from the last save
+    std::string text;
+    std::unordered_set<unsigned long long> versions;
+    std::vector<Signature> signatures;
+    for (const NihilObjectSnapshot& object : snapshot.objects)
+    {
+        const std::string& body = formatObject(object);
+        text.append(body);
+        nihilFormatLocalSection(text, object.worldMat);
+        text.append("}\n");
+        versions.insert(object.version);
+        Signature signature;
+        signature.version = object.version;
+        signature.worldMat = object.worldMat;
+        signatures.push_back(signature);
+    }
+    // drop the versions of the deleted or edited objects, they never show up again
+    for (auto i = m_texts.begin(); i != m_texts.end();)
+    {
+        if (versions.find(i->first) == versions.end())
+            i = m_texts.erase(i);
+        else
+            ++ i;
+    }
+    // 2.write a temporary file then move it over the target
+    gs::string tempPath = path + _t(".tmp");
+    {
+        gs::file f(tempPath.c_str(), _t("wb"));
+        if (!f.is_valid())
+            return false;
+        if (!text.empty() && f.put((const gs::byte*)text.data(), (int)text.size()) != (int)text.size())
+            return false;
+    }
+    if (!MoveFileEx(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+        return false;
+    m_lastSignatures.swap(signatures);
+    m_lastPath = path;
+    return true;
+}
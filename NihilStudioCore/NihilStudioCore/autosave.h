@@ -0,0 +1,69 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <gslib/math.h>
+#include <gslib/string.h>
+
+struct NihilObjectSnapshot;
+struct NihilSceneSnapshot;
+typedef std::shared_ptr<const NihilSceneSnapshot> NihilSceneSnapshotPtr;
+
+/*
+ * Writes the snapshots of the scene on a thread of its own, in the text format of the loader, so that the editing
+ * never waits for the formatting or the disk.
+ * The formatted contents of each object are kept by its version, only the objects edited since the last save are
+ * formatted again, and nothing is written if neither the contents nor the transforms change.
+ * The text goes to a temporary file then moves over the target, a crash during the writing keeps the last one.
+ */
+class NihilAutosave
+{
+public:
+    NihilAutosave() {}
+    NihilAutosave(const NihilAutosave&) = delete;
+    NihilAutosave& operator=(const NihilAutosave&) = delete;
+    ~NihilAutosave() { destroy(); }
+    void destroy();                                 // finish the one in hand, then stop the thread
+    bool save(const NihilSceneSnapshotPtr& snapshot, const gs::string& path);  // false if busy, the first one starts the thread
+    void wait();                                    // until the snapshot in hand is written
+    bool isBusy() const;
+    bool getLastResult() const;                     // of the last finished save
+    int getWrittenCount() const;                    // the saves skipped for no changes don't count
+
+protected:
+    // what a save looks like, to tell if the next one changes anything
+    struct Signature
+    {
+        unsigned long long  version;
+        gs::matrix          worldMat;
+    };
+
+    std::thread             m_thread;
+    mutable std::mutex      m_mutex;
+    std::condition_variable m_wakeup;
+    std::condition_variable m_finished;
+    NihilSceneSnapshotPtr   m_pending;              // guarded by the mutex
+    gs::string              m_pendingPath;
+    bool                    m_busy = false;
+    bool                    m_quit = false;
+    bool                    m_lastResult = true;
+    int                     m_writtenCount = 0;
+    // touched by the thread only
+    std::unordered_map<unsigned long long, std::string> m_texts;    // by the versions of the objects
+    std::vector<Signature>  m_lastSignatures;
+    gs::string              m_lastPath;
+
+protected:
+    void saverProc();
+    bool writeSnapshot(const NihilSceneSnapshot& snapshot, const gs::string& path);
+    bool isUnchanged(const NihilSceneSnapshot& snapshot, const gs::string& path) const;
+    const std::string& formatObject(const NihilObjectSnapshot& object);
+};
+
+extern void nihilFormatObjectSnapshot(std::string& text, const NihilObjectSnapshot& object);   // without the local section
+extern void nihilFormatLocalSection(std::string& text, const gs::matrix& mat);
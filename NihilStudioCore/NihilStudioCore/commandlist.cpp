@@ -0,0 +1,86 @@
+#include <assert.h>
+#include <algorithm>
+#include "core.h"
+
+#define ASSERT assert
+
+gs::vec3 nihilGetDiffuseColor(int material)
+{
+    return material == NihilDrawPacket::Mat_Selected ? gs::vec3(0.6f, 0.6f, 0.5f) : gs::vec3(0.6f, 0.f, 0.f);
+}
+
+unsigned long long NihilDrawPacket::makeKey(Pass pass, int topology, int material, int streams, int level)
+{
+    ASSERT(topology >= 0 && topology <= 0x3);
+    ASSERT(material >= 0 && material <= 0xff);
+    ASSERT(streams >= 0);
+    ASSERT(level >= 0 && level <= 0xff);
+    return ((unsigned long long)pass << 62) |
+        ((unsigned long long)topology << 60) |
+        ((unsigned long long)material << 52) |
+        ((unsigned long long)(unsigned)streams << 20) |
+        ((unsigned long long)level << 12);
+}
+
+void NihilCommandList::clear()
+{
+    m_packets.clear();
+    m_streams.clear();
+}
+
+void NihilCommandList::addGeometry(NihilGeometry* geometry, const gs::matrix& mvp, int level)
+{
+    ASSERT(geometry);
+    NihilDrawPacket packet;
+    packet.geometry = geometry;
+    packet.mvp = mvp;
+    packet.material = geometry->isSelected() ? NihilDrawPacket::Mat_Selected : NihilDrawPacket::Mat_Default;
+    int streams = getStreamsNumber(geometry->getStreams());
+    if (geometry->isInstanced())
+    {
+        // the color comes from the instance stream, so the material doesn't break the batches of the streams
+        packet.key = NihilDrawPacket::makeKey(NihilDrawPacket::Pass_InstancedGeometry, NihilUIObject::Topo_TriangleList,
+            NihilDrawPacket::Mat_Default, streams, level);
+    }
+    else
+    {
+        packet.key = NihilDrawPacket::makeKey(NihilDrawPacket::Pass_Geometry, NihilUIObject::Topo_TriangleList,
+            packet.material, streams, level);
+    }
+    m_packets.push_back(packet);
+}
+
+void NihilCommandList::addUIObject(NihilUIObject* uiObject)
+{
+    ASSERT(uiObject);
+    NihilDrawPacket packet;
+    packet.uiObject = uiObject;
+    packet.key = NihilDrawPacket::makeKey(NihilDrawPacket::Pass_UI, uiObject->getTopology(), NihilDrawPacket::Mat_Default,
+        getStreamsNumber(uiObject), 0);
+    m_packets.push_back(packet);
+}
+
+void NihilCommandList::sort()
+{
+    std::stable_sort(m_packets.begin(), m_packets.end(), [](const NihilDrawPacket& a, const NihilDrawPacket& b)-> bool {
+        return a.key < b.key;
+    });
+}
+
+int NihilCommandList::getStateChanges() const
+{
+    int changes = 0;
+    for (int i = 0; i < size(); i ++)
+    {
+        if (!i || !m_packets.at(i).isSameState(m_packets.at(i - 1)))
+            changes ++;
+    }
+    return changes;
+}
+
+int NihilCommandList::getStreamsNumber(const void* streams)
+{
+    ASSERT(streams);
+    auto r = m_streams.emplace(streams, (int)m_streams.size());
+    return r.first->second;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <gslib/math.h>
+
+class NihilGeometry;
+class NihilUIObject;
+
+/*
+ * A draw of the frame. The key packs the states it needs, from the highest bits:
+ * pass (2 bits), topology (2 bits), material (8 bits), streams (32 bits), lod level (8 bits).
+ * Sorting the packets by the keys groups them by the shader first, then the topology, the material and the streams.
+ */
+struct NihilDrawPacket
+{
+    enum Pass
+    {
+        Pass_Geometry,
+        Pass_InstancedGeometry,
+        Pass_UI,                                    // drawn at last, over the geometries
+    };
+
+    enum Material
+    {
+        Mat_Default,
+        Mat_Selected,
+    };
+
+    unsigned long long      key = 0;
+    NihilGeometry*          geometry = nullptr;     // of the geometry passes
+    NihilUIObject*          uiObject = nullptr;     // of the ui pass
+    gs::matrix              mvp;                    // of the geometry passes
+    int                     material = Mat_Default; // kept for the instanced ones as well, whose keys ignore it
+
+    static unsigned long long makeKey(Pass pass, int topology, int material, int streams, int level);
+    Pass getPass() const { return (Pass)(key >> 62); }
+    int getTopology() const { return (int)(key >> 60) & 0x3; }
+    int getMaterial() const { return (int)(key >> 52) & 0xff; }
+    int getStreams() const { return (int)((key >> 20) & 0xffffffff); }
+    int getLevel() const { return (int)(key >> 12) & 0xff; }
+    bool isSameState(const NihilDrawPacket& that) const { return (key >> 52) == (that.key >> 52); }      // the same shader, topology and material
+    bool isSameStreams(const NihilDrawPacket& that) const { return (key >> 12) == (that.key >> 12); }    // and the same streams of the same level
+};
+
+typedef std::vector<NihilDrawPacket> NihilDrawPacketList;
+
+// the diffuse color of the material, shared by the backends
+extern gs::vec3 nihilGetDiffuseColor(int material);
+
+/*
+ * The draws of a frame, built by the core and consumed by the renderer, without touching any device.
+ * The streams are numbered in the order they are first added, instead of by their addresses, and sort is stable,
+ * so the same scene always draws in the same order, whatever the heap does.
+ */
+class NihilCommandList
+{
+public:
+    void clear();
+    void addGeometry(NihilGeometry* geometry, const gs::matrix& mvp, int level);
+    void addUIObject(NihilUIObject* uiObject);
+    void sort();
+    bool isEmpty() const { return m_packets.empty(); }
+    int size() const { return (int)m_packets.size(); }
+    const NihilDrawPacket& getPacket(int i) const { return m_packets.at(i); }
+    const NihilDrawPacketList& getPackets() const { return m_packets; }
+    int getStateChanges() const;        // the switches of the shader, topology and material drawing the list in order
+
+protected:
+    NihilDrawPacketList     m_packets;
+    std::unordered_map<const void*, int> m_streams; // to the numbers of the streams
+
+protected:
+    int getStreamsNumber(const void* streams);
+};
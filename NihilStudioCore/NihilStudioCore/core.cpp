@@ -1,15 +1,41 @@
 #include <assert.h>
-#include <windowsx.h>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <emmintrin.h>
 #include <gslib/error.h>
 #include <pink/utility.h>
 #include "core.h"
+#include "meshlod.h"
 #include "dx11renderer.h"
 
 #define ASSERT assert
 #undef min
 #undef max
 
+#define NIHIL_DEFAULT_REFRESH_RATE 60
+#define NIHIL_FRAME_PACING_SLACK 1.0         // milliseconds, still take a tick of the timer a bit early
+#define NIHIL_SCENE_FOVY 1.f
+
+double nihilGetMilliseconds()
+{
+#ifdef _WIN32
+    LARGE_INTEGER freq, counter;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart * 1000.0 / (double)freq.QuadPart;
+#else
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+unsigned long long nihilNewObjectVersion()
+{
+    // the objects may be created by the cores on the other threads
+    static std::atomic<unsigned long long> counter(0);
+    return ++ counter;
+}
+
 NihilCore::NihilCore()
 {
 }
@@ -21,30 +47,67 @@ NihilCore::~NihilCore()
 
 void NihilCore::setup(HWND hwnd)
 {
-    ASSERT(!m_hwnd && "DONOT setup twice.");
+    ASSERT(!m_hwnd && !m_renderer && "DONOT setup twice.");
     if (!setupWindow(hwnd) || !setupRenderer())
         destroy();
-    m_sceneConfig.setup(m_hwnd);
+    setupScene(-1);
+}
+
+bool NihilCore::setupHeadless(NihilRenderer* renderer, int workers)
+{
+    ASSERT(!m_hwnd && !m_renderer && "DONOT setup twice.");
+    ASSERT(renderer);
+    m_renderer = renderer;
+    if (!m_renderer->setup(0))
+    {
+        destroy();
+        return false;
+    }
+    // no display to be paced to, each render draws the changes at once
+    m_framePacing = false;
+    setupScene(workers);
+    return true;
+}
+
+void NihilCore::setupScene(int workers)
+{
+    m_threadPool.setup(workers);
+    UINT width, height;
+    getViewSize(width, height);
+    m_sceneConfig.setup(width, height);
+    setupFrameInterval();
     navigateScene();
 }
 
 void NihilCore::resizeWindow()
 {
-    m_sceneConfig.updateProjMatrix(m_hwnd);
+    if (!m_renderer)
+        return;
+    // the swap chain is resized, draw it at once
+    m_renderer->notifyResize();
+    UINT width, height;
+    getViewSize(width, height);
+    m_sceneConfig.updateProjMatrix(width, height);
+    drawFrame();
+}
+
+void NihilCore::getViewSize(UINT& width, UINT& height) const
+{
+    float w = 0.f, h = 0.f;
     if (m_renderer)
-    {
-        gs::matrix mat;
-        m_sceneConfig.calcMatrix(mat);
-        m_renderer->setWorldMat(mat);
-        m_renderer->notifyResize();
-        m_renderer->render();
-    }
+        m_renderer->getViewSize(w, h);
+    width = (UINT)w;
+    height = (UINT)h;
 }
 
 void NihilCore::destroy()
 {
+    // the snapshots hold only the lists, but the file should be complete
+    m_autosave.destroy();
+    m_autosavePath.clear();
     destroyController();
     destroyObjects();
+    m_threadPool.destroy();
     if (m_hwnd)
     {
         SetWindowLong(m_hwnd, GWL_USERDATA, 0);
@@ -61,33 +124,90 @@ void NihilCore::destroy()
 
 void NihilCore::render()
 {
-    if (m_renderer)
+    if (!m_renderer)
+        return;
+    updateAutosave();
+    // nothing changed since the last frame
+    if (!m_frameDirty && m_updateQueue.empty())
+        return;
+    // pace to the refresh rate, the next call draws the rest of the changes
+    if (m_framePacing && nihilGetMilliseconds() - m_lastFrameTime < m_frameInterval - NIHIL_FRAME_PACING_SLACK)
+        return;
+    drawFrame();
+}
+
+void NihilCore::drawFrame()
+{
+    ASSERT(m_renderer);
+    if (m_controller)
+        m_controller->onFrame(this);
+    m_frameDirty = false;
+    m_lastFrameTime = nihilGetMilliseconds();
+    gs::matrix mat;
+    m_sceneConfig.calcMatrix(mat);
+    updateVisibility(mat);
+    buildCommandList(mat);
+    m_renderer->render(m_commandList);
+}
+
+void NihilCore::buildCommandList(const gs::matrix& viewProj)
+{
+    ASSERT(m_renderer);
+    m_commandList.clear();
+    float width, height;
+    m_renderer->getViewSize(width, height);
+    // 1.the visible geometries in the order of the slots, so that the order of the streams is stable
+    for (int i = 0; i < m_objectTable.size(); i ++)
     {
-        gs::matrix mat;
-        m_sceneConfig.calcMatrix(mat);
-        m_renderer->setWorldMat(mat);
-        m_renderer->render();
+        NihilGeometry* geometry = m_objectTable.getGeometry(i);
+        if (!geometry || !geometry->isVisible())
+            continue;
+        gs::matrix mvp;
+        mvp.multiply(geometry->getLocalMat(), viewProj);
+        m_commandList.addGeometry(geometry, mvp, geometry->selectLodLevel(mvp, width, height));
     }
+    // 2.the ui objects over them
+    for (auto* p : m_renderer->getUIObjects())
+        m_commandList.addUIObject(p);
+    m_commandList.sort();
+}
+
+void NihilCore::setupFrameInterval()
+{
+    // a frame per refresh of the display, the virtual displays may report 0 or 1 for the default rate
+    int rate = 0;
+    if (HDC dc = m_hwnd ? GetDC(m_hwnd) : 0)
+    {
+        rate = GetDeviceCaps(dc, VREFRESH);
+        ReleaseDC(m_hwnd, dc);
+    }
+    if (rate <= 1)
+        rate = NIHIL_DEFAULT_REFRESH_RATE;
+    m_frameInterval = 1000.0 / rate;
 }
 
 void NihilCore::showSolidMode()
 {
     if (m_renderer)
         m_renderer->showSolidMode();
+    invalidate();
 }
 
 void NihilCore::showWireframeMode()
 {
     if (m_renderer)
         m_renderer->showWireframeMode();
+    invalidate();
 }
 
 void NihilCore::destroyController()
 {
+    m_journal.endEdit();
     if (m_controller)
     {
         delete m_controller;
         m_controller = nullptr;
+        invalidate();
     }
 }
 
@@ -101,12 +221,14 @@ void NihilCore::selectObject()
 {
     destroyController();
     m_controller = new NihilControl_ObjectLayer(this);
+    invalidate();
 }
 
 void NihilCore::selectPoints()
 {
     destroyController();
     m_controller = new NihilControl_PointsLayer(this);
+    invalidate();
 }
 
 void NihilCore::translateModifier()
@@ -189,10 +311,26 @@ static int readLineOfSection(const NihilString& src, NihilString& line, int star
 }
 
 bool NihilCore::loadFromTextStream(const NihilString& src)
+{
+    bool succeeded = loadObjectsFromTextStream(src);
+    // the objects loaded before any failure stay in the scene as well
+    m_sceneBvh.build(m_objectTable.getObjects());
+    invalidate();
+    return succeeded;
+}
+
+bool NihilCore::loadObjectsFromTextStream(const NihilString& src)
 {
     int start = skipBlankCharactors(src, 0);
     if (badEof(src, start))
         return false;
+    // the new polygons may also share the meshes of the ones loaded earlier
+    NihilMeshCache meshCache;
+    for (auto* p : m_objectTable.getObjects())
+    {
+        if (p->getType() == NihilObject::OT_Polygon)
+            meshCache.add(static_cast<NihilPolygon*>(p));
+    }
     NihilString prename;
     int next = prereadSectionName(src, prename, start);
     if (badEof(src, next))
@@ -202,7 +340,7 @@ bool NihilCore::loadFromTextStream(const NihilString& src)
         // format start with: Polygon {
         if (prename == _t("Polygon"))
         {
-            next = loadPolygonFromTextStream(src, start = next);
+            next = loadPolygonFromTextStream(src, start = next, meshCache);
             if (next == -1)
                 return false;
         }
@@ -232,11 +370,252 @@ bool NihilCore::loadFromTextStream(const NihilString& src)
     return true;
 }
 
+bool NihilCore::parentObject(int child, int parent, bool keepWorld)
+{
+    NihilObject* object = m_objectTable.getObject(child);
+    NihilObject* newParent = parent >= 0 ? m_objectTable.getObject(parent) : nullptr;
+    ASSERT(object);
+    if (newParent == object || object->isAncestorOf(newParent))
+        return false;
+    gs::matrix worldMat = object->getWorldMat();
+    object->setParent(newParent);
+    // keep the world placement, the local matrix is relative to the new parent
+    if (keepWorld)
+    {
+        gs::matrix localMat = worldMat;
+        if (newParent)
+        {
+            gs::matrix inv;
+            float det;
+            inv.inverse(&det, newParent->getWorldMat());
+            localMat.multiply(worldMat, inv);
+        }
+        object->setLocalMat(localMat);
+    }
+    invalidate();
+    return true;
+}
+
+void NihilCore::clearScene()
+{
+    // the layers may hold the selected objects, leave them first
+    navigateScene();
+    // the autosave belongs to the last scene, the next one sets it up again, and its signatures are not of the new objects
+    m_autosave.destroy();
+    m_autosavePath.clear();
+    m_lastAutosaveTime = 0.0;
+    destroyObjects();
+    invalidate();
+}
+
+bool NihilCore::getSceneBoundingBox(NihilBoundingBox& box)
+{
+    updateTransforms();
+    box.reset();
+    for (int i = 0; i < m_objectTable.size(); i ++)
+        box.expand(m_objectTable.getBoundingBox(i));
+    return !box.isEmpty();
+}
+
 void NihilCore::destroyObjects()
 {
-    for (auto* p : m_objectList)
+    // the journal refers the objects by their slots
+    m_journal.clear();
+    m_updateQueue.clear();
+    m_sceneBvh.clear();
+    NihilObjectList objects = m_objectTable.getObjects();
+    m_objectTable.clear();
+    for (auto* p : objects)
         delete p;
-    m_objectList.clear();
+}
+
+NihilSceneSnapshotPtr NihilCore::takeSnapshot() const
+{
+    auto snapshot = std::make_shared<NihilSceneSnapshot>();
+    snapshot->objects.resize(m_objectTable.size());
+    for (int i = 0; i < m_objectTable.size(); i ++)
+        m_objectTable.getObject(i)->takeSnapshot(snapshot->objects.at(i));
+    return snapshot;
+}
+
+void NihilCore::setupAutosave(const NihilString& path, double interval)
+{
+    m_autosavePath = path;
+    m_autosaveInterval = interval;
+    m_lastAutosaveTime = nihilGetMilliseconds();
+}
+
+bool NihilCore::saveInBackground(const NihilString& path)
+{
+    if (m_autosave.isBusy())
+        return false;
+    return m_autosave.save(takeSnapshot(), path);
+}
+
+void NihilCore::updateAutosave()
+{
+    if (m_autosavePath.empty())
+        return;
+    double now = nihilGetMilliseconds();
+    if (now - m_lastAutosaveTime < m_autosaveInterval)
+        return;
+    // still writing the last one, try again by the next call
+    if (!saveInBackground(m_autosavePath))
+        return;
+    m_lastAutosaveTime = now;
+}
+
+bool NihilCore::undo()
+{
+    if (!m_journal.undo(this))
+        return false;
+    if (m_controller)
+        m_controller->onObjectsEdited(this);
+    invalidate();
+    return true;
+}
+
+bool NihilCore::redo()
+{
+    if (!m_journal.redo(this))
+        return false;
+    if (m_controller)
+        m_controller->onObjectsEdited(this);
+    invalidate();
+    return true;
+}
+
+void NihilCore::translatePoints(int slot, const int indices[], int count, const gs::vec3& offset)
+{
+    NihilObject* object = m_objectTable.getObject(slot);
+    ASSERT(object && indices);
+    switch (object->getType())
+    {
+    case NihilObject::OT_Polygon:
+        {
+            auto& pointList = static_cast<NihilPolygon*>(object)->editPointList();
+            for (int i = 0; i < count; i ++)
+                pointList.at(indices[i]).pos += offset;
+            break;
+        }
+    case NihilObject::OT_BiCubicBezierPatch:
+        {
+            gs::vec3* cvs = static_cast<NihilBiCubicBezierPatch*>(object)->editCvs();
+            for (int i = 0; i < count; i ++)
+            {
+                ASSERT(indices[i] >= 0 && indices[i] < 16);
+                cvs[indices[i]] += offset;
+            }
+            break;
+        }
+    case NihilObject::OT_BiCubicNURBS:
+        {
+            auto& cvs = static_cast<NihilBiCubicNURBSurface*>(object)->editCvs();
+            for (int i = 0; i < count; i ++)
+                cvs.at(indices[i]) += offset;
+            break;
+        }
+    }
+    queueUpdate(object);
+}
+
+void NihilCore::translateObject(int slot, const gs::vec3& offset)
+{
+    NihilObject* object = m_objectTable.getObject(slot);
+    ASSERT(object);
+    object->appendTranslation(offset);
+    invalidate();
+}
+
+void NihilCore::queueUpdate(NihilObject* object)
+{
+    ASSERT(object);
+    if (object->isUpdateQueued())
+        return;
+    object->setUpdateQueued(true);
+    m_updateQueue.push_back(object);
+    invalidate();
+}
+
+void NihilCore::flushUpdates()
+{
+    // calculate the normals and upload the vertices once for all the edits since the last frame
+    for (auto* p : m_updateQueue)
+    {
+        ASSERT(p && p->isUpdateQueued());
+        p->setUpdateQueued(false);
+        p->updateBuffers();
+    }
+    m_updateQueue.clear();
+}
+
+void NihilCore::updateTransforms()
+{
+    // the hierarchy needs the bounding boxes of the queued edits
+    flushUpdates();
+    for (auto* p : m_objectTable.getObjects())
+    {
+        ASSERT(p);
+        if (!p->getParent())
+            p->updateTransforms();
+    }
+}
+
+void NihilCore::updateVisibility(const gs::matrix& viewProj)
+{
+    updateTransforms();
+    m_sceneBvh.refit();
+    m_sceneBvh.cull(viewProj);
+}
+
+bool NihilCore::pickObject(const gs::vec2& pt, UINT width, UINT height, NihilPickResult& result)
+{
+    result = NihilPickResult();
+    if (!width || !height)
+        return false;
+    updateTransforms();
+    m_sceneBvh.refit();
+    // 1.the ray through the point, from the near plane to the far plane in world space
+    gs::matrix viewProj, invViewProj;
+    m_sceneConfig.calcMatrix(viewProj);
+    invViewProj.inverse(nullptr, viewProj);
+    float x = pt.x * 2.f / width - 1.f;
+    float y = 1.f - pt.y * 2.f / height;
+    gs::vec3 origin, target, dir;
+    origin.transformcoord(gs::vec3(x, y, 0.f), invViewProj);
+    target.transformcoord(gs::vec3(x, y, 1.f), invViewProj);
+    dir.sub(target, origin);
+    // 2.the objects by the distances their boxes are entered, stop when the nearest hit is nearer than the next box
+    m_rayCandidates.clear();
+    m_sceneBvh.raycast(origin, dir, m_rayCandidates);
+    NihilRayHit hit;
+    int hitSlot = -1;
+    for (const NihilRayCandidate& candidate : m_rayCandidates)
+    {
+        if (candidate.distance > hit.distance)
+            break;
+        int slot = candidate.object->getTableSlot();
+        const NihilPolygon* mesh = m_objectTable.getRenderMesh(slot);
+        if (!mesh || mesh->getPointList().empty())
+            continue;
+        // 3.the ray in object space, so that the moves never rebuild the hierarchy of the mesh
+        gs::matrix invWorldMat;
+        invWorldMat.inverse(nullptr, m_objectTable.getWorldMat(slot));
+        gs::vec3 localOrigin, localDir;
+        localOrigin.transformcoord(origin, invWorldMat);
+        localDir.transformnormal(dir, invWorldMat);
+        if (mesh->getMeshBvh().raycast(mesh->getPointList().data(), mesh->getIndexList().data(), localOrigin, localDir, hit))
+            hitSlot = slot;
+    }
+    if (hitSlot < 0)
+        return false;
+    result.object = m_objectTable.getObject(hitSlot);
+    result.triangle = hit.triangle;
+    result.barycentric = gs::vec3(1.f - hit.u - hit.v, hit.u, hit.v);
+    result.position.scale(dir, hit.distance);
+    result.position.add(origin, result.position);
+    result.distance = hit.distance;
+    return true;
 }
 
 bool NihilCore::setupWindow(HWND hwnd)
@@ -264,28 +643,31 @@ bool NihilCore::setupRenderer()
     return false;
 }
 
-int NihilCore::loadPolygonFromTextStream(const NihilString& src, int start)
+int NihilCore::loadPolygonFromTextStream(const NihilString& src, int start, NihilMeshCache& meshCache)
 {
     NihilPolygon* polygon = new NihilPolygon(m_renderer);
     ASSERT(polygon);
-    m_objectList.push_back(polygon);
-    return polygon->loadPolygonFromTextStream(src, start);
+    int next = polygon->loadPolygonFromTextStream(src, start, &meshCache);
+    m_objectTable.add(polygon);     // even if failed, so it gets deleted with the others
+    return next;
 }
 
 int NihilCore::loadBiCubicBezierPatchFromTextStream(const NihilString& src, int start)
 {
     NihilBiCubicBezierPatch* biCubicBezier = new NihilBiCubicBezierPatch(m_renderer);
     ASSERT(biCubicBezier);
-    m_objectList.push_back(biCubicBezier);
-    return biCubicBezier->loadBiCubicBezierPatchFromTextStream(src, start);
+    int next = biCubicBezier->loadBiCubicBezierPatchFromTextStream(src, start);
+    m_objectTable.add(biCubicBezier);
+    return next;
 }
 
 int NihilCore::loadNurbsFromTextStream(const NihilString& src, int start)
 {
     NihilBiCubicNURBSurface* biCubicNurbs = new NihilBiCubicNURBSurface(m_renderer);
     ASSERT(biCubicNurbs);
-    m_objectList.push_back(biCubicNurbs);
-    return biCubicNurbs->loadBiCubicNURBSFromTextStream(src, start);
+    int next = biCubicNurbs->loadBiCubicNURBSFromTextStream(src, start);
+    m_objectTable.add(biCubicNurbs);
+    return next;
 }
 
 LRESULT NihilCore::wndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
@@ -315,28 +697,34 @@ LRESULT NihilCore::wndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
             PAINTSTRUCT ps;
             BeginPaint(hwnd, &ps);
             EndPaint(hwnd, &ps);
+            core->invalidate();     // exposed, draw it again by the next render
             break;
         }
     }
     return oldWndProc(hwnd, msg, wParam, lParam);
 }
 
-void NihilSceneConfig::setup(HWND hwnd)
+void NihilSceneConfig::setup(UINT width, UINT height)
 {
     m_model.identity();
-    updateProjMatrix(hwnd);
+    updateProjMatrix(width, height);
     updateViewMatrix();
 }
 
-void NihilSceneConfig::updateProjMatrix(HWND hwnd)
+void NihilSceneConfig::updateProjMatrix(UINT width, UINT height)
 {
-    RECT rc;
-    GetClientRect(hwnd, &rc);
-    UINT width = rc.right - rc.left;
-    UINT height = rc.bottom - rc.top;
     // const float fovy = 1.570796327f;
-    const float fovy = 1.f;
-    m_proj.perspectivefovlh(fovy, (float)width / height, 0.01f, 100.f);
+    const float fovy = NIHIL_SCENE_FOVY;
+    m_proj.perspectivefovlh(fovy, (float)width / height, m_zn, m_zf);
+}
+
+float NihilSceneConfig::calcFitDistance(float radius, UINT width, UINT height) const
+{
+    // the narrower one of the vertical and the horizontal fields of view
+    float t = tanf(NIHIL_SCENE_FOVY * 0.5f);
+    if (width < height)
+        t *= (float)width / height;
+    return radius / sinf(atanf(t));
 }
 
 void NihilSceneConfig::updateViewMatrix()
@@ -405,6 +793,17 @@ void NihilSceneConfig::updateTranslation(const gs::vec2& lastpt, const gs::vec2&
     updateViewMatrix();
 }
 
+void NihilSceneConfig::setupOrbit(float rot1, float rot2, float distance, const gs::vec3& center)
+{
+    m_rot1 = rot1;
+    m_rot2 = rot2;
+    nihilKeepRotInDomain(m_rot1);
+    nihilKeepRotInDomain(m_rot2);
+    m_cdis = distance;
+    m_viewOffset = gs::vec3(-center.x, -center.y, -center.z);
+    updateViewMatrix();
+}
+
 gs::vec3 NihilSceneConfig::getTranslationInCurrentView(const gs::vec2& lastpt, const gs::vec2& pt) const
 {
     gs::matrix mat;
@@ -422,18 +821,173 @@ gs::vec3 NihilSceneConfig::getTranslationInCurrentView(const gs::vec2& lastpt, c
     return (const gs::vec3&)t;
 }
 
+#define NIHIL_LOD_PIXEL_TOLERANCE 1.f
+
+int NihilGeometry::selectLodLevel(const gs::matrix& mvp, float width, float height) const
+{
+    if (m_lodErrors.size() < 2)
+        return 0;
+    gs::vec4 c;
+    m_lodCenter.transform(c, mvp);
+    // the center is behind or right on the eye, keep the full resolution
+    if (c.w <= 1e-4f)
+        return 0;
+    // pixels covered by a unit length in object space around the center
+    float sx = gs::vec3(mvp._11, mvp._21, mvp._31).length() * 0.5f * width;
+    float sy = gs::vec3(mvp._12, mvp._22, mvp._32).length() * 0.5f * height;
+    float pixelsPerUnit = std::max(sx, sy) / c.w;
+    int level = 0;
+    for (int i = 1; i < (int)m_lodErrors.size(); i++)
+    {
+        if (m_lodErrors.at(i) * pixelsPerUnit > NIHIL_LOD_PIXEL_TOLERANCE)
+            break;
+        level = i;
+    }
+    return level;
+}
+
+NihilObject::~NihilObject()
+{
+    setParent(nullptr);
+    for (auto* p : m_children)
+    {
+        ASSERT(p && p->m_parent == this);
+        p->m_parent = nullptr;
+        p->invalidateWorldMat();
+    }
+    m_children.clear();
+}
+
+const gs::matrix& NihilObject::getWorldMat() const
+{
+    if (m_worldDirty)
+    {
+        if (m_parent)
+            m_worldMat.multiply(m_localMat, m_parent->getWorldMat());
+        else
+            m_worldMat = m_localMat;
+        m_worldDirty = false;
+    }
+    return m_worldMat;
+}
+
+void NihilObject::setParent(NihilObject* parent)
+{
+    if (m_parent == parent)
+        return;
+    ASSERT(parent != this && !isAncestorOf(parent) && "Cycles in the hierarchy.");
+    if (m_parent)
+    {
+        auto& siblings = m_parent->m_children;
+        auto f = std::find(siblings.begin(), siblings.end(), this);
+        ASSERT(f != siblings.end());
+        siblings.erase(f);
+    }
+    m_parent = parent;
+    if (m_parent)
+        m_parent->m_children.push_back(this);
+    invalidateWorldMat();
+}
+
+bool NihilObject::isAncestorOf(const NihilObject* object) const
+{
+    for (const NihilObject* p = object ? object->m_parent : nullptr; p; p = p->m_parent)
+    {
+        if (p == this)
+            return true;
+    }
+    return false;
+}
+
 void NihilObject::appendTranslation(const gs::vec3& ofs)
 {
+    // bring the offset into the space of the parent
+    gs::vec3 t = ofs;
+    if (m_parent)
+    {
+        gs::matrix inv;
+        float det;
+        inv.inverse(&det, m_parent->getWorldMat());
+        t.transformnormal(inv);
+    }
     gs::matrix mat;
-    mat.translation(ofs.x, ofs.y, ofs.z);
+    mat.translation(t.x, t.y, t.z);
     m_localMat.multiply(mat);
-    updateLocalMat();
+    invalidateWorldMat();
 }
 
-void NihilObject::updateLocalMat()
+void NihilObject::invalidateWorldMat()
 {
-    if (m_geometry)
-        m_geometry->setLocalMat(m_localMat);
+    invalidateSubtree();
+    // so that updateTransforms finds the way down to this subtree
+    for (NihilObject* p = m_parent; p && !p->m_hasDirtyChildren; p = p->m_parent)
+        p->m_hasDirtyChildren = true;
+}
+
+void NihilObject::invalidateSubtree()
+{
+    // the descendants of a dirty node are always dirty, stop here, so a dragged group costs O(1) between two frames
+    if (m_worldDirty && m_transformDirty)
+        return;
+    m_worldDirty = true;
+    m_transformDirty = true;
+    for (auto* p : m_children)
+        p->invalidateSubtree();
+}
+
+void NihilObject::updateTransforms()
+{
+    if (m_transformDirty)
+    {
+        if (m_geometry)
+            m_geometry->setLocalMat(getWorldMat());
+        updateBoundingBox();
+        m_transformDirty = false;
+    }
+    else if (!m_hasDirtyChildren)
+        return;
+    m_hasDirtyChildren = false;
+    for (auto* p : m_children)
+        p->updateTransforms();
+}
+
+void NihilObject::updateLocalBoundingBox()
+{
+    m_localBoundingBox.reset();
+    calcLocalBoundingBox(m_localBoundingBox);
+    updateBoundingBox();
+}
+
+void NihilObject::updateBoundingBox()
+{
+    m_boundingBox.transform(m_localBoundingBox, getWorldMat());
+    if (m_sceneBvh)
+        m_sceneBvh->markDirty(m_bvhLeaf);
+    if (m_objectTable)
+        m_objectTable->updateTransform(m_tableSlot, getWorldMat(), m_boundingBox);
+}
+
+void NihilObject::setSelected(bool b)
+{
+    if (m_objectTable)
+        m_objectTable->setSelected(m_tableSlot, b);
+    else if (auto* geometry = getRenderGeometry())
+        geometry->setSelected(b);
+}
+
+bool NihilObject::isSelected() const
+{
+    if (m_objectTable)
+        return m_objectTable->isSelected(m_tableSlot);
+    auto* geometry = getRenderGeometry();
+    return geometry ? geometry->isSelected() : false;
+}
+
+void NihilObject::takeBaseSnapshot(NihilObjectSnapshot& snapshot) const
+{
+    snapshot.type = getType();
+    snapshot.version = m_version;
+    snapshot.worldMat = getWorldMat();
 }
 
 int NihilObject::loadLocalSectionFromTextStream(const NihilString& src, int start)
@@ -482,6 +1036,7 @@ NihilPolygon::NihilPolygon(NihilRenderer* renderer)
 {
     ASSERT(renderer);
     m_renderer = renderer;
+    m_mesh = std::make_shared<NihilMeshData>();
     m_geometry = renderer->addGeometry();
     ASSERT(m_geometry);
 }
@@ -494,7 +1049,7 @@ NihilPolygon::~NihilPolygon()
     m_geometry = nullptr;
 }
 
-int NihilPolygon::loadPolygonFromTextStream(const NihilString& src, int start)
+int NihilPolygon::loadPolygonFromTextStream(const NihilString& src, int start, NihilMeshCache* meshCache)
 {
     int next = enterSection(src, start);
     if (badEof(src, next))
@@ -557,28 +1112,41 @@ int NihilPolygon::loadPolygonFromTextStream(const NihilString& src, int start)
         // setup a default matrix
         m_localMat.identity();
     }
-    // so far so good, finally setup the buffers to geometry
-    if (!setupGeometryBuffers())
-        return -1;
+    updateLocalBoundingBox();
+    // so far so good, share the mesh of an identical polygon, or finally setup the buffers to geometry
+    NihilPolygon* prototype = meshCache ? meshCache->find(*m_mesh) : nullptr;
+    if (prototype)
+        shareMeshOf(prototype);
+    else
+    {
+        if (!setupGeometryBuffers())
+            return -1;
+        setupLodChain();
+        if (meshCache)
+            meshCache->add(this);
+    }
     ASSERT(src.at(next) == _t('}'));
     return ++ next;
 }
 
 void NihilPolygon::calculateNormals()
 {
+    // copy the points held by a snapshot first
+    NihilPointList& pointList = m_mesh->pointList.edit();
+    const NihilIndexList& indexList = m_mesh->indexList;
     // 1.set all the normals to 0
-    for (NihilVertex& v : m_pointList)
+    for (NihilVertex& v : pointList)
         v.normal = gs::vec3(0.f, 0.f, 0.f);
     // 2.calculate normals for each face, normalize it, add it up to the normals of each point
-    ASSERT(m_indexList.size() % 3 == 0);
-    for (int m = 0; m < (int)m_indexList.size(); m += 3)
-    {
-        int i = m_indexList.at(m);
-        int j = m_indexList.at(m + 1);
-        int k = m_indexList.at(m + 2);
-        NihilVertex& v1 = m_pointList.at(i);
-        NihilVertex& v2 = m_pointList.at(j);
-        NihilVertex& v3 = m_pointList.at(k);
+    ASSERT(indexList.size() % 3 == 0);
+    for (int m = 0; m < (int)indexList.size(); m += 3)
+    {
+        int i = indexList.at(m);
+        int j = indexList.at(m + 1);
+        int k = indexList.at(m + 2);
+        NihilVertex& v1 = pointList.at(i);
+        NihilVertex& v2 = pointList.at(j);
+        NihilVertex& v3 = pointList.at(k);
         gs::vec3 normal;
         normal.cross(gs::vec3().sub(v2.pos, v1.pos), gs::vec3().sub(v3.pos, v2.pos)).normalize();
         v1.normal += normal;
@@ -586,7 +1154,7 @@ void NihilPolygon::calculateNormals()
         v3.normal += normal;
     }
     // 3.normalize each of the normals
-    for (NihilVertex& v : m_pointList)
+    for (NihilVertex& v : pointList)
         v.normal.normalize();
 }
 
@@ -594,29 +1162,119 @@ bool NihilPolygon::setupGeometryBuffers()
 {
     ASSERT(m_geometry);
     // create vertex buffer
-    if (!m_geometry->createVertexStream(&m_pointList.front(), (int)m_pointList.size()))
+    if (!m_geometry->createVertexStream(&m_mesh->pointList.front(), (int)m_mesh->pointList.size()))
     {
         ASSERT(!"Create vertex buffer failed.");
         return false;
     }
     // create index buffer
-    if (!m_geometry->createIndexStream(&m_indexList.front(), (int)m_indexList.size()))
+    if (!m_geometry->createIndexStream(&m_mesh->indexList.front(), (int)m_mesh->indexList.size()))
     {
         ASSERT(!"Create index buffer failed.");
         return false;
     }
     // set local transformations
-    m_geometry->setLocalMat(m_localMat);
+    m_geometry->setLocalMat(getWorldMat());
     return true;
 }
 
+void NihilPolygon::setupLodChain()
+{
+    ASSERT(m_mesh->lodIndexLists.empty());
+    if ((int)m_mesh->indexList.size() / 3 < NIHIL_LOD_MIN_SOURCE_FACES)
+        return;
+    NihilLodChain chain;
+    nihilBuildLodChain(chain, m_mesh->pointList, m_mesh->indexList);
+    if (chain.empty())
+        return;
+    m_mesh->lodErrors.push_back(0.f);
+    for (NihilLodLevel& level : chain)
+    {
+        m_mesh->lodIndexLists.push_back(NihilIndexList());
+        m_mesh->lodIndexLists.back().swap(level.indexList);
+        m_mesh->lodErrors.push_back(level.error);
+    }
+    setupLodStreams();
+}
+
+void NihilPolygon::setupLodStreams()
+{
+    ASSERT(m_geometry);
+    if (m_mesh->lodIndexLists.empty())
+        return;
+    std::vector<float> errors;
+    errors.push_back(0.f);
+    for (NihilIndexList& indexList : m_mesh->lodIndexLists)
+    {
+        if (!m_geometry->createLodIndexStream((int)errors.size(), &indexList.front(), (int)indexList.size()))
+        {
+            ASSERT(!"Create lod index buffer failed.");
+            break;
+        }
+        errors.push_back(m_mesh->lodErrors.at(errors.size()));
+    }
+    // measure the projected size at the center of the bounding box
+    m_geometry->setLodBound(m_localBoundingBox.getCenter());
+    m_geometry->setLodErrors(errors);
+}
+
+void NihilPolygon::shareMeshOf(NihilPolygon* prototype)
+{
+    ASSERT(prototype && prototype != this);
+    ASSERT(m_geometry && prototype->m_geometry);
+    m_mesh = prototype->m_mesh;
+    m_geometry->shareStreamsOf(prototype->m_geometry);
+    m_geometry->setLocalMat(getWorldMat());
+}
+
+void NihilPolygon::detachMesh()
+{
+    if (!isMeshShared())
+        return;
+    // copy on write, the other instances keep the original mesh
+    m_mesh = std::make_shared<NihilMeshData>(*m_mesh);
+    ASSERT(m_geometry);
+    m_geometry->unshareStreams();
+    if (setupGeometryBuffers())
+        setupLodStreams();
+}
+
+const NihilMeshBvh& NihilPolygon::getMeshBvh() const
+{
+    // kept in the object space and shared by the instances, the transforms never invalidate it
+    NihilMeshData& mesh = *m_mesh;
+    if (mesh.bvhState == NihilMeshData::BS_Rebuild)
+        mesh.bvh.build(mesh.pointList.data(), mesh.indexList.data(), (int)mesh.indexList.size() / 3);
+    else if (mesh.bvhState == NihilMeshData::BS_Refit)
+        mesh.bvh.refit(mesh.pointList.data(), mesh.indexList.data());
+    mesh.bvhState = NihilMeshData::BS_Valid;
+    return mesh.bvh;
+}
+
+void NihilPolygon::calcLocalBoundingBox(NihilBoundingBox& box) const
+{
+    for (const NihilVertex& v : m_mesh->pointList)
+        box.expand(v.pos);
+}
+
+void NihilPolygon::takeSnapshot(NihilObjectSnapshot& snapshot) const
+{
+    takeBaseSnapshot(snapshot);
+    snapshot.points = m_mesh->pointList.share();
+    snapshot.indices = m_mesh->indexList.share();
+}
+
 void NihilPolygon::updateBuffers()
 {
+    ASSERT(!isMeshShared() && "Edit the points by editPointList.");
     if (m_geometry)
     {
-        calculateNormals();
-        m_geometry->updateVertexStream(&m_pointList.front(), (int)m_pointList.size());
+        // the lod levels share the vertex stream, so they follow the edits as well
+        if (!m_analyticNormals)
+            calculateNormals();
+        m_geometry->updateVertexStream(&m_mesh->pointList.front(), (int)m_mesh->pointList.size());
     }
+    updateLocalBoundingBox();
 }
 
 int NihilPolygon::loadPointSectionFromTextStream(const NihilString& src, int start)
@@ -644,7 +1302,7 @@ int NihilPolygon::loadPointSectionFromTextStream(const NihilString& src, int sta
         NihilVertex v;
         v.pos = gs::vec3(x, y, z);
         v.normal = gs::vec3(0.f, 0.f, 0.f);
-        m_pointList.push_back(v);
+        m_mesh->pointList.edit().push_back(v);
         // step on
         next = skipBlankCharactors(src, start = next);
         if (badEof(src, next))
@@ -677,9 +1335,10 @@ int NihilPolygon::loadFaceSectionFromTextStream(const NihilString& src, int star
             return -1;
         }
         // write index
-        m_indexList.push_back(i);
-        m_indexList.push_back(j);
-        m_indexList.push_back(k);
+        NihilIndexList& indexList = m_mesh->indexList.edit();
+        indexList.push_back(i);
+        indexList.push_back(j);
+        indexList.push_back(k);
         // step on
         next = skipBlankCharactors(src, start = next);
         if (badEof(src, next))
@@ -689,6 +1348,135 @@ int NihilPolygon::loadFaceSectionFromTextStream(const NihilString& src, int star
     return ++next;
 }
 
+static unsigned long long nihilHashBytes(unsigned long long h, const void* data, size_t size)
+{
+    // FNV-1a
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i ++)
+    {
+        h ^= p[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+static unsigned long long nihilHashMesh(const NihilMeshData& mesh)
+{
+    // the normals derive from the rest, leave them out
+    unsigned long long h = 0xcbf29ce484222325ull;
+    for (const NihilVertex& v : mesh.pointList)
+        h = nihilHashBytes(h, &v.pos, sizeof(v.pos));
+    if (!mesh.indexList.empty())
+        h = nihilHashBytes(h, &mesh.indexList.front(), sizeof(int) * mesh.indexList.size());
+    return h;
+}
+
+static bool nihilIsIdenticalMesh(const NihilMeshData& mesh1, const NihilMeshData& mesh2)
+{
+    if (mesh1.pointList.size() != mesh2.pointList.size() || mesh1.indexList.get() != mesh2.indexList.get())
+        return false;
+    for (size_t i = 0; i < mesh1.pointList.size(); i ++)
+    {
+        if (memcmp(&mesh1.pointList.at(i).pos, &mesh2.pointList.at(i).pos, sizeof(gs::vec3)))
+            return false;
+    }
+    return true;
+}
+
+void NihilMeshCache::add(NihilPolygon* polygon)
+{
+    ASSERT(polygon);
+    m_polygons.insert(std::make_pair(nihilHashMesh(polygon->getMeshData()), polygon));
+}
+
+NihilPolygon* NihilMeshCache::find(const NihilMeshData& mesh) const
+{
+    if (mesh.pointList.empty() || mesh.indexList.empty())
+        return nullptr;
+    auto range = m_polygons.equal_range(nihilHashMesh(mesh));
+    for (auto i = range.first; i != range.second; ++ i)
+    {
+        if (nihilIsIdenticalMesh(i->second->getMeshData(), mesh))
+            return i->second;
+    }
+    return nullptr;
+}
+
+int NihilObjectTable::add(NihilObject* object)
+{
+    ASSERT(object);
+    int slot = (int)m_objects.size();
+    NihilGeometry* geometry = object->getRenderGeometry();
+    m_objects.push_back(object);
+    m_types.push_back(object->getType());
+    m_selection.resize(slot + 1);
+    if (geometry)
+        geometry->setSelected(false);
+    m_worldMats.push_back(object->getWorldMat());
+    m_boundingBoxes.push_back(object->getBoundingBox());
+    m_geometries.push_back(geometry);
+    object->setObjectTableSlot(this, slot);
+    return slot;
+}
+
+void NihilObjectTable::clear()
+{
+    for (auto* p : m_objects)
+        p->setObjectTableSlot(nullptr, -1);
+    m_objects.clear();
+    m_types.clear();
+    m_selection.resize(0);
+    m_worldMats.clear();
+    m_boundingBoxes.clear();
+    m_geometries.clear();
+}
+
+void NihilObjectTable::onSelectionChanged(const NihilSelectionSet* selection, const gs::vbitset& changed)
+{
+    ASSERT(selection == &m_selection);
+    for (int i = changed.find_next(0); i >= 0; i = changed.find_next(i + 1))
+    {
+        if (NihilGeometry* geometry = m_geometries.at(i))
+            geometry->setSelected(m_selection.isSelected(i));
+    }
+}
+
+void NihilObjectTable::onElementChanged(const NihilSelectionSet* selection, int i)
+{
+    ASSERT(selection == &m_selection);
+    if (NihilGeometry* geometry = m_geometries.at(i))
+        geometry->setSelected(m_selection.isSelected(i));
+}
+
+void NihilObjectTable::collectSelected(NihilObjectList& objects) const
+{
+    objects.clear();
+    for (int i = m_selection.findNext(0); i >= 0; i = m_selection.findNext(i + 1))
+        objects.push_back(m_objects.at(i));
+}
+
+NihilPolygon* NihilObjectTable::getRenderMesh(int slot) const
+{
+    NihilObject* object = getObject(slot);
+    ASSERT(object);
+    switch (getType(slot))
+    {
+    case NihilObject::OT_Polygon:
+        return static_cast<NihilPolygon*>(object);
+    case NihilObject::OT_BiCubicBezierPatch:
+        return static_cast<NihilBiCubicBezierPatch*>(object)->getGridMesh();
+    case NihilObject::OT_BiCubicNURBS:
+        return static_cast<NihilBiCubicNURBSurface*>(object)->getGridMesh();
+    }
+    return nullptr;
+}
+
+void NihilObjectTable::updateTransform(int slot, const gs::matrix& worldMat, const NihilBoundingBox& box)
+{
+    m_worldMats.at(slot) = worldMat;
+    m_boundingBoxes.at(slot) = box;
+}
+
 NihilBiCubicBezierPatch::NihilBiCubicBezierPatch(NihilRenderer* renderer)
 {
     ASSERT(renderer);
@@ -765,24 +1553,31 @@ int NihilBiCubicBezierPatch::loadBiCubicBezierPatchFromTextStream(const NihilStr
 void NihilBiCubicBezierPatch::updateBuffers()
 {
     updateGridMesh();
+    updateLocalBoundingBox();
+}
+
+void NihilBiCubicBezierPatch::takeSnapshot(NihilObjectSnapshot& snapshot) const
+{
+    takeBaseSnapshot(snapshot);
+    snapshot.cvs = std::make_shared<const std::vector<gs::vec3>>(m_cvs, m_cvs + 16);
 }
 
-void NihilBiCubicBezierPatch::setSelected(bool b)
+void NihilBiCubicBezierPatch::setVisible(bool b)
 {
     if (m_gridMesh)
-        m_gridMesh->setSelected(b);
+        m_gridMesh->setVisible(b);
 }
 
-bool NihilBiCubicBezierPatch::isSelected() const
+bool NihilBiCubicBezierPatch::isVisible() const
 {
-    return m_gridMesh ? m_gridMesh->isSelected() : false;
+    return m_gridMesh ? m_gridMesh->isVisible() : false;
 }
 
-void NihilBiCubicBezierPatch::appendTranslation(const gs::vec3& ofs)
+void NihilBiCubicBezierPatch::calcLocalBoundingBox(NihilBoundingBox& box) const
 {
-    __super::appendTranslation(ofs);
+    // the grid mesh shares the local matrix, and it is what we actually draw
     if (m_gridMesh)
-        m_gridMesh->appendTranslation(ofs);
+        m_gridMesh->calcLocalBoundingBox(box);
 }
 
 int NihilBiCubicBezierPatch::loadCvsSectionFromTextStream(const NihilString& src, int start)
@@ -873,7 +1668,17 @@ static void nihilPrepareBiCubicSampleMatrix(matrix& matX, matrix& matY, matrix&
     matZ.multiply(mbt);
 }
 
-static void nihilSampleBiCubicPatch(vec3 vertices[], int ustep, int vstep, const matrix& matX, const matrix& matY, const matrix& matZ)
+// the normal of the faces, dP/dv x dP/du, not normalized
+static void nihilCalcBiCubicPatchNormal(vec3& normal, float u, float v, const matrix& matX, const matrix& matY, const matrix& matZ)
+{
+    vec4 m(1.f, u, u * u, u * u * u), mu(0.f, 1.f, 2.f * u, 3.f * u * u);
+    vec4 n(1.f, v, v * v, v * v * v), nv(0.f, 1.f, 2.f * v, 3.f * v * v);
+    vec3 pu(vec4().multiply(mu, matX).dot(n), vec4().multiply(mu, matY).dot(n), vec4().multiply(mu, matZ).dot(n));
+    vec3 pv(vec4().multiply(m, matX).dot(nv), vec4().multiply(m, matY).dot(nv), vec4().multiply(m, matZ).dot(nv));
+    normal.cross(pv, pu);
+}
+
+static void nihilSampleBiCubicPatch(NihilVertex vertices[], int ustep, int vstep, const matrix& matX, const matrix& matY, const matrix& matZ, float degenerate)
 {
     ASSERT(vertices);
     ASSERT(ustep >= 2 && vstep >= 2);
@@ -883,17 +1688,29 @@ static void nihilSampleBiCubicPatch(vec3 vertices[], int ustep, int vstep, const
     int i, j, k;
     for (i = k = 0, u = 0.f; i < ustep; i ++, u += uchord)
     {
-        vec4 m(1.f, u, u * u, u * u * u);
+        // the column shares the products of u, the partial derivatives come from the derivatives of the powers
+        vec4 m(1.f, u, u * u, u * u * u), mu(0.f, 1.f, 2.f * u, 3.f * u * u);
+        vec4 ax, ay, az, aux, auy, auz;
+        ax.multiply(m, matX);
+        ay.multiply(m, matY);
+        az.multiply(m, matZ);
+        aux.multiply(mu, matX);
+        auy.multiply(mu, matY);
+        auz.multiply(mu, matZ);
         for (j = 0, v = 0.f; j < vstep; j ++, v += vchord)
         {
-            vec4 n(1.f, v, v * v, v * v * v);
-            float x = vec4().multiply(m, matX).dot(n);
-            float y = vec4().multiply(m, matY).dot(n);
-            float z = vec4().multiply(m, matZ).dot(n);
-            vertices[k ++] = vec3(x, y, z);
-#ifdef _DEBUG
-            trace(_t("curve -d 3 -p %f %f %f;\n"), x, y, z);
-#endif
+            vec4 n(1.f, v, v * v, v * v * v), nv(0.f, 1.f, 2.f * v, 3.f * v * v);
+            NihilVertex& vertex = vertices[k ++];
+            vertex.pos = vec3(ax.dot(n), ay.dot(n), az.dot(n));
+            vec3 pu(aux.dot(n), auy.dot(n), auz.dot(n));
+            vec3 pv(ax.dot(nv), ay.dot(nv), az.dot(nv));
+            vertex.normal.cross(pv, pu);
+            // take the vanished ones, e.g. on the collapsed edges, a thousandth inside toward the middle
+            if (vertex.normal.lengthsq() <= degenerate)
+                nihilCalcBiCubicPatchNormal(vertex.normal, u < 0.5f ? u + 1e-3f : u - 1e-3f, v < 0.5f ? v + 1e-3f : v - 1e-3f, matX, matY, matZ);
+            float len2 = vertex.normal.lengthsq();
+            if (len2 > 0.f)
+                vertex.normal.scale(1.f / sqrtf(len2));
         }
     }
 }
@@ -903,7 +1720,11 @@ void NihilBiCubicBezierPatch::loadFinished()
     ASSERT(!m_gridMesh);
     m_gridMesh = new NihilPolygon(m_renderer);
     ASSERT(m_gridMesh);
-    m_gridMesh->setLocalMat(m_localMat);
+    m_gridMesh->setParent(this);
+    // the patch places the grid mesh
+    matrix gridMat;
+    gridMat.identity();
+    m_gridMesh->setLocalMat(gridMat);
     m_ustep = std::max(
         nihilGetBiCubicBezierInterpolationStep(m_cvs[0], m_cvs[1], m_cvs[2], m_cvs[3]),
         nihilGetBiCubicBezierInterpolationStep(m_cvs[12], m_cvs[13], m_cvs[14], m_cvs[15])
@@ -913,24 +1734,27 @@ void NihilBiCubicBezierPatch::loadFinished()
         nihilGetBiCubicBezierInterpolationStep(m_cvs[3], m_cvs[7], m_cvs[11], m_cvs[15])
         );
     m_ustep = m_vstep = 8;
+    m_gridMesh->m_analyticNormals = true;
     updateGridMeshPoints();
     createGridMeshIndices();
-    m_gridMesh->calculateNormals();
     m_gridMesh->setupGeometryBuffers();
+    updateLocalBoundingBox();
 }
 
 void NihilBiCubicBezierPatch::updateGridMeshPoints()
 {
     matrix matX, matY, matZ;
     nihilPrepareBiCubicSampleMatrix(matX, matY, matZ, m_cvs);
+    // the normals as long as a millionth of the size of the patch count as vanished
+    NihilBoundingBox box;
+    for (const vec3& cv : m_cvs)
+        box.expand(cv);
+    float size2 = vec3().sub(box.maxpt, box.minpt).lengthsq();
     int size = m_ustep * m_vstep;
-    std::unique_ptr<vec3[]> vertices(new vec3[size]);
-    nihilSampleBiCubicPatch(vertices.get(), m_ustep, m_vstep, matX, matY, matZ);
     ASSERT(m_gridMesh);
-    NihilPointList& ptList = m_gridMesh->getPointList();
+    NihilPointList& ptList = m_gridMesh->editPointList();
     ptList.resize(size);
-    for (int i = 0; i < size; i ++)
-        ptList.at(i).pos = vertices[i];
+    nihilSampleBiCubicPatch(&ptList.front(), m_ustep, m_vstep, matX, matY, matZ, size2 * size2 * 1e-12f);
 }
 
 void NihilBiCubicBezierPatch::updateGridMesh()
@@ -943,7 +1767,7 @@ void NihilBiCubicBezierPatch::updateGridMesh()
 void NihilBiCubicBezierPatch::createGridMeshIndices()
 {
     int size = (m_ustep - 1) * (m_vstep - 1);
-    NihilIndexList& indexList = m_gridMesh->getIndexList();
+    NihilIndexList& indexList = m_gridMesh->editIndexList();
     indexList.resize(size * 6);
     int* indices = &indexList.front();
     int i, j, k;
@@ -1037,24 +1861,38 @@ NihilBiCubicNURBSurface::~NihilBiCubicNURBSurface()
 void NihilBiCubicNURBSurface::updateBuffers()
 {
     updateGridMesh();
+    updateLocalBoundingBox();
+}
+
+void NihilBiCubicNURBSurface::takeSnapshot(NihilObjectSnapshot& snapshot) const
+{
+    takeBaseSnapshot(snapshot);
+    snapshot.cvs = m_cvs.share();
+    snapshot.weights = m_weights.share();
+    snapshot.uknots = m_uknots;
+    snapshot.vknots = m_vknots;
+    snapshot.ucvs = getUCvs();
+    snapshot.vcvs = getVCvs();
+    snapshot.udegrees = m_udegrees;
+    snapshot.vdegrees = m_vdegrees;
 }
 
-void NihilBiCubicNURBSurface::setSelected(bool b)
+void NihilBiCubicNURBSurface::setVisible(bool b)
 {
     if (m_gridMesh)
-        m_gridMesh->setSelected(b);
+        m_gridMesh->setVisible(b);
 }
 
-bool NihilBiCubicNURBSurface::isSelected() const
+bool NihilBiCubicNURBSurface::isVisible() const
 {
-    return m_gridMesh ? m_gridMesh->isSelected() : false;
+    return m_gridMesh ? m_gridMesh->isVisible() : false;
 }
 
-void NihilBiCubicNURBSurface::appendTranslation(const gs::vec3& ofs)
+void NihilBiCubicNURBSurface::calcLocalBoundingBox(NihilBoundingBox& box) const
 {
-    __super::appendTranslation(ofs);
+    // the grid mesh shares the local matrix, and it is what we actually draw
     if (m_gridMesh)
-        m_gridMesh->appendTranslation(ofs);
+        m_gridMesh->calcLocalBoundingBox(box);
 }
 
 int NihilBiCubicNURBSurface::loadBiCubicNURBSFromTextStream(const NihilString& src, int start)
@@ -1103,9 +1941,9 @@ int NihilBiCubicNURBSurface::loadBiCubicNURBSFromTextStream(const NihilString& s
             if (badEof(src, next))
                 return -1;
             fulfilled |= DegreeSectionFulfilled;
-            if (udegree != 3 || vdegree != 3)
+            if (udegree < 1 || vdegree < 1)
             {
-                ASSERT(!"Only cubic NURBS was supported.");
+                ASSERT(!"Bad degrees of NURBS.");
                 return -1;
             }
         }
@@ -1141,16 +1979,24 @@ int NihilBiCubicNURBSurface::loadBiCubicNURBSFromTextStream(const NihilString& s
     }
     if ((fulfilled & NecessarySectionsFulfilled) != NecessarySectionsFulfilled)
         return -1;
-    if ((ucvs + udegree + 1 != (int)m_uknots.size()) || (vcvs + vdegree + 1 != (int)m_vknots.size()))
+    if ((ucvs + udegree + 1 != (int)m_uknots.size()) || (vcvs + vdegree + 1 != (int)m_vknots.size()) ||
+        (ucvs * vcvs != (int)m_cvs.size()) || (!m_weights.empty() && m_weights.size() != m_cvs.size()))
     {
         ASSERT(!"Bad format of NURBS.");
         return -1;
     }
+    m_udegrees = udegree;
+    m_vdegrees = vdegree;
     int uspans = ucvs - udegree;
     int vspans = vcvs - vdegree;
     const int steps = 6;
     m_ustep = uspans * steps;
     m_vstep = vspans * steps;
+    if (!m_evaluator.setup(udegree, vdegree, m_uknots, m_vknots, m_ustep, m_vstep))
+    {
+        ASSERT(!"Bad knots of NURBS.");
+        return -1;
+    }
     if (!(fulfilled & LocalSectionFulfilled))
     {
         // setup a default matrix
@@ -1175,14 +2021,17 @@ int NihilBiCubicNURBSurface::loadCvsSectionFromTextStream(const NihilString& src
         next = readLineOfSection(src, line, start = next);
         if (badEof(src, next))
             return -1;
-        float i, j, k;
-        int c = gs::strtool::sscanf(line.c_str(), _t("%f %f %f"), &i, &j, &k);
-        if (c != 3)
+        // the weight is optional, but all or none of the cvs have it, a weight not above zero makes no point at all
+        float i, j, k, w;
+        int c = gs::strtool::sscanf(line.c_str(), _t("%f %f %f %f"), &i, &j, &k, &w);
+        if ((c != 3 && c != 4) || (!m_cvs.empty() && (c == 4) != !m_weights.empty()) || (c == 4 && !(w > 0.f)))
         {
             ASSERT(!"Bad format about line in section...");
             return -1;
         }
-        m_cvs.push_back(gs::vec3(i, j, k));
+        m_cvs.edit().push_back(gs::vec3(i, j, k));
+        if (c == 4)
+            m_weights.edit().push_back(w);
         // step on
         next = skipBlankCharactors(src, start = next);
         if (badEof(src, next))
@@ -1197,99 +2046,27 @@ void NihilBiCubicNURBSurface::loadFinished()
     ASSERT(!m_gridMesh);
     m_gridMesh = new NihilPolygon(m_renderer);
     ASSERT(m_gridMesh);
-    m_gridMesh->setLocalMat(m_localMat);
+    m_gridMesh->setParent(this);
+    // the patch places the grid mesh
+    matrix gridMat;
+    gridMat.identity();
+    m_gridMesh->setLocalMat(gridMat);
+    m_gridMesh->m_analyticNormals = true;
     updateGridMeshPoints();
     createGridMeshIndices();
-    m_gridMesh->calculateNormals();
     m_gridMesh->setupGeometryBuffers();
-}
-
-static int nihilFindNurbsSpan(int numCvs, int degree, float t, const std::vector<float>& knots)
-{
-    if (t == knots.at(numCvs))
-        return numCvs - 1;
-    int low = degree;
-    int high = numCvs;
-    int mid = (low + high) / 2;
-    while (t < knots.at(mid) || t >= knots.at(mid + 1))
-    {
-        if (t < knots.at(mid))
-            high = mid;
-        else
-            low = mid;
-        mid = (low + high) / 2;
-    }
-    return mid;
-}
-
-static void nihilNurbsBasisFunc(int i, float u, int degree, const std::vector<float>& knots, float N[])
-{
-    ASSERT(N);
-    N[0] = 1.f;
-    ASSERT(degree == 3);
-    float left[4], right[4];
-    for (int j = 1; j <= degree; j ++)
-    {
-        left[j] = u - knots.at(i + 1 - j);
-        right[j] = knots.at(i + j) - u;
-        float saved = 0.f;
-        for (int r = 0; r < j; r ++)
-        {
-            float temp = N[r] / (right[r + 1] + left[j - r]);
-            N[r] = saved + right[r + 1] * temp;
-            saved = left[j - r] * temp;
-        }
-        N[j] = saved;
-    }
-}
-
-void NihilBiCubicNURBSurface::calcPoint(gs::vec3& p, float u, float v)
-{
-    int udegree = getUDegrees();
-    int vdegree = getVDegrees();
-    int uspan = nihilFindNurbsSpan(getUCvs(), udegree, u, m_uknots);
-    int vspan = nihilFindNurbsSpan(getVCvs(), vdegree, v, m_vknots);
-    ASSERT(udegree == 3 && vdegree == 3);
-    float Nu[4], Nv[4];
-    nihilNurbsBasisFunc(uspan, u, udegree, m_uknots, Nu);
-    nihilNurbsBasisFunc(vspan, v, vdegree, m_vknots, Nv);
-    gs::vec3 temp[4];
-    for (int l = 0; l <= vdegree; l ++)
-    {
-        temp[l] = gs::vec3(0.f, 0.f, 0.f);
-        for (int k = 0; k <= udegree; k ++)
-        {
-            int uni = (uspan - udegree + k) * getVCvs() + (vspan - vdegree + l);
-            temp[l] += Nu[k] * m_cvs.at(uni);
-        }
-    }
-    gs::vec3 sw(0.f, 0.f, 0.f);
-    for (int l = 0; l <= vdegree; l ++)
-        sw += gs::vec3().scale(temp[l], Nv[l]);
-    p = sw;
+    updateLocalBoundingBox();
 }
 
 void NihilBiCubicNURBSurface::updateGridMeshPoints()
 {
     int size = (m_ustep + 1) * (m_vstep + 1);
     ASSERT(m_gridMesh);
-    NihilPointList& ptList = m_gridMesh->getPointList();
+    NihilPointList& ptList = m_gridMesh->editPointList();
     ptList.resize(size);
-    int k = 0;
-    for (int i = 0; i <= m_vstep; i++)
-    {
-        float v = ((float)i / m_vstep) * (m_vknots.at(getVCvs()) - m_vknots.at(getVDegrees())) + m_vknots.at(getVDegrees());
-        for (int j = 0; j <= m_ustep; j++)
-        {
-            gs::vec3 p;
-            float u = ((float)j / m_ustep) * (m_uknots.at(getUCvs()) - m_uknots.at(getUDegrees())) + m_uknots.at(getUDegrees());
-            calcPoint(p, u, v);
-#ifdef _DEBUG
-            gs::trace(_t("curve -d 3 -p %f %f %f;\n"), p.x, p.y, p.z);
-#endif
-            ptList.at(k++).pos = p;
-        }
-    }
+    ASSERT(m_evaluator.getUSamples() == m_ustep + 1 && m_evaluator.getVSamples() == m_vstep + 1);
+    // rows in v, the points of a row in u
+    m_evaluator.evaluate(m_cvs.data(), isRational() ? m_weights.data() : nullptr, &ptList.front().pos, &ptList.front().normal, sizeof(NihilVertex));
 }
 
 void NihilBiCubicNURBSurface::updateGridMesh()
@@ -1302,7 +2079,7 @@ void NihilBiCubicNURBSurface::updateGridMesh()
 void NihilBiCubicNURBSurface::createGridMeshIndices()
 {
     int size = m_ustep * m_vstep;
-    NihilIndexList& indexList = m_gridMesh->getIndexList();
+    NihilIndexList& indexList = m_gridMesh->editIndexList();
     indexList.resize(size * 6);
     int* indices = &indexList.front();
     int i, j, k;
@@ -1381,6 +2158,59 @@ void NihilUIRectangle::calcVertexBuffer(NihilUIVertex vertices[4])
     vertices[3].color = cr;
 }
 
+NihilUILasso::NihilUILasso(NihilRenderer* renderer)
+{
+    ASSERT(renderer);
+    m_renderer = renderer;
+    m_lassoObject = renderer->addUIObject();
+    ASSERT(m_lassoObject);
+    m_lassoObject->setTopology(NihilUIObject::Topo_LineList);
+}
+
+NihilUILasso::~NihilUILasso()
+{
+    ASSERT(m_renderer && m_lassoObject);
+    m_renderer->removeUIObject(m_lassoObject);
+    m_renderer = nullptr;
+    m_lassoObject = nullptr;
+}
+
+void NihilUILasso::setupBuffers(const NihilLasso& lasso)
+{
+    NihilUIVertices vertices;
+    calcVertexBuffer(lasso, vertices);
+    m_lassoObject->createVertexStream(&vertices.front(), (int)vertices.size());
+    // a closed loop over all the slots, the unused ones collapse to the last point
+    NihilIndexList indices;
+    indices.reserve(NIHIL_LASSO_MAX_POINTS * 2);
+    for (int i = 0; i < NIHIL_LASSO_MAX_POINTS; i ++)
+    {
+        indices.push_back(i);
+        indices.push_back((i + 1) % NIHIL_LASSO_MAX_POINTS);
+    }
+    m_lassoObject->createIndexStream(&indices.front(), (int)indices.size());
+}
+
+void NihilUILasso::updateBuffer(const NihilLasso& lasso)
+{
+    NihilUIVertices vertices;
+    calcVertexBuffer(lasso, vertices);
+    m_lassoObject->updateVertexStream(&vertices.front(), (int)vertices.size());
+}
+
+void NihilUILasso::calcVertexBuffer(const NihilLasso& lasso, NihilUIVertices& vertices)
+{
+    ASSERT(lasso.size() > 0);
+    static const gs::vec4 cr(0.5f, 0.6f, 0.5f, 1.f);
+    vertices.resize(NIHIL_LASSO_MAX_POINTS);
+    for (int i = 0; i < NIHIL_LASSO_MAX_POINTS; i ++)
+    {
+        const gs::vec2& pt = lasso.getPoint(std::min(i, lasso.size() - 1));
+        vertices.at(i).pos = gs::vec3(pt.x, pt.y, 0.f);
+        vertices.at(i).color = cr;
+    }
+}
+
 NihilUIPoints::NihilUIPoints(NihilRenderer* renderer)
 {
     ASSERT(renderer);
@@ -1396,18 +2226,46 @@ NihilUIPoints::~NihilUIPoints()
     m_rcObject = nullptr;
 }
 
-static void nihilPrepareUIPointVertexBuffer(NihilUIVertices& vertices, NihilPointInfoList& infos)
+void NihilPointTable::clear()
+{
+    m_objects.clear();
+    m_indices.clear();
+    m_xs.clear();
+    m_ys.clear();
+    m_zs.clear();
+}
+
+void NihilPointTable::add(NihilObject* object, int index, const gs::vec3& point)
+{
+    ASSERT(object && index >= 0);
+    m_objects.push_back(object);
+    m_indices.push_back(index);
+    m_xs.push_back(point.x);
+    m_ys.push_back(point.y);
+    m_zs.push_back(point.z);
+}
+
+void NihilPointTable::setPoint(int i, const gs::vec3& point)
+{
+    m_xs.at(i) = point.x;
+    m_ys.at(i) = point.y;
+    m_zs.at(i) = point.z;
+}
+
+static void nihilPrepareUIPointVertexBuffer(NihilUIVertices& vertices, const NihilPointTable& points, const NihilSelectionSet& selection)
 {
     const float radius = 1.f;
     const gs::vec4 unselectedColor(1.f, 0.9f, 0.f, 1.f), selectedColor(0.f, 1.f, 0.f, 1.f);
-    for (auto& info : infos)
+    vertices.reserve(points.size() * 4);
+    for (int i = 0; i < points.size(); i ++)
     {
+        gs::vec3 point = points.getPoint(i);
         NihilUIVertex v1, v2, v3, v4;
-        v1.color = v2.color = v3.color = v4.color = info.isSelected ? selectedColor : unselectedColor;
-        v1.pos = gs::vec3(info.point.x - radius, info.point.y - radius, info.point.z);
-        v2.pos = gs::vec3(info.point.x + radius, info.point.y - radius, info.point.z);
-        v3.pos = gs::vec3(info.point.x + radius, info.point.y + radius, info.point.z);
-        v4.pos = gs::vec3(info.point.x - radius, info.point.y + radius, info.point.z);
+        v1.color = v2.color = v3.color = v4.color = selection.isSelected(i) ? selectedColor : unselectedColor;
+        v1.pos = gs::vec3(point.x - radius, point.y - radius, point.z);
+        v2.pos = gs::vec3(point.x + radius, point.y - radius, point.z);
+        v3.pos = gs::vec3(point.x + radius, point.y + radius, point.z);
+        v4.pos = gs::vec3(point.x - radius, point.y + radius, point.z);
         vertices.push_back(v1);
         vertices.push_back(v2);
         vertices.push_back(v3);
@@ -1415,7 +2273,7 @@ static void nihilPrepareUIPointVertexBuffer(NihilUIVertices& vertices, NihilPoin
     }
 }
 
-void NihilUIPoints::updateBuffer(NihilPointInfoList& infos)
+void NihilUIPoints::updateBuffer(const NihilPointTable& points, const NihilSelectionSet& selection)
 {
     if (!m_rcObject)
     {
@@ -1423,17 +2281,17 @@ void NihilUIPoints::updateBuffer(NihilPointInfoList& infos)
         m_rcObject = m_renderer->addUIObject();
         ASSERT(m_rcObject);
         m_rcObject->setTopology(NihilUIObject::Topo_TriangleList);
-        return initBuffers(infos);
+        return initBuffers(points, selection);
     }
     NihilUIVertices vertices;
-    nihilPrepareUIPointVertexBuffer(vertices, infos);
+    nihilPrepareUIPointVertexBuffer(vertices, points, selection);
     m_rcObject->updateVertexStream(&vertices.front(), (int)vertices.size());
 }
 
-void NihilUIPoints::initBuffers(NihilPointInfoList& infos)
+void NihilUIPoints::initBuffers(const NihilPointTable& points, const NihilSelectionSet& selection)
 {
     // create index buffer
-    int size = infos.size() * 6;
+    int size = points.size() * 6;
     int* indices = new int[size];
     for (int i = 0; i < size; i += 6)
     {
@@ -1449,7 +2307,7 @@ void NihilUIPoints::initBuffers(NihilPointInfoList& infos)
     delete[] indices;
     // create vertex buffer
     NihilUIVertices vertices;
-    nihilPrepareUIPointVertexBuffer(vertices, infos);
+    nihilPrepareUIPointVertexBuffer(vertices, points, selection);
     m_rcObject->createVertexStream(&vertices.front(), (int)vertices.size());
 }
 
@@ -1487,6 +2345,7 @@ bool NihilControl_NavigateScene::onMsg(NihilCore* core, UINT message, WPARAM wPa
             pt.x = (float)GET_X_LPARAM(lParam);
             pt.y = (float)GET_Y_LPARAM(lParam);
             core->getSceneConfig().updateRotation(m_lastpt, pt);
+            core->invalidate();
             m_lastpt = pt;
         }
         break;
@@ -1505,6 +2364,7 @@ bool NihilControl_NavigateScene::onMsg(NihilCore* core, UINT message, WPARAM wPa
             pt.x = (float)GET_X_LPARAM(lParam);
             pt.y = (float)GET_Y_LPARAM(lParam);
             core->getSceneConfig().updateTranslation(m_lastpt, pt);
+            core->invalidate();
             m_lastpt = pt;
         }
         break;
@@ -1515,6 +2375,7 @@ bool NihilControl_NavigateScene::onMsg(NihilCore* core, UINT message, WPARAM wPa
             pt.x = (float)GET_X_LPARAM(lParam);
             pt.y = (float)GET_Y_LPARAM(lParam);
             core->getSceneConfig().updateRotation(m_lastpt, pt);
+            core->invalidate();
             m_lastpt = pt;
         }
         if (m_rmbPressed)
@@ -1523,6 +2384,7 @@ bool NihilControl_NavigateScene::onMsg(NihilCore* core, UINT message, WPARAM wPa
             pt.x = (float)GET_X_LPARAM(lParam);
             pt.y = (float)GET_Y_LPARAM(lParam);
             core->getSceneConfig().updateTranslation(m_lastpt, pt);
+            core->invalidate();
             m_lastpt = pt;
         }
         break;
@@ -1530,6 +2392,7 @@ bool NihilControl_NavigateScene::onMsg(NihilCore* core, UINT message, WPARAM wPa
     {
         float d = (float)GET_WHEEL_DELTA_WPARAM(wParam) / WHEEL_DELTA;
         core->getSceneConfig().updateZooming(d);
+        core->invalidate();
         break;
     }
     }
@@ -1537,11 +2400,11 @@ bool NihilControl_NavigateScene::onMsg(NihilCore* core, UINT message, WPARAM wPa
 }
 
 NihilControl_ObjectLayer::NihilControl_ObjectLayer(NihilCore* core)
-    : m_objectList(core->m_objectList)
+    : m_objectTable(core->m_objectTable)
 {
     ASSERT(core);
+    m_core = core;
     m_renderer = core->getRenderer();
-    setupHittestTable(core->getHwnd(), core->getSceneConfig());
 }
 
 NihilControl_ObjectLayer::~NihilControl_ObjectLayer()
@@ -1557,6 +2420,11 @@ NihilControl_ObjectLayer::~NihilControl_ObjectLayer()
         delete m_selectArea;
         m_selectArea = nullptr;
     }
+    if (m_lassoArea)
+    {
+        delete m_lassoArea;
+        m_lassoArea = nullptr;
+    }
 }
 
 bool NihilControl_ObjectLayer::onMsg(NihilCore* core, UINT message, WPARAM wParam, LPARAM lParam)
@@ -1570,10 +2438,12 @@ bool NihilControl_ObjectLayer::onMsg(NihilCore* core, UINT message, WPARAM wPara
         m_startpt.x = (float)GET_X_LPARAM(lParam);
         m_startpt.y = (float)GET_Y_LPARAM(lParam);
         m_lastpt = m_startpt;
+        core->invalidate();
         switch (m_modTag)
         {
         case Mod_None:
-            startSelecting();
+            m_selectThrough = (wParam & MK_SHIFT) != 0;
+            startSelecting((wParam & MK_CONTROL) != 0);
             break;
         case Mod_Translation:
             startTranslation();
@@ -1595,9 +2465,11 @@ bool NihilControl_ObjectLayer::onMsg(NihilCore* core, UINT message, WPARAM wPara
                 break;
             case Mod_Translation:
                 updateTranslation(core->getSceneConfig(), pt);
+                core->m_journal.endEdit();
                 break;
             }
             m_lastpt = pt;
+            core->invalidate();
         }
         break;
     case WM_MOUSEMOVE:
@@ -1616,13 +2488,14 @@ bool NihilControl_ObjectLayer::onMsg(NihilCore* core, UINT message, WPARAM wPara
                 break;
             }
             m_lastpt = pt;
+            core->invalidate();
         }
         break;
     }
     return false;
 }
 
-static void nihilBoundaryRect(gs::rectf& rc, const gs::vec2& p1, const gs::vec2& p2)
+static void nihilBoundaryRect(gs::pink::rectf& rc, const gs::vec2& p1, const gs::vec2& p2)
 {
     float left, right, top, bottom;
     left = top = FLT_MAX;
@@ -1634,116 +2507,198 @@ static void nihilBoundaryRect(gs::rectf& rc, const gs::vec2& p1, const gs::vec2&
     rc.set_ltrb(left, top, right, bottom);
 }
 
-static void nihilBoundaryRect(gs::rectf& rc, const gs::vec2& p1, const gs::vec2& p2, const gs::vec2& p3)
+/*
+ * Separating axis test of 4 triangles against the rect, the triangles are given by the coordinates of their vertices,
+ * xs[k][j] is the x of the kth vertex of the jth triangle.
+ * The candidate axes are the 2 axes of the rect and the normals of the 3 edges, touching counts as overlapping.
+ * Return the mask of the overlapping triangles.
+ */
+static int nihilOverlapTrianglesRect(const float xs[3][4], const float ys[3][4], const gs::pink::rectf& rc)
 {
-    float left, right, top, bottom;
-    left = top = FLT_MAX;
-    right = bottom = -FLT_MAX;
-    left = std::min(std::min(p1.x, p2.x), p3.x);
-    top = std::min(std::min(p1.y, p2.y), p3.y);
-    right = std::max(std::max(p1.x, p2.x), p3.x);
-    bottom = std::max(std::max(p1.y, p2.y), p3.y);
-    rc.set_ltrb(left, top, right, bottom);
+    __m128 x[3], y[3];
+    for (int k = 0; k < 3; k ++)
+    {
+        x[k] = _mm_loadu_ps(xs[k]);
+        y[k] = _mm_loadu_ps(ys[k]);
+    }
+    __m128 left = _mm_set1_ps(rc.left), right = _mm_set1_ps(rc.right);
+    __m128 top = _mm_set1_ps(rc.top), bottom = _mm_set1_ps(rc.bottom);
+    // 1.axes of the rect, the bounding boxes of the triangles
+    __m128 overlapped = _mm_and_ps(
+        _mm_and_ps(_mm_cmple_ps(_mm_min_ps(_mm_min_ps(x[0], x[1]), x[2]), right), _mm_cmpge_ps(_mm_max_ps(_mm_max_ps(x[0], x[1]), x[2]), left)),
+        _mm_and_ps(_mm_cmple_ps(_mm_min_ps(_mm_min_ps(y[0], y[1]), y[2]), bottom), _mm_cmpge_ps(_mm_max_ps(_mm_max_ps(y[0], y[1]), y[2]), top))
+        );
+    // 2.normals of the edges, project the rect as center +- extent
+    __m128 half = _mm_set1_ps(0.5f);
+    __m128 cx = _mm_mul_ps(_mm_add_ps(left, right), half), cy = _mm_mul_ps(_mm_add_ps(top, bottom), half);
+    __m128 hw = _mm_mul_ps(_mm_sub_ps(right, left), half), hh = _mm_mul_ps(_mm_sub_ps(bottom, top), half);
+    __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    for (int k = 0; k < 3; k ++)
+    {
+        int i = (k + 1) % 3, j = (k + 2) % 3;
+        __m128 nx = _mm_sub_ps(y[i], y[k]);
+        __m128 ny = _mm_sub_ps(x[k], x[i]);
+        // the edge projects to a single value, the opposite vertex to another
+        __m128 d1 = _mm_add_ps(_mm_mul_ps(nx, x[k]), _mm_mul_ps(ny, y[k]));
+        __m128 d2 = _mm_add_ps(_mm_mul_ps(nx, x[j]), _mm_mul_ps(ny, y[j]));
+        __m128 c = _mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy));
+        __m128 r = _mm_add_ps(_mm_mul_ps(_mm_and_ps(nx, absMask), hw), _mm_mul_ps(_mm_and_ps(ny, absMask), hh));
+        overlapped = _mm_and_ps(overlapped, _mm_and_ps(
+            _mm_cmple_ps(_mm_sub_ps(c, r), _mm_max_ps(d1, d2)),
+            _mm_cmpge_ps(_mm_add_ps(c, r), _mm_min_ps(d1, d2))
+            ));
+    }
+    return _mm_movemask_ps(overlapped);
+}
+
+#define NIHIL_CLICK_TOLERANCE 2.f   // a select area smaller than this is a click, in pixels
+#define NIHIL_PICK_RADIUS 4.f
+
+// the clip space of the frustum through the rect of the screen, at least a pixel wide so that a click still hits
+static void nihilSetupRectFrustum(gs::matrix& m, const gs::matrix& viewProj, const gs::pink::rectf& rc, UINT width, UINT height)
+{
+    float left = rc.left / width * 2.f - 1.f;
+    float right = rc.right / width * 2.f - 1.f;
+    float top = 1.f - rc.top / height * 2.f;
+    float bottom = 1.f - rc.bottom / height * 2.f;
+    float hx = std::max((right - left) * 0.5f, 1.f / width);
+    float hy = std::max((top - bottom) * 0.5f, 1.f / height);
+    float cx = (left + right) * 0.5f, cy = (top + bottom) * 0.5f;
+    // [cx - hx, cx + hx] x [cy - hy, cy + hy] of ndc => [-1, 1] x [-1, 1]
+    m.multiply(viewProj, gs::matrix().scaling(1.f / hx, 1.f / hy, 1.f));
+    m.multiply(gs::matrix().translation(-cx / hx, -cy / hy, 0.f));
+}
+
+#define NIHIL_HITTEST_FIRST_BATCH 128        // triangles, doubled each batch, a hit usually shows up in the first few
+#define NIHIL_HITTEST_PROJECTION_BATCH 8192  // triangles
+#define NIHIL_LASSO_GRAIN 256                // triangles or points of a task, the lasso tests are much heavier
+
+// the front faces of the projected corners overlapped by the lasso, classified over the pool
+static bool nihilOverlapTrianglesLasso(const NihilScreenPoints& projected, int count, const NihilLasso& lasso, NihilThreadPool* pool)
+{
+    std::atomic<bool> found(false);
+    pool->parallelFor(count / 3, NIHIL_LASSO_GRAIN, [&](int first, int last) {
+        for (int t = first; t < last && !found.load(std::memory_order_relaxed); t ++)
+        {
+            int c = t * 3;
+            const float* ws = &projected.ws[c];
+            if (ws[0] <= 0.f || ws[1] <= 0.f || ws[2] <= 0.f)   // behind the eye
+                continue;
+            gs::vec2 p1(projected.xs[c], projected.ys[c]);
+            gs::vec2 p2(projected.xs[c + 1], projected.ys[c + 1]);
+            gs::vec2 p3(projected.xs[c + 2], projected.ys[c + 2]);
+            bool isccw = gs::vec2().sub(p2, p1).ccw(gs::vec2().sub(p3, p2)) > 0.f;
+            if (isccw && lasso.overlapsTriangle(p1, p2, p3))    // flip y already make counter clockwised.
+                found.store(true, std::memory_order_relaxed);
+        }
+    });
+    return found.load();
 }
 
-void NihilControl_ObjectLayer::setupHittestTableOf(NihilObject* object, const gs::matrix& mat, UINT width, UINT height)
+// the render meshes of the objects by their slots in the table, then rasterize them
+static void nihilDrawIdBuffer(NihilIdBuffer& idBuffer, const NihilObjectTable& objectTable, const NihilObjectList& objects, const gs::matrix& viewProj, NihilThreadPool* pool)
 {
-    ASSERT(object);
-    switch (object->getType())
+    for (NihilObject* object : objects)
     {
-    case NihilObject::OT_Polygon:
-        return setupHittestTableOfPolygon(static_cast<NihilPolygon*>(object), mat, width, height);
-    case NihilObject::OT_BiCubicBezierPatch:
-        return setupHittestTableOfPolygon(static_cast<NihilBiCubicBezierPatch*>(object)->getGridMesh(), mat, width, height);
-    case NihilObject::OT_BiCubicNURBS:
-        return setupHittestTableOfPolygon(static_cast<NihilBiCubicNURBSurface*>(object)->getGridMesh(), mat, width, height);
+        int slot = object->getTableSlot();
+        const NihilPolygon* mesh = objectTable.getRenderMesh(slot);
+        if (!mesh || mesh->getPointList().empty())
+            continue;
+        const NihilPointList& pointList = mesh->getPointList();
+        const NihilIndexList& indexList = mesh->getIndexList();
+        gs::matrix clipMat;
+        clipMat.multiply(objectTable.getWorldMat(slot), viewProj);
+        idBuffer.addMesh(slot, &pointList.front().pos, sizeof(NihilVertex), (int)pointList.size(), indexList.data(), (int)indexList.size() / 3, clipMat, pool);
     }
+    idBuffer.rasterize(pool);
 }
 
-void NihilControl_ObjectLayer::setupHittestTableOfPolygon(NihilPolygon* polygon, const gs::matrix& mat, UINT width, UINT height)
+bool NihilControl_ObjectLayer::hitTestPolygon(const NihilPolygon* polygon, const gs::matrix& worldMat, const gs::matrix& viewProj, const gs::matrix& rectMat, const gs::pink::rectf& rc, const NihilLasso* lasso, UINT width, UINT height)
 {
     ASSERT(polygon);
-    // 1.ndc => screen space
+    // 1.the object space hierarchy of the mesh culls the triangles by the frustum of the rect
+    gs::matrix mat;
+    mat.multiply(worldMat, rectMat);
+    m_triangles.clear();
+    polygon->getMeshBvh().query(mat, m_triangles);
+    if (m_triangles.empty())
+        return false;
+    // 2.ndc => screen space
     gs::matrix ssm;
-    ssm.multiply(polygon->getLocalMat(), mat);
+    ssm.multiply(worldMat, viewProj);
     ssm.multiply(gs::matrix().scaling(0.5f * width, -0.5f * height, 0.f));
     ssm.multiply(gs::matrix().translation(0.5f * width, 0.5f * height, 0.f));
-    // 2.transform points
-    NihilPointList& pointList = polygon->getPointList();
-    std::vector<gs::vec2> dupPoints;
-    dupPoints.resize(pointList.size());
-    int i = 0;
-    for (NihilVertex& v : pointList)
-    {
-        gs::vec4 t;
-        v.pos.transform(t, ssm);
-        t.scale(1.f / t.w);
-        dupPoints.at(i ++) = (const gs::vec2&)t;
-    }
-    // 3.setup rtree
-    NihilIndexList& indexList = polygon->getIndexList();
-    ASSERT(indexList.size() % 3 == 0);
-    for (i = 0; i < (int)indexList.size(); i += 3)
-    {
-        int a = indexList.at(i);
-        int b = indexList.at(i + 1);
-        int c = indexList.at(i + 2);
-        const gs::vec2& p1 = dupPoints.at(a);
-        const gs::vec2& p2 = dupPoints.at(b);
-        const gs::vec2& p3 = dupPoints.at(c);
-        bool isccw = gs::vec2().sub(p2, p1).ccw(gs::vec2().sub(p3, p2)) > 0.f;
-        if (isccw)  // flip y already make counter clockwised.
+    // 3.project the corners of the candidates a batch at a time, so that an early hit skips the rest
+    const NihilPointList& pointList = polygon->getPointList();
+    const NihilIndexList& indexList = polygon->getIndexList();
+    float xs[3][4], ys[3][4];
+    int batchSize = 0;
+    for (int first = 0, batch = NIHIL_HITTEST_FIRST_BATCH; first < (int)m_triangles.size(); first += batch, batch = std::min(batch * 2, NIHIL_HITTEST_PROJECTION_BATCH))
+    {
+        int last = std::min(first + batch, (int)m_triangles.size());
+        m_corners.clear();
+        for (int i = first; i < last; i ++)
         {
-            m_cache.push_back(HittestNode());
-            HittestNode& node = m_cache.back();
-            node.triangle[0] = p1;
-            node.triangle[1] = p2;
-            node.triangle[2] = p3;
-#if 0
-            gs::trace(_t("@moveTo %f, %f;\n"), p1.x, p1.y);
-            gs::trace(_t("@lineTo %f, %f;\n"), p2.x, p2.y);
-            gs::trace(_t("@lineTo %f, %f;\n"), p3.x, p3.y);
-            gs::trace(_t("@lineTo %f, %f;\n"), p1.x, p1.y);
-#endif
-            node.index[0] = a;
-            node.index[1] = b;
-            node.index[2] = c;
-            node.geometry = polygon->getGeometry();
-            gs::rectf rc;
-            nihilBoundaryRect(rc, p1, p2, p3);
-            m_rtree.insert((UINT)&node, rc);
+            const int* triangle = &indexList.at(m_triangles.at(i) * 3);
+            m_corners.insert(m_corners.end(), triangle, triangle + 3);
+        }
+        nihilProjectPoints(m_projected, &pointList.front().pos, sizeof(NihilVertex), m_corners.data(), (int)m_corners.size(), ssm, &m_core->m_threadPool);
+        if (lasso)
+        {
+            if (nihilOverlapTrianglesLasso(m_projected, (int)m_corners.size(), *lasso, &m_core->m_threadPool))
+                return true;
+            continue;
+        }
+        // 4.filter the front faces by the exact test 4 triangles at a time
+        for (int c = 0; c < (int)m_corners.size(); c += 3)
+        {
+            const float* ws = &m_projected.ws[c];
+            if (ws[0] <= 0.f || ws[1] <= 0.f || ws[2] <= 0.f)   // behind the eye
+                continue;
+            gs::vec2 p1(m_projected.xs[c], m_projected.ys[c]);
+            gs::vec2 p2(m_projected.xs[c + 1], m_projected.ys[c + 1]);
+            gs::vec2 p3(m_projected.xs[c + 2], m_projected.ys[c + 2]);
+            bool isccw = gs::vec2().sub(p2, p1).ccw(gs::vec2().sub(p3, p2)) > 0.f;
+            if (!isccw) // flip y already make counter clockwised.
+                continue;
+            xs[0][batchSize] = p1.x, ys[0][batchSize] = p1.y;
+            xs[1][batchSize] = p2.x, ys[1][batchSize] = p2.y;
+            xs[2][batchSize] = p3.x, ys[2][batchSize] = p3.y;
+            if (++ batchSize == 4)
+            {
+                if (nihilOverlapTrianglesRect(xs, ys, rc))
+                    return true;
+                batchSize = 0;
+            }
         }
     }
-}
-
-void NihilControl_ObjectLayer::setupHittestTable(HWND hwnd, NihilSceneConfig& sceneConfig)
-{
-    m_rtree.destroy();
-    m_cache.clear();
-    gs::matrix mat;
-    sceneConfig.calcMatrix(mat);
-    RECT rc;
-    GetClientRect(hwnd, &rc);
-    UINT width = rc.right - rc.left;
-    UINT height = rc.bottom - rc.top;
-    for (auto* p : m_objectList)
+    if (!batchSize)
+        return false;
+    // pad the batch with its last triangle
+    for (int j = batchSize; j < 4; j ++)
     {
-        ASSERT(p);
-        setupHittestTableOf(p, mat, width, height);
+        for (int k = 0; k < 3; k ++)
+        {
+            xs[k][j] = xs[k][batchSize - 1];
+            ys[k][j] = ys[k][batchSize - 1];
+        }
     }
+    return nihilOverlapTrianglesRect(xs, ys, rc) != 0;
 }
 
-void NihilControl_ObjectLayer::resetSelectState()
+void NihilControl_ObjectLayer::startSelecting(bool lasso)
 {
-    for (auto* p : m_objectList)
+    if (lasso)
     {
-        ASSERT(p);
-        p->setSelected(false);
+        if (m_lassoArea)
+            delete m_lassoArea;
+        m_lasso.clear();
+        m_lasso.addPoint(m_startpt);
+        m_lassoArea = new NihilUILasso(m_renderer);
+        ASSERT(m_lassoArea);
+        m_lassoArea->setupBuffers(m_lasso);
+        return;
     }
-}
-
-void NihilControl_ObjectLayer::startSelecting()
-{
     if (m_selectArea)
         delete m_selectArea;
     m_selectArea = new NihilUIRectangle(m_renderer);
@@ -1754,51 +2709,115 @@ void NihilControl_ObjectLayer::startSelecting()
 
 void NihilControl_ObjectLayer::endSelecting(const gs::vec2& pt)
 {
+    gs::pink::rectf rc;
+    if (m_lassoArea)
+    {
+        delete m_lassoArea;
+        m_lassoArea = nullptr;
+        m_lasso.addPoint(pt);
+        if (m_lasso.isValid())
+        {
+            m_lasso.prepare();
+            return hitTest(m_lasso.getBoundingRect(), &m_lasso);
+        }
+        // too short to be a lasso, take it as a click
+        nihilBoundaryRect(rc, m_startpt, pt);
+        return hitTest(rc);
+    }
     ASSERT(m_selectArea);
     delete m_selectArea;
     m_selectArea = nullptr;
-    resetSelectState();
-    gs::rectf rc;
     nihilBoundaryRect(rc, m_startpt, pt);
     hitTest(rc);
 }
 
 void NihilControl_ObjectLayer::updateSelecting(const gs::vec2& pt)
 {
+    if (m_lassoArea)
+    {
+        if (m_lasso.addPoint(pt))
+            m_lassoArea->updateBuffer(m_lasso);
+        return;
+    }
     ASSERT(m_selectArea);
     m_selectArea->setBottomRight(pt.x, pt.y);
     m_selectArea->updateBuffer();
 }
 
-void NihilControl_ObjectLayer::hitTest(const gs::rectf& rc)
+void NihilControl_ObjectLayer::hitTest(const gs::pink::rectf& rc, const NihilLasso* lasso)
 {
-    // 1.hit through rtree
-    std::vector<UINT> hittable;
-    m_rtree.query(rc, hittable);
-    // 2.todo: test if the rect overlaps these triangles then filter them again.
-    // 3.tag them
-    for (UINT u : hittable)
+#ifdef NIHIL_PROFILE_HITTEST
+    double startTime = nihilGetMilliseconds();
+#endif
+    UINT width, height;
+    m_core->getViewSize(width, height);
+    if (!width || !height)
+        return;
+    // 1.the moves since the last frame, only the branches above the moved objects are refit
+    m_core->updateTransforms();
+    m_core->m_sceneBvh.refit();
+    // 2.cull the objects by the frustum of the rect, the bounding rect of the lasso
+    gs::matrix viewProj, rectMat;
+    m_core->getSceneConfig().calcMatrix(viewProj);
+    if (!lasso && rc.width() < NIHIL_CLICK_TOLERANCE && rc.height() < NIHIL_CLICK_TOLERANCE)
+    {
+        // a click picks the nearest object under it by a ray
+        NihilPickResult result;
+        gs::vbitset hits;
+        hits.resize(m_objectTable.size());
+        if (m_core->pickObject(gs::vec2(rc.left, rc.top), width, height, result))
+            hits.set(result.object->getTableSlot());
+        m_objectTable.getSelection().replace(hits);
+        return;
+    }
+    nihilSetupRectFrustum(rectMat, viewProj, rc, width, height);
+    m_candidates.clear();
+    m_core->m_sceneBvh.query(rectMat, m_candidates);
+    gs::vbitset hits;
+    hits.resize(m_objectTable.size());
+    if (!m_selectThrough)
+    {
+        // 3.only the objects seen in the rect, the candidates are all that may cover a pixel of it
+        m_idBuffer.setup((int)width, (int)height);
+        nihilDrawIdBuffer(m_idBuffer, m_objectTable, m_candidates, viewProj, &m_core->m_threadPool);
+        m_idBuffer.collectObjects(rc, lasso, hits);
+    }
+    else
     {
-        auto* node = reinterpret_cast<HittestNode*>(u);
-        node->geometry->setSelected(true);
+        // 3.test the triangles of the candidates, an object is hit by its first overlapping triangle
+        for (NihilObject* object : m_candidates)
+        {
+            int slot = object->getTableSlot();
+            ASSERT(slot >= 0 && m_objectTable.getObject(slot) == object);
+            if (hitTestPolygon(m_objectTable.getRenderMesh(slot), m_objectTable.getWorldMat(slot), viewProj, rectMat, rc, lasso, width, height))
+                hits.set(slot);
+        }
     }
+#ifdef NIHIL_PROFILE_HITTEST
+    gs::trace(_t("hittest query: %d candidates, %d objects hit in %f ms.\n"), (int)m_candidates.size(), hits.count(), nihilGetMilliseconds() - startTime);
+#endif
+    // replace the selection in one go
+    m_objectTable.getSelection().replace(hits);
 }
 
-static void collectSelectedObjects(NihilObjectList& selectedObjects, const NihilObjectList& objects)
+static bool nihilHasSelectedAncestor(const NihilObject* object)
 {
-    selectedObjects.clear();
-    for (const NihilObject* object : objects)
+    ASSERT(object);
+    for (const NihilObject* p = object->getParent(); p; p = p->getParent())
     {
-        ASSERT(object);
-        if (object->isSelected())
-            selectedObjects.push_back(const_cast<NihilObject*>(object));
+        if (p->isSelected())
+            return true;
     }
+    return false;
 }
 
 void NihilControl_ObjectLayer::startTranslation()
 {
-    // get selected polygons
-    collectSelectedObjects(m_selectedObjects, m_objectList);
+    // get selected polygons, the selected descendants follow their selected ancestors already
+    m_objectTable.collectSelected(m_selectedObjects);
+    m_selectedObjects.erase(std::remove_if(m_selectedObjects.begin(), m_selectedObjects.end(), nihilHasSelectedAncestor), m_selectedObjects.end());
+    // undo the moves of the drag at once
+    m_core->m_journal.beginEdit();
 }
 
 void NihilControl_ObjectLayer::updateTranslation(NihilSceneConfig& sceneConfig, const gs::vec2& pt)
@@ -1810,15 +2829,20 @@ void NihilControl_ObjectLayer::updateTranslation(NihilSceneConfig& sceneConfig,
     {
         ASSERT(polygon);
         polygon->appendTranslation(t);
+        m_core->m_journal.recordObject(polygon->getTableSlot(), t);
     }
 }
 
 NihilControl_PointsLayer::NihilControl_PointsLayer(NihilCore* core)
 {
     ASSERT(core);
+    m_core = core;
     m_renderer = core->getRenderer();
-    setupSelectedObjects(core->m_objectList);
-    setupHittestInfo(core->getHwnd(), core->getSceneConfig());
+    m_threadPool = &core->m_threadPool;
+    m_pointSelection.setListener(this);
+    core->updateTransforms();
+    setupSelectedObjects(core->m_objectTable);
+    setupHittestInfo(core);
 }
 
 NihilControl_PointsLayer::~NihilControl_PointsLayer()
@@ -1834,6 +2858,11 @@ NihilControl_PointsLayer::~NihilControl_PointsLayer()
         delete m_selectArea;
         m_selectArea = nullptr;
     }
+    if (m_lassoArea)
+    {
+        delete m_lassoArea;
+        m_lassoArea = nullptr;
+    }
     if (m_uiPoints)
     {
         delete m_uiPoints;
@@ -1852,13 +2881,14 @@ bool NihilControl_PointsLayer::onMsg(NihilCore* core, UINT message, WPARAM wPara
         m_startpt.x = (float)GET_X_LPARAM(lParam);
         m_startpt.y = (float)GET_Y_LPARAM(lParam);
         m_lastpt = m_startpt;
+        core->invalidate();
         switch (m_modTag)
         {
         case Mod_None:
-            startSelecting();
+            startSelecting((wParam & MK_CONTROL) != 0);
             break;
         case Mod_Translation:
-            startTranslation();
+            core->m_journal.beginEdit();
             break;
         }
         break;
@@ -1876,10 +2906,12 @@ bool NihilControl_PointsLayer::onMsg(NihilCore* core, UINT message, WPARAM wPara
                 endSelecting(pt);
                 break;
             case Mod_Translation:
-                updateTranslation(core->getSceneConfig(),core->getHwnd(), pt);
+                updateTranslation(core->getSceneConfig(), pt);
+                core->m_journal.endEdit();
                 break;
             }
             m_lastpt = pt;
+            core->invalidate();
         }
         break;
     case WM_MOUSEMOVE:
@@ -1894,42 +2926,62 @@ bool NihilControl_PointsLayer::onMsg(NihilCore* core, UINT message, WPARAM wPara
                 updateSelecting(pt);
                 break;
             case Mod_Translation:
-                updateTranslation(core->getSceneConfig(), core->getHwnd(), pt);
+                updateTranslation(core->getSceneConfig(), pt);
                 break;
             }
             m_lastpt = pt;
+            core->invalidate();
         }
         break;
     }
     return false;
 }
 
-void NihilControl_PointsLayer::setupSelectedObjects(const NihilObjectList& objects)
+void NihilControl_PointsLayer::setupSelectedObjects(const NihilObjectTable& objectTable)
 {
-    collectSelectedObjects(m_selectedObjects, objects);
+    objectTable.collectSelected(m_selectedObjects);
 }
 
-void NihilControl_PointsLayer::setupHittestInfo(HWND hwnd, NihilSceneConfig& sceneConfig)
+void NihilControl_PointsLayer::setupHittestInfo(NihilCore* core)
 {
-    m_pointInfos.clear();
+    ASSERT(core);
+    m_pointTable.clear();
+    m_pointGrid.clear();
     if (m_selectedObjects.empty())
         return;
     ASSERT(!m_uiPoints);
     m_uiPoints = new NihilUIPoints(m_renderer);
     gs::matrix mat;
-    sceneConfig.calcMatrix(mat);
-    RECT rc;
-    GetClientRect(hwnd, &rc);
-    UINT width = rc.right - rc.left;
-    UINT height = rc.bottom - rc.top;
+    core->getSceneConfig().calcMatrix(mat);
+    UINT width, height;
+    core->getViewSize(width, height);
+    if (!width || !height)
+        return;
+    setupIdBuffer(core, mat, width, height);
     for (NihilObject* p : m_selectedObjects)
     {
         ASSERT(p && p->isSelected());
         setupHittestInfoOf(p, mat, width, height);
     }
+    m_pointSelection.resize(0);
+    m_pointSelection.resize(m_pointTable.size());
+    m_viewWidth = width;
+    m_viewHeight = height;
+    m_pointGridDirty = true;
     updateUIVertices();
 }
 
+void NihilControl_PointsLayer::setupIdBuffer(NihilCore* core, const gs::matrix& mat, UINT width, UINT height)
+{
+    ASSERT(core);
+    // all the objects in the view may occlude the points, not only the selected ones
+    core->m_sceneBvh.refit();
+    NihilObjectList objects;
+    core->m_sceneBvh.query(mat, objects);
+    m_idBuffer.setup((int)width, (int)height);
+    nihilDrawIdBuffer(m_idBuffer, core->m_objectTable, objects, mat, m_threadPool);
+}
+
 void NihilControl_PointsLayer::setupHittestInfoOf(NihilObject* object, const gs::matrix& mat, UINT width, UINT height)
 {
     ASSERT(object);
@@ -1949,44 +3001,60 @@ void NihilControl_PointsLayer::setupHittestInfoOfPolygon(NihilPolygon* polygon,
     ASSERT(polygon);
     // 1.ndc => screen space
     gs::matrix ssm;
-    ssm.multiply(polygon->getLocalMat(), mat);
+    ssm.multiply(polygon->getWorldMat(), mat);
     ssm.multiply(gs::matrix().scaling(0.5f * width, -0.5f * height, 0.f));
     ssm.multiply(gs::matrix().translation(0.5f * width, 0.5f * height, 0.f));
-    // 2.transform points
-    NihilPointList& pointList = polygon->getPointList();
-    std::vector<gs::vec3> dupPoints;
-    dupPoints.resize(pointList.size());
-    int i = 0;
-    for (NihilVertex& v : pointList)
+    // 2.consider only the triangles in the view, the object space hierarchy culls the others
+    gs::matrix clipMat;
+    clipMat.multiply(polygon->getWorldMat(), mat);
+    std::vector<int> triangles;
+    polygon->getMeshBvh().query(clipMat, triangles);
+    // 3.gather the points of them, then project them in one batch
+    const NihilPointList& pointList = polygon->getPointList();
+    const NihilIndexList& indexList = polygon->getIndexList();
+    ASSERT(indexList.size() % 3 == 0);
+    std::vector<int> slots, gathered;
+    slots.resize(pointList.size(), -1);
+    for (int t : triangles)
     {
-        gs::vec4 t;
-        v.pos.transform(t, ssm);
-        t.scale(1.f / t.w);
-        dupPoints.at(i ++) = (const gs::vec3&)t;
+        for (int k = 0; k < 3; k ++)
+        {
+            int i = indexList.at(t * 3 + k);
+            if (slots.at(i) < 0)
+            {
+                slots.at(i) = (int)gathered.size();
+                gathered.push_back(i);
+            }
+        }
     }
-    // 3.test if the point was visible
-    std::unordered_set<int> visibleIndices;
-    NihilIndexList& indexList = polygon->getIndexList();
-    ASSERT(indexList.size() % 3 == 0);
-    for (i = 0; i < (int)indexList.size(); i += 3)
-    {
-        int a = indexList.at(i);
-        int b = indexList.at(i + 1);
-        int c = indexList.at(i + 2);
-        gs::vec2 p1 = dupPoints.at(a);
-        gs::vec2 p2 = dupPoints.at(b);
-        gs::vec2 p3 = dupPoints.at(c);
+    if (gathered.empty())
+        return;
+    NihilScreenPoints projected;
+    nihilProjectPoints(projected, &pointList.front().pos, sizeof(NihilVertex), gathered.data(), (int)gathered.size(), ssm, m_threadPool);
+    // 4.test if the point is visible
+    std::vector<bool> visible;
+    visible.resize(gathered.size(), false);
+    for (int t : triangles)
+    {
+        int a = slots.at(indexList.at(t * 3));
+        int b = slots.at(indexList.at(t * 3 + 1));
+        int c = slots.at(indexList.at(t * 3 + 2));
+        gs::vec2 p1(projected.xs[a], projected.ys[a]);
+        gs::vec2 p2(projected.xs[b], projected.ys[b]);
+        gs::vec2 p3(projected.xs[c], projected.ys[c]);
         bool isccw = gs::vec2().sub(p2, p1).ccw(gs::vec2().sub(p3, p2)) > 0.f;
         if (isccw)  // flip y already make counter clockwised.
         {
-            visibleIndices.insert(a);
-            visibleIndices.insert(b);
-            visibleIndices.insert(c);
+            visible.at(a) = visible.at(b) = visible.at(c) = true;
         }
     }
-    // 4.record the points info
-    for (int i : visibleIndices)
-        m_pointInfos.push_back(NihilPointInfo(polygon, i, dupPoints.at(i)));
+    // 5.record the points info, drop the ones hidden by the nearer surfaces of the id buffer
+    for (int i = 0; i < (int)pointList.size(); i ++)
+    {
+        int j = slots.at(i);
+        if (j >= 0 && visible.at(j) && projected.ws[j] > 0.f && m_idBuffer.isVisible(projected.xs[j], projected.ys[j], 1.f / projected.ws[j]))
+            m_pointTable.add(polygon, i, gs::vec3(projected.xs[j], projected.ys[j], projected.zs[j]));
+    }
 }
 
 void NihilControl_PointsLayer::setupHittestInfoOfBiCubicBezier(NihilBiCubicBezierPatch* bezierPatch, const gs::matrix& mat, UINT width, UINT height)
@@ -1994,11 +3062,11 @@ void NihilControl_PointsLayer::setupHittestInfoOfBiCubicBezier(NihilBiCubicBezie
     ASSERT(bezierPatch);
     // 1.ndc => screen space
     gs::matrix ssm;
-    ssm.multiply(bezierPatch->getLocalMat(), mat);
+    ssm.multiply(bezierPatch->getWorldMat(), mat);
     ssm.multiply(gs::matrix().scaling(0.5f * width, -0.5f * height, 0.f));
     ssm.multiply(gs::matrix().translation(0.5f * width, 0.5f * height, 0.f));
     // 2.transform points
-    gs::vec3* cvs = bezierPatch->getCvs();
+    const gs::vec3* cvs = bezierPatch->getCvs();
     ASSERT(cvs);
     std::vector<gs::vec3> dupPoints;
     dupPoints.resize(16);
@@ -2010,7 +3078,7 @@ void NihilControl_PointsLayer::setupHittestInfoOfBiCubicBezier(NihilBiCubicBezie
         dupPoints.at(i) = (const gs::vec3&)t;
     }
     // 3.test if the point was visible
-    std::unordered_set<int> visibleIndices;
+    bool visible[16] = { false };
     static int indexArray[4][4] =
     {
         { 0, 1, 2, 3 },
@@ -2033,22 +3101,21 @@ void NihilControl_PointsLayer::setupHittestInfoOfBiCubicBezier(NihilBiCubicBezie
             // a - c - d
             if (gs::vec2().sub(p3, p1).ccw(gs::vec2().sub(p4, p3)) > 0.f)
             {
-                visibleIndices.insert(a);
-                visibleIndices.insert(c);
-                visibleIndices.insert(d);
+                visible[a] = visible[c] = visible[d] = true;
             }
             // a - d - b
             if (gs::vec2().sub(p4, p1).ccw(gs::vec2().sub(p2, p4)) > 0.f)
             {
-                visibleIndices.insert(a);
-                visibleIndices.insert(d);
-                visibleIndices.insert(b);
+                visible[a] = visible[d] = visible[b] = true;
             }
         }
     }
     // 4.record the points info
-    for (int i : visibleIndices)
-        m_pointInfos.push_back(NihilPointInfo(bezierPatch, i, dupPoints.at(i)));
+    for (int i = 0; i < 16; i ++)
+    {
+        if (visible[i])
+            m_pointTable.add(bezierPatch, i, dupPoints.at(i));
+    }
 }
 
 void NihilControl_PointsLayer::setupHittestInfoOfBiCubicNurbs(NihilBiCubicNURBSurface* nurbs, const gs::matrix& mat, UINT width, UINT height)
@@ -2056,22 +3123,18 @@ void NihilControl_PointsLayer::setupHittestInfoOfBiCubicNurbs(NihilBiCubicNURBSu
     ASSERT(nurbs);
     // 1.ndc => screen space
     gs::matrix ssm;
-    ssm.multiply(nurbs->getLocalMat(), mat);
+    ssm.multiply(nurbs->getWorldMat(), mat);
     ssm.multiply(gs::matrix().scaling(0.5f * width, -0.5f * height, 0.f));
     ssm.multiply(gs::matrix().translation(0.5f * width, 0.5f * height, 0.f));
     // 2.transform points
     auto& cvs = nurbs->getCvs();
-    std::vector<gs::vec3> dupPoints;
-    dupPoints.resize(cvs.size());
-    for (int i = 0; i < (int)cvs.size(); i ++)
-    {
-        gs::vec4 t;
-        cvs.at(i).transform(t, ssm);
-        t.scale(1.f / t.w);
-        dupPoints.at(i) = (const gs::vec3&)t;
-    }
+    if (cvs.empty())
+        return;
+    NihilScreenPoints projected;
+    nihilProjectPoints(projected, &cvs.front(), sizeof(gs::vec3), nullptr, (int)cvs.size(), ssm, m_threadPool);
     // 3.test if the point was visible
-    std::unordered_set<int> visibleIndices;
+    std::vector<bool> visible;
+    visible.resize(cvs.size(), false);
     int ucvs = nurbs->getUCvs(), vcvs = nurbs->getVCvs();
     for (int v = 0; v < vcvs - 1; v ++)
     {
@@ -2079,45 +3142,71 @@ void NihilControl_PointsLayer::setupHittestInfoOfBiCubicNurbs(NihilBiCubicNURBSu
         {
             int a = v * ucvs + u, b = a + 1;
             int c = (v + 1) * ucvs + u, d = c + 1;
-            gs::vec2 p1 = dupPoints.at(a);  // a
-            gs::vec2 p2 = dupPoints.at(b);  // b
-            gs::vec2 p3 = dupPoints.at(c);  // c
-            gs::vec2 p4 = dupPoints.at(d);  // d
+            gs::vec2 p1(projected.xs[a], projected.ys[a]);  // a
+            gs::vec2 p2(projected.xs[b], projected.ys[b]);  // b
+            gs::vec2 p3(projected.xs[c], projected.ys[c]);  // c
+            gs::vec2 p4(projected.xs[d], projected.ys[d]);  // d
             // a - c - d
             if (gs::vec2().sub(p3, p1).ccw(gs::vec2().sub(p4, p3)) > 0.f)
             {
-                visibleIndices.insert(a);
-                visibleIndices.insert(c);
-                visibleIndices.insert(d);
+                visible[a] = visible[c] = visible[d] = true;
             }
             // a - d - b
             if (gs::vec2().sub(p4, p1).ccw(gs::vec2().sub(p2, p4)) > 0.f)
             {
-                visibleIndices.insert(a);
-                visibleIndices.insert(d);
-                visibleIndices.insert(b);
+                visible[a] = visible[d] = visible[b] = true;
             }
         }
     }
     // 4.record the points info
-    for (int i : visibleIndices)
-        m_pointInfos.push_back(NihilPointInfo(nurbs, i, dupPoints.at(i)));
+    for (int i = 0; i < (int)visible.size(); i ++)
+    {
+        if (visible.at(i))
+            m_pointTable.add(nurbs, i, gs::vec3(projected.xs[i], projected.ys[i], projected.zs[i]));
+    }
 }
 
 void NihilControl_PointsLayer::updateUIVertices()
 {
     if (m_uiPoints)
-        m_uiPoints->updateBuffer(m_pointInfos);
+        m_uiPoints->updateBuffer(m_pointTable, m_pointSelection);
+}
+
+void NihilControl_PointsLayer::onFrame(NihilCore* core)
+{
+    if (!m_uiPointsDirty)
+        return;
+    m_uiPointsDirty = false;
+    updateUIVertices();
+}
+
+void NihilControl_PointsLayer::onSelectionChanged(const NihilSelectionSet* selection, const gs::vbitset& changed)
+{
+    ASSERT(selection == &m_pointSelection);
+    m_uiPointsDirty = true;
+    m_core->invalidate();
 }
 
-void NihilControl_PointsLayer::resetSelectState()
+void NihilControl_PointsLayer::onElementChanged(const NihilSelectionSet* selection, int i)
 {
-    for (auto& info : m_pointInfos)
-        info.isSelected = false;
+    ASSERT(selection == &m_pointSelection);
+    m_uiPointsDirty = true;
+    m_core->invalidate();
 }
 
-void NihilControl_PointsLayer::startSelecting()
+void NihilControl_PointsLayer::startSelecting(bool lasso)
 {
+    if (lasso)
+    {
+        if (m_lassoArea)
+            delete m_lassoArea;
+        m_lasso.clear();
+        m_lasso.addPoint(m_startpt);
+        m_lassoArea = new NihilUILasso(m_renderer);
+        ASSERT(m_lassoArea);
+        m_lassoArea->setupBuffers(m_lasso);
+        return;
+    }
     if (m_selectArea)
         delete m_selectArea;
     m_selectArea = new NihilUIRectangle(m_renderer);
@@ -2128,134 +3217,213 @@ void NihilControl_PointsLayer::startSelecting()
 
 void NihilControl_PointsLayer::endSelecting(const gs::vec2& pt)
 {
+    gs::pink::rectf rc;
+    if (m_lassoArea)
+    {
+        delete m_lassoArea;
+        m_lassoArea = nullptr;
+        m_lasso.addPoint(pt);
+        if (m_lasso.isValid())
+        {
+            m_lasso.prepare();
+            return hitTest(m_lasso.getBoundingRect(), &m_lasso);
+        }
+        // too short to be a lasso, take it as a click
+        nihilBoundaryRect(rc, m_startpt, pt);
+        return hitTest(rc);
+    }
     ASSERT(m_selectArea);
     delete m_selectArea;
     m_selectArea = nullptr;
-    resetSelectState();
-    gs::rectf rc;
     nihilBoundaryRect(rc, m_startpt, pt);
     hitTest(rc);
-    updateUIVertices();
 }
 
 void NihilControl_PointsLayer::updateSelecting(const gs::vec2& pt)
 {
+    if (m_lassoArea)
+    {
+        if (m_lasso.addPoint(pt))
+            m_lassoArea->updateBuffer(m_lasso);
+        return;
+    }
     ASSERT(m_selectArea);
     m_selectArea->setBottomRight(pt.x, pt.y);
     m_selectArea->updateBuffer();
 }
 
-void NihilControl_PointsLayer::hitTest(const gs::rectf& rc)
+void NihilControl_PointsLayer::updatePointGrid()
 {
-    for (auto& info : m_pointInfos)
+    if (!m_pointGridDirty)
+        return;
+    m_pointGrid.build(m_pointTable.getXs(), m_pointTable.getYs(), m_pointTable.size(), (int)m_viewWidth, (int)m_viewHeight);
+    m_pointGridDirty = false;
+}
+
+void NihilControl_PointsLayer::hitTest(const gs::pink::rectf& rc, const NihilLasso* lasso)
+{
+    // bucket the points moved since the last hit test again first
+    updatePointGrid();
+    gs::vbitset hits;
+    hits.resize(m_pointTable.size());
+    if (lasso)
+    {
+        // the candidates in the bounding rect, then classify them by the lasso over the pool
+        m_pointGrid.query(rc, m_pointTable.getXs(), m_pointTable.getYs(), hits);
+        std::vector<int> candidates;
+        for (int i = hits.find_next(0); i >= 0; i = hits.find_next(i + 1))
+            candidates.push_back(i);
+        std::vector<char> inside;
+        inside.resize(candidates.size(), 0);
+        const float* xs = m_pointTable.getXs();
+        const float* ys = m_pointTable.getYs();
+        m_threadPool->parallelFor((int)candidates.size(), NIHIL_LASSO_GRAIN, [&](int first, int last) {
+            for (int j = first; j < last; j ++)
+                inside[j] = lasso->contains(xs[candidates[j]], ys[candidates[j]]);
+        });
+        for (int j = 0; j < (int)candidates.size(); j ++)
+        {
+            if (!inside.at(j))
+                hits.reset(candidates.at(j), false);
+        }
+    }
+    else if (rc.width() < NIHIL_CLICK_TOLERANCE && rc.height() < NIHIL_CLICK_TOLERANCE)
     {
-        if (rc.in_rect(gs::pointf(info.point.x, info.point.y)))
-            info.isSelected = true;
+        // a click picks the nearest point around it
+        int i = m_pointGrid.pick(rc.left, rc.top, NIHIL_PICK_RADIUS, m_pointTable.getXs(), m_pointTable.getYs());
+        if (i >= 0)
+            hits.set(i);
     }
+    else
+        m_pointGrid.query(rc, m_pointTable.getXs(), m_pointTable.getYs(), hits);
+    // replace the selection in one go
+    m_pointSelection.replace(hits);
 }
 
-static void collectSelectedPoints(NihilPointInfoRefs& selectedPoints, NihilPointInfoList& infos)
+// the points of the object to write through and the matrix to the screen space, taken once for a run of its points
+static gs::vec3* nihilBeginTranslation(NihilObject* object, const gs::matrix& mat, UINT width, UINT height, gs::matrix& ssm, int& stride)
 {
-    selectedPoints.clear();
-    for (auto& info : infos)
+    ASSERT(object);
+    // ndc => screen space
+    ssm.multiply(object->getWorldMat(), mat);
+    ssm.multiply(gs::matrix().scaling(0.5f * width, -0.5f * height, 0.f));
+    ssm.multiply(gs::matrix().translation(0.5f * width, 0.5f * height, 0.f));
+    // each edit call may copy the shared lists, bumps the version and invalidates the bvh, so call it once
+    switch (object->getType())
     {
-        if (info.isSelected)
-            selectedPoints.push_back(&info);
+    case NihilObject::OT_Polygon:
+        stride = sizeof(NihilVertex);
+        return &static_cast<NihilPolygon*>(object)->editPointList().front().pos;
+    case NihilObject::OT_BiCubicBezierPatch:
+        stride = sizeof(gs::vec3);
+        return static_cast<NihilBiCubicBezierPatch*>(object)->editCvs();
+    case NihilObject::OT_BiCubicNURBS:
+        stride = sizeof(gs::vec3);
+        return static_cast<NihilBiCubicNURBSurface*>(object)->editCvs().data();
+    default:
+        ASSERT(!"Unexpecd type.");
+        return nullptr;
     }
 }
 
-void NihilControl_PointsLayer::startTranslation()
+static void nihilUpdateTranslationPoint(NihilPointTable& points, int i, gs::vec3* first, int stride, const gs::matrix& ssm, const gs::vec3& offset)
 {
-    collectSelectedPoints(m_selectedPoints, m_pointInfos);
-}
-
-static NihilObject* nihilUpdateTranslationPoint(NihilPointInfo* info, const gs::matrix& mat, UINT width, UINT height, const gs::vec3& offset)
-{
-    ASSERT(info);
-    // ndc => screen space
-    gs::matrix ssm;
-    ssm.multiply(info->object->getLocalMat(), mat);
-    ssm.multiply(gs::matrix().scaling(0.5f * width, -0.5f * height, 0.f));
-    ssm.multiply(gs::matrix().translation(0.5f * width, 0.5f * height, 0.f));
     // offset the origin point
-    ASSERT(info->object->getType() == NihilObject::OT_Polygon);
-    auto& ptList = static_cast<NihilPolygon*>(info->object)->getPointList();
-    auto& v = ptList.at(info->index).pos;
+    gs::vec3& v = *(gs::vec3*)((char*)first + stride * points.getIndex(i));
     v += offset;
     // modify the point info
     gs::vec4 t;
     v.transform(t, ssm);
     t.scale(1.f / t.w);
-    info->point = (const gs::vec3&)t;
-    return info->object;
+    points.setPoint(i, (const gs::vec3&)t);
 }
 
-static NihilObject* nihilUpdateTranslationCvs(NihilPointInfo* info, const gs::matrix& mat, UINT width, UINT height, const gs::vec3& offset)
+void NihilControl_PointsLayer::updateTranslation(NihilSceneConfig& sceneConfig, const gs::vec2& pt)
 {
-    ASSERT(info);
-    // ndc => screen space
+    if (m_pointSelection.isEmpty())
+        return;
+    auto t = sceneConfig.getTranslationInCurrentView(m_lastpt, pt);
+    gs::matrix mat;
+    sceneConfig.calcMatrix(mat);
+    UINT width, height;
+    m_core->getViewSize(width, height);
+    // queue the modified objects, the moves between two frames flush together
+    NihilObject* lastObject = nullptr;
+    gs::vec3* first = nullptr;
+    int stride = 0;
     gs::matrix ssm;
-    ssm.multiply(info->object->getLocalMat(), mat);
-    ssm.multiply(gs::matrix().scaling(0.5f * width, -0.5f * height, 0.f));
-    ssm.multiply(gs::matrix().translation(0.5f * width, 0.5f * height, 0.f));
-    //
-    gs::vec3* v = nullptr;
-    // offset the origin point
-    if (info->object->getType() == NihilObject::OT_BiCubicBezierPatch)
-    {
-        auto* cvs = static_cast<NihilBiCubicBezierPatch*>(info->object)->getCvs();
-        v = &cvs[info->index];
-        (*v) += offset;
-    }
-    else if (info->object->getType() == NihilObject::OT_BiCubicNURBS)
+    for (int i = m_pointSelection.findNext(0); i >= 0; i = m_pointSelection.findNext(i + 1))
     {
-        auto& cvs = static_cast<NihilBiCubicNURBSurface*>(info->object)->getCvs();
-        v = &cvs.at(info->index);
-        (*v) += offset;
+        // the points of an object sit in the table in a row, so journal and edit them in a run
+        NihilObject* object = m_pointTable.getObject(i);
+        if (object != lastObject)
+        {
+            recordMovedPoints(lastObject, t);
+            lastObject = object;
+            first = nihilBeginTranslation(object, mat, width, height, ssm, stride);
+            if (first)
+                m_core->queueUpdate(object);
+        }
+        if (!first)
+            continue;
+        m_movedIndices.push_back(m_pointTable.getIndex(i));
+        nihilUpdateTranslationPoint(m_pointTable, i, first, stride, ssm, t);
     }
-    else
+    recordMovedPoints(lastObject, t);
+    m_pointGridDirty = true;
+    m_uiPointsDirty = true;
+}
+
+void NihilControl_PointsLayer::recordMovedPoints(NihilObject* object, const gs::vec3& offset)
+{
+    if (object && !m_movedIndices.empty())
+        m_core->m_journal.recordPoints(object->getTableSlot(), m_movedIndices.data(), (int)m_movedIndices.size(), offset);
+    m_movedIndices.clear();
+}
+
+static gs::vec3 nihilGetEditablePoint(const NihilObject* object, int index)
+{
+    ASSERT(object);
+    switch (object->getType())
     {
-        ASSERT(!"Unexpecd type.");
-        return nullptr;
+    case NihilObject::OT_Polygon:
+        return static_cast<const NihilPolygon*>(object)->getPointList().at(index).pos;
+    case NihilObject::OT_BiCubicBezierPatch:
+        ASSERT(index >= 0 && index < 16);
+        return static_cast<const NihilBiCubicBezierPatch*>(object)->getCvs()[index];
+    case NihilObject::OT_BiCubicNURBS:
+        return static_cast<const NihilBiCubicNURBSurface*>(object)->getCvs().at(index);
     }
-    // modify the point info
-    gs::vec4 t;
-    v->transform(t, ssm);
-    t.scale(1.f / t.w);
-    info->point = (const gs::vec3&)t;
-    return info->object;
+    ASSERT(!"Unexpected type.");
+    return gs::vec3(0.f, 0.f, 0.f);
 }
 
-void NihilControl_PointsLayer::updateTranslation(NihilSceneConfig& sceneConfig, HWND hwnd, const gs::vec2& pt)
+void NihilControl_PointsLayer::onObjectsEdited(NihilCore* core)
 {
-    if (m_selectedPoints.empty())
-        return;
-    auto t = sceneConfig.getTranslationInCurrentView(m_lastpt, pt);
+    // the core moved the points, project them again
+    ASSERT(core);
     gs::matrix mat;
-    sceneConfig.calcMatrix(mat);
-    RECT rc;
-    GetClientRect(hwnd, &rc);
-    UINT width = rc.right - rc.left;
-    UINT height = rc.bottom - rc.top;
-    std::unordered_set<NihilObject*> modifiedObjects;
-    for (auto* info : m_selectedPoints)
-    {
-        ASSERT(info);
-        switch (info->object->getType())
+    core->getSceneConfig().calcMatrix(mat);
+    UINT width, height;
+    core->getViewSize(width, height);
+    NihilObject* lastObject = nullptr;
+    gs::matrix ssm;
+    for (int i = 0; i < m_pointTable.size(); i ++)
+    {
+        NihilObject* object = m_pointTable.getObject(i);
+        if (object != lastObject)
         {
-        case NihilObject::OT_Polygon:
-            modifiedObjects.insert(nihilUpdateTranslationPoint(info, mat, width, height, t));
-            break;
-        case NihilObject::OT_BiCubicBezierPatch:
-        case NihilObject::OT_BiCubicNURBS:
-            modifiedObjects.insert(nihilUpdateTranslationCvs(info, mat, width, height, t));
-            break;
+            // ndc => screen space
+            ssm.multiply(object->getWorldMat(), mat);
+            ssm.multiply(gs::matrix().scaling(0.5f * width, -0.5f * height, 0.f));
+            ssm.multiply(gs::matrix().translation(0.5f * width, 0.5f * height, 0.f));
+            lastObject = object;
         }
+        gs::vec4 t;
+        nihilGetEditablePoint(object, m_pointTable.getIndex(i)).transform(t, ssm);
+        t.scale(1.f / t.w);
+        m_pointTable.setPoint(i, (const gs::vec3&)t);
     }
-    for (auto* object : modifiedObjects)
-    {
-        ASSERT(object);
-        object->updateBuffers();
-    }
-    updateUIVertices();
+    m_pointGridDirty = true;
+    m_uiPointsDirty = true;
 }
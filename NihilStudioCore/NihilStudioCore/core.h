@@ -1,10 +1,22 @@
 #pragma once
 
-#include <windows.h>
+#include "nihilplatform.h"
+#include <memory>
+#include <atomic>
 #include <unordered_map>
 #include <gslib/math.h>
 #include <gslib/string.h>
-#include <gslib/rtree.h>
+#include "scenebvh.h"
+#include "selection.h"
+#include "pointgrid.h"
+#include "projection.h"
+#include "idbuffer.h"
+#include "lasso.h"
+#include "commandlist.h"
+#include "threadpool.h"
+#include "autosave.h"
+#include "journal.h"
+#include "nurbs.h"
 
 struct NihilVertex
 {
@@ -19,21 +31,40 @@ struct NihilUIVertex
 };
 
 typedef gs::string NihilString;
+extern double nihilGetMilliseconds();
+extern unsigned long long nihilNewObjectVersion();   // unique over the objects, never reused
 class NihilCore;
+class NihilObjectTable;
+struct NihilObjectSnapshot;
 
 class __declspec(novtable) NihilGeometry abstract
 {
 public:
     virtual ~NihilGeometry() {}
-    virtual bool createVertexStream(NihilVertex vertices[], int size) = 0;
-    virtual bool createIndexStream(int indices[], int size) = 0;
-    virtual bool updateVertexStream(NihilVertex vertices[], int size) = 0;
-    virtual void setLocalMat(const gs::matrix& m) = 0;
+    virtual bool createVertexStream(const NihilVertex vertices[], int size) = 0;
+    virtual bool createIndexStream(const int indices[], int size) = 0;
+    virtual bool createLodIndexStream(int level, const int indices[], int size) = 0;  // level starts from 1, 0 is the index stream
+    virtual bool updateVertexStream(const NihilVertex vertices[], int size) = 0;
+    virtual void setLocalMat(const gs::matrix& m) = 0;          // the world matrix of the owner object
+    virtual const gs::matrix& getLocalMat() const = 0;
+    virtual void shareStreamsOf(NihilGeometry* source) = 0;  // draw the streams of source as an instance of it
+    virtual void unshareStreams() = 0;                       // leave the shared streams, create them again after this
+    virtual bool isInstanced() const = 0;                    // the streams are shared with the other geometries
+    virtual const void* getStreams() const = 0;              // the same for the geometries sharing the streams
     void setSelected(bool b) { m_isSelected = b; }
     bool isSelected() const { return m_isSelected; }
+    void setVisible(bool b) { m_isVisible = b; }
+    bool isVisible() const { return m_isVisible; }
+    void setLodBound(const gs::vec3& center) { m_lodCenter = center; }
+    void setLodErrors(const std::vector<float>& errors) { m_lodErrors = errors; }
+    int getLodLevels() const { return (int)m_lodErrors.size(); }
+    int selectLodLevel(const gs::matrix& mvp, float width, float height) const;
 
 protected:
     bool                    m_isSelected = false;
+    bool                    m_isVisible = true;     // culling result of the current frame
+    gs::vec3                m_lodCenter = gs::vec3(0.f, 0.f, 0.f);
+    std::vector<float>      m_lodErrors;            // object space error of each level, the first one is 0
 };
 
 class __declspec(novtable) NihilUIObject abstract
@@ -54,25 +85,34 @@ public:
 
 public:
     void setTopology(Topology topo) { m_topology = topo; }
+    Topology getTopology() const { return m_topology; }
 
 protected:
     Topology                m_topology = Topo_Points;
 };
 
+typedef std::vector<NihilUIObject*> NihilUIObjectList;
+
 class __declspec(novtable) NihilRenderer abstract
 {
 public:
     virtual ~NihilRenderer() {}
     virtual bool setup(HWND hwnd) = 0;
-    virtual void render() = 0;
+    virtual void render(const NihilCommandList& commands) = 0;  // the sorted draws of the frame
     virtual void notifyResize() = 0;
-    virtual void setWorldMat(const gs::matrix& m) = 0;
+    virtual void getViewSize(float& width, float& height) const = 0;
     virtual NihilGeometry* addGeometry() = 0;
     virtual NihilUIObject* addUIObject() = 0;
     virtual void removeGeometry(NihilGeometry*) = 0;
     virtual void removeUIObject(NihilUIObject*) = 0;
     virtual void showSolidMode() = 0;
     virtual void showWireframeMode() = 0;
+
+public:
+    const NihilUIObjectList& getUIObjects() const { return m_uiObjects; }   // in the order they are added
+
+protected:
+    NihilUIObjectList       m_uiObjects;
 };
 
 class __declspec(novtable) NihilControl abstract
@@ -89,6 +129,8 @@ public:
 public:
     virtual ~NihilControl() {}
     virtual bool onMsg(NihilCore* core, UINT message, WPARAM wParam, LPARAM lParam) = 0; // true: stop false: continue
+    virtual void onFrame(NihilCore* core) {}        // before each frame, to flush the ui updates held since the last one
+    virtual void onObjectsEdited(NihilCore* core) {}    // the core changed the objects, e.g. by undo
     void setModifierTag(ModifierTag t) { m_modTag = t; }
 
 protected:
@@ -98,19 +140,24 @@ protected:
 class NihilSceneConfig
 {
 public:
-    void setup(HWND hwnd);
-    void updateProjMatrix(HWND hwnd);
+    void setup(UINT width, UINT height);
+    void updateProjMatrix(UINT width, UINT height);
+    void setDepthRange(float zn, float zf) { m_zn = zn; m_zf = zf; }   // for the next updateProjMatrix
     void updateViewMatrix();
     void calcMatrix(gs::matrix& mat);
     void updateRotation(const gs::vec2& lastpt, const gs::vec2& pt);
     void updateZooming(float d);
     void updateTranslation(const gs::vec2& lastpt, const gs::vec2& pt);
+    void setupOrbit(float rot1, float rot2, float distance, const gs::vec3& center);  // look at the center from the angles
+    float calcFitDistance(float radius, UINT width, UINT height) const;     // the camera distance to see the whole sphere
     gs::vec3 getTranslationInCurrentView(const gs::vec2& lastpt, const gs::vec2& pt) const;
 
 private:
     float                   m_rot1 = 0.f;           // first rotation angle, in x-z plane, rotate in y-axis
     float                   m_rot2 = 0.f;           // second rotation angle, in rot1 plane
     float                   m_cdis = 20.f;          // camera distance
+    float                   m_zn = 0.01f;           // the near plane of the projection
+    float                   m_zf = 100.f;           // the far plane
     gs::vec3                m_viewOffset = gs::vec3(0.f, 0.f, 0.f);
     gs::matrix              m_model;
     gs::matrix              m_viewLookat;
@@ -121,6 +168,92 @@ private:
 typedef std::vector<NihilVertex> NihilPointList;
 typedef std::vector<int> NihilIndexList;
 
+/*
+ * A list shared by its copies until one of them is edited, the edited one copies the list first.
+ * The lists held by the snapshots are never written again, so the other threads may read them.
+ * The copies live on the editing thread, but the shares drop on any thread, so they are counted apart:
+ * a share drops its count by a release after its last read, and the edit loads the count by an acquire, the list
+ * is written in place only after the reads of all the dropped shares.
+ */
+template<class _Ty>
+class NihilSharedList
+{
+public:
+    typedef std::vector<_Ty> List;
+    typedef std::shared_ptr<const List> ConstPtr;
+
+protected:
+    struct Block
+    {
+        List                list;
+        std::atomic<int>    shares;                 // not dropped yet
+
+        Block(): shares(0) {}
+        explicit Block(const List& l): list(l), shares(0) {}
+    };
+    typedef std::shared_ptr<Block> BlockPtr;
+
+    // owned by a share, it keeps the block as well
+    struct Share
+    {
+        BlockPtr            block;
+
+        explicit Share(const BlockPtr& b): block(b) { block->shares.fetch_add(1, std::memory_order_relaxed); }
+        ~Share() { block->shares.fetch_sub(1, std::memory_order_release); }
+    };
+
+public:
+    NihilSharedList(): m_block(std::make_shared<Block>()) {}
+    const List& get() const { return m_block->list; }
+    operator const List&() const { return m_block->list; }
+    List& edit()
+    {
+        // a block kept by a dropping share is copied as well, which does no harm
+        if (m_block->shares.load(std::memory_order_acquire) > 0 || m_block.use_count() > 1)
+            m_block = std::make_shared<Block>(m_block->list);
+        return m_block->list;
+    }
+    ConstPtr share() const                          // hold the current contents, the later edits copy the list
+    {
+        auto share = std::make_shared<Share>(m_block);
+        return ConstPtr(share, &m_block->list);
+    }
+    bool empty() const { return m_block->list.empty(); }
+    size_t size() const { return m_block->list.size(); }
+    const _Ty& at(size_t i) const { return m_block->list.at(i); }
+    const _Ty& front() const { return m_block->list.front(); }
+    const _Ty* data() const { return m_block->list.data(); }
+    typename List::const_iterator begin() const { return m_block->list.begin(); }
+    typename List::const_iterator end() const { return m_block->list.end(); }
+
+protected:
+    BlockPtr                m_block;
+};
+
+typedef NihilSharedList<NihilVertex> NihilSharedPointList;
+typedef NihilSharedList<int> NihilSharedIndexList;
+
+// shared by the polygons with identical contents, copied on write
+struct NihilMeshData
+{
+    enum BvhState
+    {
+        BS_Valid,
+        BS_Refit,                                   // the points moved
+        BS_Rebuild,                                 // the triangles changed
+    };
+
+    NihilSharedPointList    pointList;              // copied on write as well, so that the snapshots can hold them
+    NihilSharedIndexList    indexList;
+    std::vector<NihilIndexList> lodIndexLists;      // to setup the lod streams again after a copy
+    std::vector<float>      lodErrors;
+    NihilMeshBvh            bvh;                    // for hit tests, brought up to date on demand
+    BvhState                bvhState = BS_Rebuild;
+
+    void invalidateBvh(BvhState state) { if (state > bvhState) bvhState = state; }
+};
+typedef std::shared_ptr<NihilMeshData> NihilMeshDataPtr;
+
 class __declspec(novtable) NihilObject abstract
 {
 public:
@@ -132,26 +265,65 @@ public:
     };
 
 public:
-    virtual ~NihilObject() {}
+    virtual ~NihilObject();
     virtual ObjectType getType() const = 0;
     virtual void updateBuffers() = 0;
+    virtual void takeSnapshot(NihilObjectSnapshot& snapshot) const = 0;
+    unsigned long long getVersion() const { return m_version; }     // of the contents except the transforms
+    void touch() { m_version = nihilNewObjectVersion(); }           // after editing the contents
     NihilGeometry* getGeometry() const { return m_geometry; }
     const gs::matrix& getLocalMat() const { return m_localMat; }
-    void setLocalMat(const gs::matrix& mat) { m_localMat = mat; }
-    virtual void appendTranslation(const gs::vec3& ofs);
+    void setLocalMat(const gs::matrix& mat) { m_localMat = mat; invalidateWorldMat(); }
+    const gs::matrix& getWorldMat() const;
+    NihilObject* getParent() const { return m_parent; }
+    const std::vector<NihilObject*>& getChildren() const { return m_children; }
+    void setParent(NihilObject* parent);
+    bool isAncestorOf(const NihilObject* object) const;
+    void appendTranslation(const gs::vec3& ofs);    // offset in world space
+    void updateTransforms();            // flush the changed world matrices of the subtree to the geometries and the bounding boxes
+    const NihilBoundingBox& getBoundingBox() const { return m_boundingBox; }
+    void updateLocalBoundingBox();      // after changing the points
+    void updateBoundingBox();           // after changing the local matrix
+    void setSceneBvhLeaf(NihilSceneBvh* bvh, int leaf) { m_sceneBvh = bvh; m_bvhLeaf = leaf; }
+    void setObjectTableSlot(NihilObjectTable* table, int slot) { m_objectTable = table; m_tableSlot = slot; }
+    int getTableSlot() const { return m_tableSlot; }
+    virtual NihilGeometry* getRenderGeometry() const { return m_geometry; }    // the geometry that draws this object
+    void setSelected(bool b);
+    bool isSelected() const;
+    void setUpdateQueued(bool b) { m_updateQueued = b; }
+    bool isUpdateQueued() const { return m_updateQueued; }
     // bridge
-    virtual void setSelected(bool b) { if (m_geometry) m_geometry->setSelected(b); }
-    virtual bool isSelected() const { return m_geometry ? m_geometry->isSelected() : false; }
+    virtual void setVisible(bool b) { if (m_geometry) m_geometry->setVisible(b); }
+    virtual bool isVisible() const { return m_geometry ? m_geometry->isVisible() : false; }
 
 protected:
     NihilGeometry*          m_geometry = nullptr;
-    gs::matrix              m_localMat;
+    gs::matrix              m_localMat;             // relative to the parent
+    NihilObject*            m_parent = nullptr;
+    std::vector<NihilObject*> m_children;
+    mutable gs::matrix      m_worldMat;
+    mutable bool            m_worldDirty = true;    // the world matrix has to be calculated again
+    bool                    m_transformDirty = true;    // the world matrix waits for updateTransforms
+    bool                    m_hasDirtyChildren = false; // some descendants wait for updateTransforms
+    NihilBoundingBox        m_localBoundingBox;
+    NihilBoundingBox        m_boundingBox;          // in world space
+    NihilSceneBvh*          m_sceneBvh = nullptr;
+    int                     m_bvhLeaf = -1;
+    NihilObjectTable*       m_objectTable = nullptr;
+    int                     m_tableSlot = -1;
+    bool                    m_updateQueued = false; // in the update queue of the core, so that it is queued once
+    unsigned long long      m_version = nihilNewObjectVersion();
 
 protected:
-    void updateLocalMat();
+    virtual void calcLocalBoundingBox(NihilBoundingBox& box) const = 0;
+    void invalidateWorldMat();
+    void invalidateSubtree();
     int loadLocalSectionFromTextStream(const NihilString& src, int start);
+    void takeBaseSnapshot(NihilObjectSnapshot& snapshot) const;
 };
 
+class NihilMeshCache;
+
 class NihilPolygon :
     public NihilObject
 {
@@ -159,22 +331,33 @@ public:
     NihilPolygon(NihilRenderer* renderer);
     virtual ~NihilPolygon();
     virtual ObjectType getType() const override { return OT_Polygon; }
-    int loadPolygonFromTextStream(const NihilString& src, int start);
-    NihilPointList& getPointList() { return m_pointList; }
-    NihilIndexList& getIndexList() { return m_indexList; }
+    int loadPolygonFromTextStream(const NihilString& src, int start, NihilMeshCache* meshCache = nullptr);
+    const NihilPointList& getPointList() const { return m_mesh->pointList; }
+    const NihilIndexList& getIndexList() const { return m_mesh->indexList; }
+    NihilPointList& editPointList() { detachMesh(); touch(); m_mesh->invalidateBvh(NihilMeshData::BS_Refit); return m_mesh->pointList.edit(); }
+    NihilIndexList& editIndexList() { detachMesh(); touch(); m_mesh->invalidateBvh(NihilMeshData::BS_Rebuild); return m_mesh->indexList.edit(); }
+    const NihilMeshData& getMeshData() const { return *m_mesh; }
+    const NihilMeshBvh& getMeshBvh() const;
+    bool isMeshShared() const { return m_mesh.use_count() > 1; }
     virtual void updateBuffers() override;
+    virtual void takeSnapshot(NihilObjectSnapshot& snapshot) const override;
 
 protected:
     NihilRenderer*          m_renderer = nullptr;
-    NihilPointList          m_pointList;
-    NihilIndexList          m_indexList;
+    NihilMeshDataPtr        m_mesh;
+    bool                    m_analyticNormals = false;  // the grid meshes have the normals of their surfaces, not averaged by the faces
 
     friend class NihilBiCubicBezierPatch;
     friend class NihilBiCubicNURBSurface;
 
 protected:
+    virtual void calcLocalBoundingBox(NihilBoundingBox& box) const override;
     void calculateNormals();
     bool setupGeometryBuffers();
+    void setupLodChain();
+    void setupLodStreams();
+    void shareMeshOf(NihilPolygon* prototype);
+    void detachMesh();
     int loadPointSectionFromTextStream(const NihilString& src, int start);
     int loadFaceSectionFromTextStream(const NihilString& src, int start);
 };
@@ -187,12 +370,14 @@ public:
     virtual ~NihilBiCubicBezierPatch();
     virtual ObjectType getType() const override { return OT_BiCubicBezierPatch; }
     NihilPolygon* getGridMesh() const { return m_gridMesh; }
-    gs::vec3* getCvs() { return m_cvs; }
+    const gs::vec3* getCvs() const { return m_cvs; }
+    gs::vec3* editCvs() { touch(); return m_cvs; }
     int loadBiCubicBezierPatchFromTextStream(const NihilString& src, int start);
     virtual void updateBuffers() override;
-    virtual void setSelected(bool b) override;
-    virtual bool isSelected() const override;
-    virtual void appendTranslation(const gs::vec3& ofs) override;
+    virtual void takeSnapshot(NihilObjectSnapshot& snapshot) const override;
+    virtual NihilGeometry* getRenderGeometry() const override { return m_gridMesh ? m_gridMesh->getGeometry() : nullptr; }
+    virtual void setVisible(bool b) override;
+    virtual bool isVisible() const override;
 
 protected:
     NihilRenderer*          m_renderer = nullptr;
@@ -201,6 +386,7 @@ protected:
     int                     m_ustep, m_vstep;
 
 protected:
+    virtual void calcLocalBoundingBox(NihilBoundingBox& box) const override;
     int loadCvsSectionFromTextStream(const NihilString& src, int start);
     void loadFinished();
     void createGridMeshIndices();
@@ -216,30 +402,38 @@ public:
     virtual ~NihilBiCubicNURBSurface();
     virtual ObjectType getType() const override { return OT_BiCubicNURBS; }
     NihilPolygon* getGridMesh() const { return m_gridMesh; }
-    int getUCvs() const { return (int)m_uknots.size() - 4; }
-    int getVCvs() const { return (int)m_vknots.size() - 4; }
+    int getUCvs() const { return (int)m_uknots.size() - m_udegrees - 1; }
+    int getVCvs() const { return (int)m_vknots.size() - m_vdegrees - 1; }
     int getUDegrees() const { return m_udegrees; }
     int getVDegrees() const { return m_vdegrees; }
-    std::vector<gs::vec3>& getCvs() { return m_cvs; }
+    const std::vector<gs::vec3>& getCvs() const { return m_cvs; }
+    std::vector<gs::vec3>& editCvs() { touch(); return m_cvs.edit(); }
+    const std::vector<float>& getWeights() const { return m_weights; }     // empty if non-rational
+    bool isRational() const { return !m_weights.empty(); }
     virtual void updateBuffers() override;
-    virtual void setSelected(bool b) override;
-    virtual bool isSelected() const override;
-    virtual void appendTranslation(const gs::vec3& ofs) override;
+    virtual void takeSnapshot(NihilObjectSnapshot& snapshot) const override;
+    virtual NihilGeometry* getRenderGeometry() const override { return m_gridMesh ? m_gridMesh->getGeometry() : nullptr; }
+    virtual void setVisible(bool b) override;
+    virtual bool isVisible() const override;
     int loadBiCubicNURBSFromTextStream(const NihilString& src, int start);
 
 protected:
     NihilRenderer*          m_renderer = nullptr;
     std::vector<float>      m_uknots;
     std::vector<float>      m_vknots;
-    std::vector<gs::vec3>   m_cvs;
+    NihilSharedList<gs::vec3> m_cvs;
+    NihilSharedList<float>  m_weights;              // of the cvs, empty if non-rational
     NihilPolygon*           m_gridMesh = nullptr;
-    int                     m_udegrees = 3, m_vdegrees = 3;  // support 3 degree only
+    int                     m_udegrees = 3, m_vdegrees = 3;
     int                     m_ustep, m_vstep;
+    NihilNurbsEvaluator     m_evaluator;            // set up by the knots and the steps, kept through the edits of the cvs
+
+protected:
+    virtual void calcLocalBoundingBox(NihilBoundingBox& box) const override;
 
 private:
     int loadCvsSectionFromTextStream(const NihilString& src, int start);
     void loadFinished();
-    void calcPoint(gs::vec3& p, float u, float v);
     void updateGridMeshPoints();
     void createGridMeshIndices();
     void updateGridMesh();
@@ -247,6 +441,95 @@ private:
 
 typedef std::vector<NihilObject*> NihilObjectList;
 
+/*
+ * The contents of an object at the moment it is taken, written by the autosave on its own thread.
+ * The points, the indices, the cvs and the weights are the shared lists of the object rather than copies, the object copies
+ * them by the next edit if they are still held here. Only the bezier cvs and the knots are copied, as they are small.
+ */
+struct NihilObjectSnapshot
+{
+    NihilObject::ObjectType type = NihilObject::OT_Polygon;
+    unsigned long long      version = 0;
+    gs::matrix              worldMat;               // the hierarchy isn't saved, so the world matrix is written as the local one
+    NihilSharedPointList::ConstPtr points;          // polygon
+    NihilSharedIndexList::ConstPtr indices;
+    NihilSharedList<gs::vec3>::ConstPtr cvs;        // bezier and nurbs
+    NihilSharedList<float>::ConstPtr weights;       // nurbs, empty if non-rational
+    std::vector<float>      uknots;
+    std::vector<float>      vknots;
+    int                     ucvs = 0;
+    int                     vcvs = 0;
+    int                     udegrees = 3;
+    int                     vdegrees = 3;
+};
+
+struct NihilSceneSnapshot
+{
+    std::vector<NihilObjectSnapshot> objects;
+};
+
+// find the loaded polygons by content, so that the identical ones share their meshes
+class NihilMeshCache
+{
+public:
+    void add(NihilPolygon* polygon);
+    NihilPolygon* find(const NihilMeshData& mesh) const;
+
+protected:
+    typedef std::unordered_multimap<unsigned long long, NihilPolygon*> PolygonMap;
+    PolygonMap              m_polygons;
+};
+
+/*
+ * Structure of arrays over the scene objects, indexed by the slots of the objects.
+ * The sweeps over the whole scene (selections, hit test tables) run linearly on these arrays instead of
+ * chasing the object pointers through virtual calls.
+ * The selection state lives here, updateBoundingBox mirrors the world matrices and bounding boxes.
+ */
+class NihilObjectTable :
+    public NihilSelectionListener
+{
+public:
+    NihilObjectTable() { m_selection.setListener(this); }
+    NihilObjectTable(const NihilObjectTable&) = delete;
+    NihilObjectTable& operator=(const NihilObjectTable&) = delete;
+    virtual void onSelectionChanged(const NihilSelectionSet* selection, const gs::vbitset& changed) override;
+    virtual void onElementChanged(const NihilSelectionSet* selection, int i) override;
+    int add(NihilObject* object);
+    void clear();                       // the objects are NOT deleted here
+    int size() const { return (int)m_objects.size(); }
+    const NihilObjectList& getObjects() const { return m_objects; }
+    NihilObject* getObject(int slot) const { return m_objects.at(slot); }
+    NihilObject::ObjectType getType(int slot) const { return m_types.at(slot); }
+    NihilGeometry* getGeometry(int slot) const { return m_geometries.at(slot); }
+    NihilPolygon* getRenderMesh(int slot) const;    // the triangles drawn for the object, the grid mesh of the patches
+    const gs::matrix& getWorldMat(int slot) const { return m_worldMats.at(slot); }
+    const NihilBoundingBox& getBoundingBox(int slot) const { return m_boundingBoxes.at(slot); }
+    NihilSelectionSet& getSelection() { return m_selection; }
+    const NihilSelectionSet& getSelection() const { return m_selection; }
+    bool isSelected(int slot) const { return m_selection.isSelected(slot); }
+    void setSelected(int slot, bool b) { m_selection.select(slot, b); }
+    void collectSelected(NihilObjectList& objects) const;
+    void updateTransform(int slot, const gs::matrix& worldMat, const NihilBoundingBox& box);
+
+protected:
+    NihilObjectList         m_objects;
+    std::vector<NihilObject::ObjectType> m_types;
+    NihilSelectionSet       m_selection;
+    std::vector<gs::matrix> m_worldMats;
+    std::vector<NihilBoundingBox> m_boundingBoxes;  // in world space
+    std::vector<NihilGeometry*> m_geometries;       // by getRenderGeometry
+};
+
+struct NihilPickResult
+{
+    NihilObject*            object = nullptr;       // null if nothing is hit
+    int                     triangle = -1;          // in the render mesh of the object
+    gs::vec3                barycentric;
+    gs::vec3                position;               // in world space
+    float                   distance = FLT_MAX;     // along the ray from the near plane to the far plane
+};
+
 class NihilUIRectangle
 {
 public:
@@ -260,7 +543,7 @@ public:
 protected:
     NihilRenderer*          m_renderer = nullptr;
     NihilUIObject*          m_rcObject = nullptr;
-    gs::rectf               m_rc;
+    gs::pink::rectf               m_rc;
 
 protected:
     void calcVertexBuffer(NihilUIVertex vertices[4]);
@@ -268,33 +551,60 @@ protected:
 
 typedef std::vector<NihilUIVertex> NihilUIVertices;
 
-struct NihilPointInfo
+/*
+ * The projected points of the points layer in structure of arrays, indexed by the point selection.
+ * The screen coordinates live apart from their owners, so that the hit tests only walk the floats.
+ */
+class NihilPointTable
 {
-    NihilObject*            object = nullptr;
-    int                     index = -1;
-    gs::vec3                point;
-    bool                    isSelected = false;
-
-    NihilPointInfo(NihilObject* p, int i, const gs::vec3& pt) :
-        object(p), index(i), point(pt)
-    {}
+public:
+    void clear();
+    int size() const { return (int)m_objects.size(); }
+    void add(NihilObject* object, int index, const gs::vec3& point);
+    NihilObject* getObject(int i) const { return m_objects.at(i); }
+    int getIndex(int i) const { return m_indices.at(i); }
+    gs::vec3 getPoint(int i) const { return gs::vec3(m_xs.at(i), m_ys.at(i), m_zs.at(i)); }
+    void setPoint(int i, const gs::vec3& point);
+    const float* getXs() const { return m_xs.data(); }
+    const float* getYs() const { return m_ys.data(); }
+
+protected:
+    std::vector<NihilObject*> m_objects;
+    std::vector<int>        m_indices;              // of the point in its object
+    std::vector<float>      m_xs;
+    std::vector<float>      m_ys;
+    std::vector<float>      m_zs;
+};
+
+class NihilUILasso
+{
+public:
+    NihilUILasso(NihilRenderer* renderer);
+    ~NihilUILasso();
+    void setupBuffers(const NihilLasso& lasso);
+    void updateBuffer(const NihilLasso& lasso);
+
+protected:
+    NihilRenderer*          m_renderer = nullptr;
+    NihilUIObject*          m_lassoObject = nullptr;
+
+protected:
+    void calcVertexBuffer(const NihilLasso& lasso, NihilUIVertices& vertices);
 };
-typedef std::list<NihilPointInfo> NihilPointInfoList;
-typedef std::vector<NihilPointInfo*> NihilPointInfoRefs;
 
 class NihilUIPoints
 {
 public:
     NihilUIPoints(NihilRenderer* renderer);
     ~NihilUIPoints();
-    void updateBuffer(NihilPointInfoList& infos);
+    void updateBuffer(const NihilPointTable& points, const NihilSelectionSet& selection);
 
 protected:
     NihilRenderer*          m_renderer = nullptr;
     NihilUIObject*          m_rcObject = nullptr;
 
 private:
-    void initBuffers(NihilPointInfoList& infos);
+    void initBuffers(const NihilPointTable& points, const NihilSelectionSet& selection);
 };
 
 // controllers
@@ -312,55 +622,45 @@ private:
     gs::vec2                m_lastpt;
 };
 
-typedef gs::rtree_entity<UINT> NihilHittestEntity;
-typedef gs::rtree_node<NihilHittestEntity> NihilHittestNode;
-typedef gs::_tree_allocator<NihilHittestNode> NihilHittestAlloc;
-typedef gs::tree<NihilHittestEntity, NihilHittestNode, NihilHittestAlloc> NihilHittestTree;
-typedef gs::rtree<NihilHittestEntity, gs::quadratic_split_alg<5, 2, NihilHittestTree>, NihilHittestNode, NihilHittestAlloc> NihilHittestRtree;
-
 class NihilControl_ObjectLayer :
     public NihilControl
 {
-protected:
-    struct HittestNode
-    {
-        gs::vec2            triangle[3];
-        int                 index[3];
-        NihilGeometry*      geometry;
-    };
-    typedef std::list<HittestNode> HittestNodeCache;
-
 public:
     NihilControl_ObjectLayer(NihilCore* core);
     virtual ~NihilControl_ObjectLayer();
     virtual bool onMsg(NihilCore* core, UINT message, WPARAM wParam, LPARAM lParam) override;
 
 private:
-    NihilObjectList&        m_objectList;
-    NihilHittestRtree       m_rtree;
-    HittestNodeCache        m_cache;
+    NihilCore*              m_core = nullptr;
+    NihilObjectTable&       m_objectTable;
     NihilUIRectangle*       m_selectArea = nullptr;
+    NihilUILasso*           m_lassoArea = nullptr;  // instead of the rect, if the selecting started with ctrl
+    NihilLasso              m_lasso;
     NihilRenderer*          m_renderer = nullptr;
     bool                    m_pressed = false;
+    bool                    m_selectThrough = false;    // with shift, select the hidden objects in the area too
     gs::vec2                m_startpt;
     gs::vec2                m_lastpt;
     NihilObjectList         m_selectedObjects;
+    NihilObjectList         m_candidates;           // scratch of the hit tests, kept to reuse the storage
+    std::vector<int>        m_triangles;
+    std::vector<int>        m_corners;
+    NihilScreenPoints       m_projected;
+    NihilIdBuffer           m_idBuffer;             // the objects seen by the box or the lasso
 
 private:
-    void setupHittestTable(HWND hwnd, NihilSceneConfig& sceneConfig);
-    void setupHittestTableOf(NihilObject* object, const gs::matrix& mat, UINT width, UINT height);
-    void setupHittestTableOfPolygon(NihilPolygon* polygon, const gs::matrix& mat, UINT width, UINT height);
-    void resetSelectState();
-    void startSelecting();
+    bool hitTestPolygon(const NihilPolygon* polygon, const gs::matrix& worldMat, const gs::matrix& viewProj, const gs::matrix& rectMat, const gs::pink::rectf& rc, const NihilLasso* lasso, UINT width, UINT height);
+    void startSelecting(bool lasso);
     void endSelecting(const gs::vec2& pt);
     void updateSelecting(const gs::vec2& pt);
-    void hitTest(const gs::rectf& rc);
+    void hitTest(const gs::pink::rectf& rc, const NihilLasso* lasso = nullptr);   // rc is the bounding rect of the lasso if any
     void startTranslation();
     void updateTranslation(NihilSceneConfig& sceneConfig, const gs::vec2& pt);
 };
 
 class NihilControl_PointsLayer :
-    public NihilControl
+    public NihilControl,
+    public NihilSelectionListener
 {
 protected:
     struct VertexInfo
@@ -372,36 +672,53 @@ public:
     NihilControl_PointsLayer(NihilCore* core);
     virtual ~NihilControl_PointsLayer();
     virtual bool onMsg(NihilCore* core, UINT message, WPARAM wParam, LPARAM lParam) override;
+    virtual void onFrame(NihilCore* core) override;
+    virtual void onObjectsEdited(NihilCore* core) override;
+    virtual void onSelectionChanged(const NihilSelectionSet* selection, const gs::vbitset& changed) override;
+    virtual void onElementChanged(const NihilSelectionSet* selection, int i) override;
 
 private:
+    NihilCore*              m_core = nullptr;
     NihilObjectList         m_selectedObjects;
     NihilUIRectangle*       m_selectArea = nullptr;
+    NihilUILasso*           m_lassoArea = nullptr;  // instead of the rect, if the selecting started with ctrl
+    NihilLasso              m_lasso;
     NihilRenderer*          m_renderer = nullptr;
+    NihilThreadPool*        m_threadPool = nullptr;
     bool                    m_pressed = false;
-    NihilPointInfoList      m_pointInfos;
+    NihilPointTable         m_pointTable;
+    NihilSelectionSet       m_pointSelection;
+    NihilPointGrid          m_pointGrid;
+    bool                    m_pointGridDirty = false;
+    NihilIdBuffer           m_idBuffer;             // the depth of the scene, to hide the occluded points
+    UINT                    m_viewWidth = 0;
+    UINT                    m_viewHeight = 0;
     NihilUIPoints*          m_uiPoints = nullptr;
+    bool                    m_uiPointsDirty = false;    // updated once before the next frame
     gs::vec2                m_startpt;
     gs::vec2                m_lastpt;
-    NihilPointInfoRefs      m_selectedPoints;
+    std::vector<int>        m_movedIndices;         // scratch of the journal, the moved points of an object
 
 private:
-    void setupSelectedObjects(const NihilObjectList& polygons);
-    void setupHittestInfo(HWND hwnd, NihilSceneConfig& sceneConfig);
+    void setupSelectedObjects(const NihilObjectTable& objectTable);
+    void setupHittestInfo(NihilCore* core);
+    void setupIdBuffer(NihilCore* core, const gs::matrix& mat, UINT width, UINT height);
     void setupHittestInfoOf(NihilObject* object, const gs::matrix& mat, UINT width, UINT height);
     void setupHittestInfoOfPolygon(NihilPolygon* polygon, const gs::matrix& mat, UINT width, UINT height);
     void setupHittestInfoOfBiCubicBezier(NihilBiCubicBezierPatch* bezierPatch, const gs::matrix& mat, UINT width, UINT height);
     void setupHittestInfoOfBiCubicNurbs(NihilBiCubicNURBSurface* nurbs, const gs::matrix& mat, UINT width, UINT height);
     void updateUIVertices();
-    void resetSelectState();
-    void startSelecting();
+    void updatePointGrid();
+    void startSelecting(bool lasso);
     void endSelecting(const gs::vec2& pt);
     void updateSelecting(const gs::vec2& pt);
-    void hitTest(const gs::rectf& rc);
-    void startTranslation();
-    void updateTranslation(NihilSceneConfig& sceneConfig, HWND hwnd, const gs::vec2& pt);
+    void hitTest(const gs::pink::rectf& rc, const NihilLasso* lasso = nullptr);   // rc is the bounding rect of the lasso if any
+    void updateTranslation(NihilSceneConfig& sceneConfig, const gs::vec2& pt);
+    void recordMovedPoints(NihilObject* object, const gs::vec3& offset);
 };
 
-class NihilCore
+class NihilCore :
+    public NihilJournalTarget
 {
     friend class NihilControl_ObjectLayer;
     friend class NihilControl_PointsLayer;
@@ -412,6 +729,7 @@ public:
 
 public:
     void setup(HWND hwnd);
+    bool setupHeadless(NihilRenderer* renderer, int workers = -1);  // without any window, the core takes over and deletes the renderer
     void resizeWindow();
     void destroy();
     void render();
@@ -425,11 +743,32 @@ public:
     void scaleModifier();
     void rotateModifier();
     NihilRenderer* getRenderer() const { return m_renderer; }
+    NihilThreadPool& getThreadPool() { return m_threadPool; }     // the renderer may share it, as a frame never runs during the loops
     NihilControl* getController() const { return m_controller; }
     NihilSceneConfig& getSceneConfig() { return m_sceneConfig; }
-    HWND getHwnd() const { return m_hwnd; }
+    HWND getHwnd() const { return m_hwnd; }       // 0 if headless
+    void getViewSize(UINT& width, UINT& height) const;
     WNDPROC getOldWndProc() const { return m_oldWndProc; }
     bool loadFromTextStream(const NihilString& src);
+    void clearScene();                              // remove all the objects and stop the autosave, so that another scene can be loaded
+    bool getSceneBoundingBox(NihilBoundingBox& box);    // in world space, false if the scene is empty
+    bool pickObject(const gs::vec2& pt, UINT width, UINT height, NihilPickResult& result);    // the nearest object under the point of the view
+    bool parentObject(int child, int parent, bool keepWorld = true);  // by the slots of the object table, -1 to unparent, false if it makes a cycle
+    void invalidate() { m_frameDirty = true; }      // draw a frame by the next render, which does nothing otherwise
+    bool isFrameDirty() const { return m_frameDirty; }
+    void setFramePacing(bool b) { m_framePacing = b; }  // at most a frame per refresh of the display, poll at the interval or faster
+    double getFrameInterval() const { return m_frameInterval; }    // in milliseconds
+    const NihilCommandList& getCommandList() const { return m_commandList; }
+    void queueUpdate(NihilObject* object);          // update the buffers of the edited object once before the next frame, instead of each edit
+    NihilSceneSnapshotPtr takeSnapshot() const;     // cheap, it shares the lists of the objects
+    void setupAutosave(const NihilString& path, double interval);  // save a snapshot every interval milliseconds, an empty path to stop it
+    bool saveInBackground(const NihilString& path); // false if the autosave is still writing the last one
+    NihilAutosave& getAutosave() { return m_autosave; }
+    bool undo();                                    // false if nothing to undo
+    bool redo();
+    NihilEditJournal& getJournal() { return m_journal; }
+    virtual void translatePoints(int slot, const int indices[], int count, const gs::vec3& offset) override;
+    virtual void translateObject(int slot, const gs::vec3& offset) override;
 
 private:
     static LRESULT CALLBACK wndProc(HWND, UINT, WPARAM, LPARAM);
@@ -439,14 +778,37 @@ protected:
     WNDPROC                 m_oldWndProc = nullptr; // old windowproc
     NihilRenderer*          m_renderer = nullptr;
     NihilSceneConfig        m_sceneConfig;
-    NihilObjectList         m_objectList;
+    NihilObjectTable        m_objectTable;
+    NihilSceneBvh           m_sceneBvh;
+    NihilThreadPool         m_threadPool;
     NihilControl*           m_controller = nullptr;
+    std::vector<NihilRayCandidate> m_rayCandidates; // scratch of the picks
+    NihilCommandList        m_commandList;          // the draws of the last frame
+    NihilObjectList         m_updateQueue;
+    bool                    m_frameDirty = true;
+    bool                    m_framePacing = true;
+    double                  m_frameInterval = 0.0;
+    double                  m_lastFrameTime = 0.0;
+    NihilAutosave           m_autosave;
+    NihilString             m_autosavePath;
+    double                  m_autosaveInterval = 0.0;
+    double                  m_lastAutosaveTime = 0.0;
+    NihilEditJournal        m_journal;
 
 protected:
     void destroyObjects();
+    void setupScene(int workers);
+    void drawFrame();
+    void buildCommandList(const gs::matrix& viewProj);
+    void setupFrameInterval();
+    void flushUpdates();
+    void updateAutosave();
+    void updateTransforms();
+    void updateVisibility(const gs::matrix& viewProj);
+    bool loadObjectsFromTextStream(const NihilString& src);
     bool setupWindow(HWND hwnd);
     bool setupRenderer();
-    int loadPolygonFromTextStream(const NihilString& src, int start);   // -1: failed
+    int loadPolygonFromTextStream(const NihilString& src, int start, NihilMeshCache& meshCache);   // -1: failed
     int loadBiCubicBezierPatchFromTextStream(const NihilString& src, int start);
     int loadNurbsFromTextStream(const NihilString& src, int start);
 };
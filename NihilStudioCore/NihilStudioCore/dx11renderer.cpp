@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <algorithm>
 #include "dx11renderer.h"
 
 #ifdef _NIHIL_USE_DX11
@@ -6,6 +7,7 @@
 // compiled shader
 #include "geometry_vs.h"
 #include "geometry_ps.h"
+#include "geometry_instanced_vs.h"
 #include "ui_vs.h"
 #include "ui_ps.h"
 
@@ -28,14 +30,49 @@ static UINT PackCbSize(UINT cbsize)
     return x * 16;
 }
 
+static D3D11_PRIMITIVE_TOPOLOGY nihilGetPrimitiveTopology(int topology)
+{
+    switch (topology)
+    {
+    case NihilUIObject::Topo_Points:
+        return D3D11_PRIMITIVE_TOPOLOGY_POINTLIST;
+    case NihilUIObject::Topo_LineList:
+        return D3D11_PRIMITIVE_TOPOLOGY_LINELIST;
+    case NihilUIObject::Topo_TriangleList:
+        return D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+    default:
+        ASSERT(!"Unexpected topology.");
+        return D3D11_PRIMITIVE_TOPOLOGY_UNDEFINED;
+    }
+}
+
+NihilDx11Mesh::~NihilDx11Mesh()
+{
+    SAFE_RELEASE(vb);
+    SAFE_RELEASE(ib);
+    for (auto*& p : lodIbs)
+        SAFE_RELEASE(p);
+    lodIbs.clear();
+    lodIndicesCount.clear();
+}
+
+void NihilDx11Mesh::setupIndexVertexBuffers(ID3D11DeviceContext* context, int level) const
+{
+    ASSERT(context);
+    ASSERT(level >= 0 && level <= (int)lodIbs.size());
+    UINT stride = sizeof(NihilVertex);
+    UINT offset = 0;
+    context->IASetVertexBuffers(0, 1, &vb, &stride, &offset);
+    context->IASetIndexBuffer(level ? lodIbs.at(level - 1) : ib, DXGI_FORMAT_R32_UINT, 0);
+}
+
 NihilDx11Geometry::~NihilDx11Geometry()
 {
-    SAFE_RELEASE(m_vb);
-    SAFE_RELEASE(m_ib);
+    m_mesh.reset();
     m_renderer = nullptr;
 }
 
-bool NihilDx11Geometry::createVertexStream(NihilVertex vertices[], int size)
+bool NihilDx11Geometry::createVertexStream(const NihilVertex vertices[], int size)
 {
     D3D11_BUFFER_DESC desc;
     ZeroMemory(&desc, sizeof(desc));
@@ -50,17 +87,17 @@ bool NihilDx11Geometry::createVertexStream(NihilVertex vertices[], int size)
 
     ASSERT(m_renderer);
     ID3D11Device* device = m_renderer->getDevice();
-    ASSERT(device && !m_vb);
-    HRESULT hr = device->CreateBuffer(&desc, &data, &m_vb);
+    ASSERT(device && !m_mesh->vb);
+    HRESULT hr = device->CreateBuffer(&desc, &data, &m_mesh->vb);
     if (FAILED(hr))
         return false;
 
-    m_verticeCount = size;
-    ASSERT(m_vb);
+    m_mesh->verticeCount = size;
+    ASSERT(m_mesh->vb);
     return true;
 }
 
-bool NihilDx11Geometry::createIndexStream(int indices[], int size)
+bool NihilDx11Geometry::createIndexStream(const int indices[], int size)
 {
     D3D11_BUFFER_DESC desc;
     ZeroMemory(&desc, sizeof(desc));
@@ -75,28 +112,57 @@ bool NihilDx11Geometry::createIndexStream(int indices[], int size)
 
     ASSERT(m_renderer);
     ID3D11Device* device = m_renderer->getDevice();
-    ASSERT(device && !m_ib);
-    HRESULT hr = device->CreateBuffer(&desc, &data, &m_ib);
+    ASSERT(device && !m_mesh->ib);
+    HRESULT hr = device->CreateBuffer(&desc, &data, &m_mesh->ib);
     if (FAILED(hr))
         return false;
 
-    m_indicesCount = size;
-    ASSERT(m_ib);
+    m_mesh->indicesCount = size;
+    ASSERT(m_mesh->ib);
     return true;
 }
 
-bool NihilDx11Geometry::updateVertexStream(NihilVertex vertices[], int size)
+bool NihilDx11Geometry::createLodIndexStream(int level, const int indices[], int size)
+{
+    ASSERT(level == (int)m_mesh->lodIbs.size() + 1 && "Lod levels should be created in order.");
+    D3D11_BUFFER_DESC desc;
+    ZeroMemory(&desc, sizeof(desc));
+    desc.Usage = D3D11_USAGE_IMMUTABLE;
+    desc.ByteWidth = sizeof(int) * size;
+    desc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+    desc.CPUAccessFlags = 0;
+
+    D3D11_SUBRESOURCE_DATA data;
+    ZeroMemory(&data, sizeof(data));
+    data.pSysMem = indices;
+
+    ASSERT(m_renderer);
+    ID3D11Device* device = m_renderer->getDevice();
+    ASSERT(device);
+    ID3D11Buffer* ib = nullptr;
+    HRESULT hr = device->CreateBuffer(&desc, &data, &ib);
+    if (FAILED(hr))
+        return false;
+
+    ASSERT(ib);
+    m_mesh->lodIbs.push_back(ib);
+    m_mesh->lodIndicesCount.push_back(size);
+    return true;
+}
+
+bool NihilDx11Geometry::updateVertexStream(const NihilVertex vertices[], int size)
 {
     ASSERT(vertices);
-    ASSERT(m_verticeCount == size);
+    ASSERT(m_mesh->verticeCount == size);
+    ASSERT(!isInstanced() && "Unshare the streams before modifying them.");
     ASSERT(m_renderer);
     ID3D11DeviceContext* immContext = m_renderer->getImmediateContext();
     ASSERT(immContext);
     D3D11_MAPPED_SUBRESOURCE mappedRes;
     ZeroMemory(&mappedRes, sizeof(mappedRes));
-    immContext->Map(m_vb, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedRes);
+    immContext->Map(m_mesh->vb, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedRes);
     memcpy_s(mappedRes.pData, sizeof(NihilVertex) * size, vertices, sizeof(NihilVertex) * size);
-    immContext->Unmap(m_vb, 0);
+    immContext->Unmap(m_mesh->vb, 0);
     return true;
 }
 
@@ -105,24 +171,36 @@ void NihilDx11Geometry::setLocalMat(const gs::matrix& m)
     m_localMat = m;
 }
 
-void NihilDx11Geometry::setupIndexVertexBuffers(NihilDx11Renderer* renderer)
+void NihilDx11Geometry::shareStreamsOf(NihilGeometry* source)
+{
+    ASSERT(source && source != this);
+    auto* p = static_cast<NihilDx11Geometry*>(source);
+    ASSERT(p->m_renderer == m_renderer);
+    m_mesh = p->m_mesh;
+    m_lodCenter = p->m_lodCenter;
+    m_lodErrors = p->m_lodErrors;
+}
+
+void NihilDx11Geometry::unshareStreams()
+{
+    m_mesh = std::make_shared<NihilDx11Mesh>();
+    // the levels belong to the shared streams as well, setupLodStreams sets them again
+    m_lodCenter = gs::vec3(0.f, 0.f, 0.f);
+    m_lodErrors.clear();
+}
+
+void NihilDx11Geometry::setupIndexVertexBuffers(NihilDx11Renderer* renderer, int level)
 {
     ASSERT(m_renderer == renderer);
-    ID3D11DeviceContext* immContext = renderer->getImmediateContext();
-    ASSERT(immContext);
-    UINT stride = sizeof(NihilVertex);
-    UINT offset = 0;
-    immContext->IASetVertexBuffers(0, 1, &m_vb, &stride, &offset);
-    immContext->IASetIndexBuffer(m_ib, DXGI_FORMAT_R32_UINT, 0);
-    immContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    m_mesh->setupIndexVertexBuffers(renderer->getImmediateContext(), level);
 }
 
-void NihilDx11Geometry::render(NihilDx11Renderer* renderer)
+void NihilDx11Geometry::render(NihilDx11Renderer* renderer, int level)
 {
     ASSERT(m_renderer == renderer);
     ID3D11DeviceContext* immContext = renderer->getImmediateContext();
     ASSERT(immContext);
-    immContext->DrawIndexed(m_indicesCount, 0, 0);
+    immContext->DrawIndexed(m_mesh->getIndicesCount(level), 0, 0);
 }
 
 NihilDx11UIObject::~NihilDx11UIObject()
@@ -201,21 +279,7 @@ void NihilDx11UIObject::setupIndexVertexBuffers(NihilDx11Renderer* renderer)
     ASSERT(renderer);
     ID3D11DeviceContext* context = renderer->getImmediateContext();
     ASSERT(context);
-    switch (m_topology)
-    {
-    case Topo_Points:
-        context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_POINTLIST);
-        break;
-    case Topo_LineList:
-        context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_LINELIST);
-        break;
-    case Topo_TriangleList:
-        context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-        break;
-    default:
-        ASSERT(!"Unexpected topology.");
-        break;
-    }
+    // the renderer sets the topology for the run of the same topology
     if (m_vb)
     {
         UINT stride = sizeof(NihilUIVertex);
@@ -242,7 +306,6 @@ void NihilDx11UIObject::render(NihilDx11Renderer* renderer)
 
 NihilDx11Renderer::NihilDx11Renderer()
 {
-    m_worldMat.identity();
 }
 
 NihilDx11Renderer::~NihilDx11Renderer()
@@ -430,14 +493,32 @@ bool NihilDx11Renderer::setup(HWND hwnd)
 
     setupViewpoints(width, height);
     setupScreenMatrix(width, height);
-    return setupShaderOfGeometry() && setupShaderOfUI();
+    return setupShaderOfGeometry() && setupShaderOfInstancedGeometry() && setupShaderOfUI();
 }
 
-void NihilDx11Renderer::render()
+void NihilDx11Renderer::render(const NihilCommandList& commands)
 {
     beginRender();
-    renderGeometryBatch();
-    renderUIBatch();
+    // the packets of a pass are contiguous in the sorted list, each batch draws the run starts from the given one
+    for (int i = 0; i < commands.size(); )
+    {
+        switch (commands.getPacket(i).getPass())
+        {
+        case NihilDrawPacket::Pass_Geometry:
+            i = renderGeometryBatch(commands, i);
+            break;
+        case NihilDrawPacket::Pass_InstancedGeometry:
+            i = renderInstancedBatch(commands, i);
+            break;
+        case NihilDrawPacket::Pass_UI:
+            i = renderUIBatch(commands, i);
+            break;
+        default:
+            ASSERT(!"Unexpected pass.");
+            i ++;
+            break;
+        }
+    }
     endRender();
 }
 
@@ -476,9 +557,10 @@ void NihilDx11Renderer::notifyResize()
     setupScreenMatrix(width, height);
 }
 
-void NihilDx11Renderer::setWorldMat(const gs::matrix& m)
+void NihilDx11Renderer::getViewSize(float& width, float& height) const
 {
-    m_worldMat = m;
+    width = m_viewWidth;
+    height = m_viewHeight;
 }
 
 NihilGeometry* NihilDx11Renderer::addGeometry()
@@ -493,7 +575,7 @@ NihilUIObject* NihilDx11Renderer::addUIObject()
 {
     auto* p = new NihilDx11UIObject(this);
     ASSERT(p);
-    m_uiSet.insert(p);
+    m_uiObjects.push_back(p);
     return p;
 }
 
@@ -507,7 +589,9 @@ void NihilDx11Renderer::removeGeometry(NihilGeometry* ptr)
 void NihilDx11Renderer::removeUIObject(NihilUIObject* ptr)
 {
     ASSERT(ptr);
-    m_uiSet.erase(ptr);
+    auto f = std::find(m_uiObjects.begin(), m_uiObjects.end(), ptr);
+    ASSERT(f != m_uiObjects.end());
+    m_uiObjects.erase(f);
     delete ptr;
 }
 
@@ -558,6 +642,10 @@ void NihilDx11Renderer::destroy()
     SAFE_RELEASE(m_geometryCB);
     SAFE_RELEASE(m_geometryPS);
     SAFE_RELEASE(m_geometryVS);
+    SAFE_RELEASE(m_instanceBuffer);
+    SAFE_RELEASE(m_instancedInputLayout);
+    SAFE_RELEASE(m_instancedVS);
+    m_instanceCapacity = 0;
     SAFE_RELEASE(m_rtv);
     SAFE_RELEASE(m_dsv);
     SAFE_RELEASE(m_swapChain);
@@ -583,6 +671,8 @@ void NihilDx11Renderer::setupViewpoints(UINT width, UINT height)
     vp.TopLeftY = 0;
     ASSERT(m_immediateContext);
     m_immediateContext->RSSetViewports(1, &vp);
+    m_viewWidth = vp.Width;
+    m_viewHeight = vp.Height;
 }
 
 void NihilDx11Renderer::setupScreenMatrix(UINT width, UINT height)
@@ -618,6 +708,50 @@ bool NihilDx11Renderer::setupShaderOfGeometry()
     return SUCCEEDED(hr);
 }
 
+bool NihilDx11Renderer::setupShaderOfInstancedGeometry()
+{
+    ASSERT(m_device);
+    HRESULT hr = m_device->CreateVertexShader(g_InstancedVS, sizeof(g_InstancedVS), nullptr, &m_instancedVS);
+    if (FAILED(hr))
+        return false;
+    D3D11_INPUT_ELEMENT_DESC layout[] =
+    {
+        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+        { "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+        { "MVP", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+        { "MVP", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 16, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+        { "MVP", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 32, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+        { "MVP", 3, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 48, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+        { "DIFFUSE", 0, DXGI_FORMAT_R32G32B32_FLOAT, 1, 64, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+    };
+    UINT numElements = ARRAYSIZE(layout);
+    hr = m_device->CreateInputLayout(layout, numElements, g_InstancedVS, sizeof(g_InstancedVS), &m_instancedInputLayout);
+    return SUCCEEDED(hr);
+}
+
+bool NihilDx11Renderer::reserveInstanceBuffer(int count)
+{
+    if (count <= m_instanceCapacity)
+        return true;
+    SAFE_RELEASE(m_instanceBuffer);
+    m_instanceCapacity = 0;
+    int capacity = 64;
+    while (capacity < count)
+        capacity <<= 1;
+    D3D11_BUFFER_DESC desc;
+    ZeroMemory(&desc, sizeof(desc));
+    desc.Usage = D3D11_USAGE_DYNAMIC;
+    desc.ByteWidth = sizeof(GeometryInstance) * capacity;
+    desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+    desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+    ASSERT(m_device);
+    HRESULT hr = m_device->CreateBuffer(&desc, nullptr, &m_instanceBuffer);
+    if (FAILED(hr))
+        return false;
+    m_instanceCapacity = capacity;
+    return true;
+}
+
 bool NihilDx11Renderer::setupShaderOfUI()
 {
     ASSERT(m_device);
@@ -650,10 +784,10 @@ void NihilDx11Renderer::clearRenderSets()
 {
     for (auto* p : m_geometrySet)
         delete p;
-    for (auto * p : m_uiSet)
+    for (auto * p : m_uiObjects)
         delete p;
     m_geometrySet.clear();
-    m_uiSet.clear();
+    m_uiObjects.clear();
 }
 
 void NihilDx11Renderer::beginRender()
@@ -672,54 +806,128 @@ void NihilDx11Renderer::endRender()
     m_swapChain->Present(0, 0);
 }
 
-void NihilDx11Renderer::renderGeometryBatch()
+void NihilDx11Renderer::setupState(const NihilDrawPacket& packet)
 {
     ASSERT(m_immediateContext);
-    m_immediateContext->IASetInputLayout(m_geometryInputLayout);
-    m_immediateContext->VSSetShader(m_geometryVS, nullptr, 0);
-    m_immediateContext->PSSetShader(m_geometryPS, nullptr, 0);
-    for (auto* p : m_geometrySet)
+    switch (packet.getPass())
+    {
+    case NihilDrawPacket::Pass_Geometry:
+        m_immediateContext->IASetInputLayout(m_geometryInputLayout);
+        m_immediateContext->VSSetShader(m_geometryVS, nullptr, 0);
+        m_immediateContext->PSSetShader(m_geometryPS, nullptr, 0);
+        break;
+    case NihilDrawPacket::Pass_InstancedGeometry:
+        m_immediateContext->IASetInputLayout(m_instancedInputLayout);
+        m_immediateContext->VSSetShader(m_instancedVS, nullptr, 0);
+        m_immediateContext->PSSetShader(m_geometryPS, nullptr, 0);
+        break;
+    case NihilDrawPacket::Pass_UI:
+        m_immediateContext->IASetInputLayout(m_uiInputLayout);
+        m_immediateContext->VSSetShader(m_uiVS, nullptr, 0);
+        m_immediateContext->PSSetShader(m_uiPS, nullptr, 0);
+        setupUIConstantBuffer();
+        break;
+    default:
+        ASSERT(!"Unexpected pass.");
+        break;
+    }
+    m_immediateContext->IASetPrimitiveTopology(nihilGetPrimitiveTopology(packet.getTopology()));
+}
+
+int NihilDx11Renderer::renderGeometryBatch(const NihilCommandList& commands, int first)
+{
+    int i = first;
+    for (; i < commands.size(); i ++)
     {
-        ASSERT(p);
-        auto* pGeometry = static_cast<NihilDx11Geometry*>(p);
-        pGeometry->setupIndexVertexBuffers(this);
-        // setup constant buffer
-        setupConstantBufferForGeometry(pGeometry);
-        pGeometry->render(this);
+        const NihilDrawPacket& packet = commands.getPacket(i);
+        if (packet.getPass() != NihilDrawPacket::Pass_Geometry)
+            break;
+        ASSERT(packet.geometry);
+        auto* pGeometry = static_cast<NihilDx11Geometry*>(packet.geometry);
+        // only switch the states and the streams where they change
+        if (i == first || !packet.isSameState(commands.getPacket(i - 1)))
+            setupState(packet);
+        if (i == first || !packet.isSameStreams(commands.getPacket(i - 1)))
+            pGeometry->setupIndexVertexBuffers(this, packet.getLevel());
+        setupConstantBufferForGeometry(packet);
+        pGeometry->render(this, packet.getLevel());
     }
+    return i;
 }
 
-void NihilDx11Renderer::renderUIBatch()
+int NihilDx11Renderer::renderInstancedBatch(const NihilCommandList& commands, int first)
 {
+    int last = first;
+    while (last < commands.size() && commands.getPacket(last).getPass() == NihilDrawPacket::Pass_InstancedGeometry)
+        last ++;
+    int count = last - first;
+    ASSERT(count > 0);
+    if (!reserveInstanceBuffer(count))
+    {
+        ASSERT(!"Create instance buffer failed.");
+        return last;
+    }
     ASSERT(m_immediateContext);
-    m_immediateContext->IASetInputLayout(m_uiInputLayout);
-    m_immediateContext->VSSetShader(m_uiVS, nullptr, 0);
-    m_immediateContext->PSSetShader(m_uiPS, nullptr, 0);
-    setupUIConstantBuffer();
-    for (auto * p : m_uiSet)
+    D3D11_MAPPED_SUBRESOURCE mappedRes;
+    ZeroMemory(&mappedRes, sizeof(mappedRes));
+    m_immediateContext->Map(m_instanceBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedRes);
+    auto* data = (GeometryInstance*)mappedRes.pData;
+    for (int i = 0; i < count; i ++)
+    {
+        const NihilDrawPacket& packet = commands.getPacket(first + i);
+        ASSERT(packet.geometry);
+        data[i].mvp = packet.mvp;
+        data[i].diffuseColor = nihilGetDiffuseColor(packet.material);
+    }
+    m_immediateContext->Unmap(m_instanceBuffer, 0);
+    setupState(commands.getPacket(first));
+    UINT stride = sizeof(GeometryInstance);
+    UINT offset = 0;
+    m_immediateContext->IASetVertexBuffers(1, 1, &m_instanceBuffer, &stride, &offset);
+    // the instances of the same streams are contiguous by the keys
+    for (int i = first, j; i < last; i = j)
     {
-        ASSERT(p);
-        auto* pUI = static_cast<NihilDx11UIObject*>(p);
+        const NihilDrawPacket& packet = commands.getPacket(i);
+        for (j = i + 1; j < last; j ++)
+        {
+            if (!commands.getPacket(j).isSameStreams(packet))
+                break;
+        }
+        auto* mesh = static_cast<NihilDx11Geometry*>(packet.geometry)->getMesh();
+        mesh->setupIndexVertexBuffers(m_immediateContext, packet.getLevel());
+        m_immediateContext->DrawIndexedInstanced(mesh->getIndicesCount(packet.getLevel()), j - i, 0, 0, i - first);
+    }
+    return last;
+}
+
+int NihilDx11Renderer::renderUIBatch(const NihilCommandList& commands, int first)
+{
+    int i = first;
+    for (; i < commands.size(); i ++)
+    {
+        const NihilDrawPacket& packet = commands.getPacket(i);
+        if (packet.getPass() != NihilDrawPacket::Pass_UI)
+            break;
+        ASSERT(packet.uiObject);
+        if (i == first || !packet.isSameState(commands.getPacket(i - 1)))
+            setupState(packet);
+        auto* pUI = static_cast<NihilDx11UIObject*>(packet.uiObject);
         pUI->setupIndexVertexBuffers(this);
         pUI->render(this);
     }
+    return i;
 }
 
-void NihilDx11Renderer::setupConstantBufferForGeometry(NihilDx11Geometry* geometry)
+void NihilDx11Renderer::setupConstantBufferForGeometry(const NihilDrawPacket& packet)
 {
-    ASSERT(geometry);
-    gs::matrix m;
-    m.multiply(geometry->getLocalMat(), m_worldMat);
+    gs::matrix m = packet.mvp;
     m.transpose();
     D3D11_MAPPED_SUBRESOURCE mappedRes;
     ZeroMemory(&mappedRes, sizeof(mappedRes));
     m_immediateContext->Map(m_geometryCB, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedRes);
     auto* data = (GeometryCB*)mappedRes.pData;
     data->mvp = m;
-    if (geometry->isSelected())
-        data->diffuseColor = gs::vec3(0.6f, 0.6f, 0.5f);
-    else
-        data->diffuseColor = gs::vec3(0.6f, 0.f, 0.f);
+    data->diffuseColor = nihilGetDiffuseColor(packet.material);
     m_immediateContext->Unmap(m_geometryCB, 0);
     m_immediateContext->VSSetConstantBuffers(0, 1, &m_geometryCB);
 }
@@ -8,30 +8,49 @@
 #include <dxgi1_2.h>
 #include <unordered_set>
 
+// the streams of a geometry, shared by its instances
+struct NihilDx11Mesh
+{
+    ID3D11Buffer*               vb = nullptr;
+    ID3D11Buffer*               ib = nullptr;
+    int                         verticeCount = 0;
+    int                         indicesCount = 0;
+    std::vector<ID3D11Buffer*>  lodIbs;             // level 1 to n
+    std::vector<int>            lodIndicesCount;
+
+    ~NihilDx11Mesh();
+    void setupIndexVertexBuffers(ID3D11DeviceContext* context, int level) const;
+    int getIndicesCount(int level) const { return level ? lodIndicesCount.at(level - 1) : indicesCount; }
+};
+typedef std::shared_ptr<NihilDx11Mesh> NihilDx11MeshPtr;
+
 class NihilDx11Geometry :
     public NihilGeometry
 {
     friend class NihilDx11Renderer;
 
 public:
-    NihilDx11Geometry(NihilDx11Renderer* renderer): m_renderer(renderer) {}
+    NihilDx11Geometry(NihilDx11Renderer* renderer): m_renderer(renderer), m_mesh(std::make_shared<NihilDx11Mesh>()) {}
     virtual ~NihilDx11Geometry();
-    virtual bool createVertexStream(NihilVertex vertices[], int size) override;
-    virtual bool createIndexStream(int indices[], int size) override;
-    virtual bool updateVertexStream(NihilVertex vertices[], int size) override;
+    virtual bool createVertexStream(const NihilVertex vertices[], int size) override;
+    virtual bool createIndexStream(const int indices[], int size) override;
+    virtual bool createLodIndexStream(int level, const int indices[], int size) override;
+    virtual bool updateVertexStream(const NihilVertex vertices[], int size) override;
     virtual void setLocalMat(const gs::matrix& m) override;
+    virtual void shareStreamsOf(NihilGeometry* source) override;
+    virtual void unshareStreams() override;
+    virtual const gs::matrix& getLocalMat() const override { return m_localMat; }
+    virtual bool isInstanced() const override { return m_mesh.use_count() > 1; }
+    virtual const void* getStreams() const override { return m_mesh.get(); }
 
 public:
-    const gs::matrix& getLocalMat() const { return m_localMat; }
-    void setupIndexVertexBuffers(NihilDx11Renderer* renderer);
-    void render(NihilDx11Renderer* renderer);
+    NihilDx11Mesh* getMesh() const { return m_mesh.get(); }
+    void setupIndexVertexBuffers(NihilDx11Renderer* renderer, int level = 0);
+    void render(NihilDx11Renderer* renderer, int level = 0);
 
 private:
     NihilDx11Renderer*          m_renderer = nullptr;
-    ID3D11Buffer*               m_vb = nullptr;
-    ID3D11Buffer*               m_ib = nullptr;
-    int                         m_verticeCount = 0;
-    int                         m_indicesCount = 0;
+    NihilDx11MeshPtr            m_mesh;
     gs::matrix                  m_localMat;
 };
 
@@ -60,7 +79,6 @@ private:
 };
 
 typedef std::unordered_set<NihilGeometry*> NihilGeometrySet;
-typedef std::unordered_set<NihilUIObject*> NihilUIObjectSet;
 
 class NihilDx11Renderer :
     public NihilRenderer
@@ -77,15 +95,22 @@ public:
         gs::matrix              mat;
     };
 
+    // per instance stream of the instanced geometry shader
+    struct GeometryInstance
+    {
+        gs::matrix              mvp;                // not transposed, the rows are read as vertex elements
+        gs::vec3                diffuseColor;
+    };
+
 public:
     NihilDx11Renderer();
     virtual ~NihilDx11Renderer();
 
 public:
     virtual bool setup(HWND hwnd) override;
-    virtual void render() override;
+    virtual void render(const NihilCommandList& commands) override;
     virtual void notifyResize() override;
-    virtual void setWorldMat(const gs::matrix& m) override;
+    virtual void getViewSize(float& width, float& height) const override;
     virtual NihilGeometry* addGeometry() override;
     virtual NihilUIObject* addUIObject() override;
     virtual void removeGeometry(NihilGeometry* ptr) override;
@@ -110,14 +135,18 @@ protected:
     ID3D11PixelShader*          m_geometryPS = nullptr;
     ID3D11InputLayout*          m_geometryInputLayout = nullptr;
     ID3D11Buffer*               m_geometryCB = nullptr;
+    ID3D11VertexShader*         m_instancedVS = nullptr;
+    ID3D11InputLayout*          m_instancedInputLayout = nullptr;
+    ID3D11Buffer*               m_instanceBuffer = nullptr;
+    int                         m_instanceCapacity = 0;
     ID3D11VertexShader*         m_uiVS = nullptr;
     ID3D11PixelShader*          m_uiPS = nullptr;
     ID3D11InputLayout*          m_uiInputLayout = nullptr;
     ID3D11Buffer*               m_uiCB = nullptr;
     NihilGeometrySet            m_geometrySet;
-    NihilUIObjectSet            m_uiSet;
-    gs::matrix                  m_worldMat;
     gs::matrix                  m_screenMat;
+    float                       m_viewWidth = 0.f;
+    float                       m_viewHeight = 0.f;
 
 private:
     void destroy();
@@ -125,13 +154,17 @@ private:
     void setupViewpoints(UINT width, UINT height);
     void setupScreenMatrix(UINT width, UINT height);
     bool setupShaderOfGeometry();
+    bool setupShaderOfInstancedGeometry();
+    bool reserveInstanceBuffer(int count);
     bool setupShaderOfUI();
     void beginRender();
     void endRender();
-    void renderGeometryBatch();
-    void renderUIBatch();
+    void setupState(const NihilDrawPacket& packet);
+    int renderGeometryBatch(const NihilCommandList& commands, int first);
+    int renderInstancedBatch(const NihilCommandList& commands, int first);
+    int renderUIBatch(const NihilCommandList& commands, int first);
     void setupUIConstantBuffer();
-    void setupConstantBufferForGeometry(NihilDx11Geometry* geometry);
+    void setupConstantBufferForGeometry(const NihilDrawPacket& packet);
 };
 
 #endif
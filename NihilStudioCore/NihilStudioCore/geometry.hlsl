@@ -10,6 +10,17 @@ struct VS_Input
     float3 normal : NORMAL;
 };
 
+struct VS_InstancedInput
+{
+    float3 pos : POSITION;
+    float3 normal : NORMAL;
+    float4 mvp0 : MVP0;
+    float4 mvp1 : MVP1;
+    float4 mvp2 : MVP2;
+    float4 mvp3 : MVP3;
+    float3 diffuseColor : DIFFUSE;
+};
+
 struct PS_Input
 {
     float4 pos : SV_POSITION;
@@ -22,25 +33,39 @@ static const float3 ambientColor = float3(0.1f, 0.f, 0.f);
 static const float3 specColor = float3(1.f, 1.f, 1.f);
 static const float shininess = 22.f;
 
-PS_Input VS(VS_Input input)
+float3 Shade(float3 pos, float3 normal, float3 diffuse)
 {
-    float3 normal = normalize(input.normal);
-    float3 lightDir = normalize(lightPos - input.pos);
+    normal = normalize(normal);
+    float3 lightDir = normalize(lightPos - pos);
     float lambertian = max(dot(lightDir, normal), 0.f);
     float specular = 0.f;
     if(lambertian > 0.f)
     {
-        float3 viewDir = normalize(-input.pos);
+        float3 viewDir = normalize(-pos);
         float3 halfDir = normalize(lightDir + viewDir);
         float specAngle = max(dot(halfDir, normal), 0.f);
         specular = pow(specAngle, shininess);
     }
 
-    float3 colorLinear = ambientColor + lambertian * diffuseColor + specular * specColor;
+    return ambientColor + lambertian * diffuse + specular * specColor;
+}
 
+PS_Input VS(VS_Input input)
+{
     PS_Input output = (PS_Input)0;
     output.pos = mul(float4(input.pos, 1.f), mvp);
-    output.cr = float4(colorLinear, 1.f);
+    output.cr = float4(Shade(input.pos, input.normal, diffuseColor), 1.f);
+
+    return output;
+}
+
+PS_Input InstancedVS(VS_InstancedInput input)
+{
+    float4x4 instanceMvp = float4x4(input.mvp0, input.mvp1, input.mvp2, input.mvp3);
+
+    PS_Input output = (PS_Input)0;
+    output.pos = mul(float4(input.pos, 1.f), instanceMvp);
+    output.cr = float4(Shade(input.pos, input.normal, input.diffuseColor), 1.f);
 
     return output;
 }
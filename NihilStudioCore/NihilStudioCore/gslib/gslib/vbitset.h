@@ -27,6 +27,7 @@
 #define vbitset_deeaeda9_1fc9_43e4_9026_c5eeb93c6ebb_h
 
 #include <intrin.h>
+#include <emmintrin.h>
 #include <gslib/config.h>
 #include <gslib/std.h>
 
@@ -90,52 +91,116 @@ public:
     void set(int pos) { reset(pos, true); }
     void reset(int pos, bool b = false)
     {
+        assert(pos >= 0);
         int cc = cycle_count(pos);
         int cidx = cycle_index(pos);
         ensure_container_capacity(pos, cc, cidx);
         uint& n = _container.at(cc);
-        uint mask = (1 << cidx);
+        uint mask = (1u << cidx);
         b ? (n |= mask) : (n &= ~mask);
     }
     void reset(bool b)
     {
-        int cc = cycle_count(_size);
-        int cidx = cycle_index(_size);
-        int m = b ? -1 : 0;
-        memset(&_container.front(), m, cc * sizeof(uint));
-        uint mask = (1 << (cidx + 1)) - 1;
-        uint& n = _container.at(cc);
-        b ? (n |= mask) : (n &= ~mask);
+        if(!_size)
+            return;
+        memset(&_container.front(), b ? -1 : 0, knot_count() * sizeof(uint));
+        clear_tail();
     }
-    bool test(int pos)
+    bool test(int pos) const
     {
-        if(pos >= _size)
+        if(pos < 0 || pos >= _size)
             return false;
         int cc = cycle_count(pos);
         int cidx = cycle_index(pos);
         uint n = knot_at(cc);
-        uint mask = (1 << cidx);
+        uint mask = (1u << cidx);
         return (n & mask) != 0;
     }
     void resize(int s)
     {
-        if(s == 0) {
+        if(s <= 0) {
             _container.clear();
             _size = 0;
             return;
         }
         if(s == _size)
             return;
-        else if(s < _size) {
-            ensure_container_capacity(s - 1);
-            return;
+        _container.resize(cycle_count(s - 1) + 1, 0);
+        _size = s;
+        clear_tail();
+    }
+    bool any() const
+    {
+        for(uint n : _container) {
+            if(n)
+                return true;
         }
-        else {
-            int cc = cycle_count(s - 1);
-            _container.resize(cc + 1);
-            _size = s;
+        return false;
+    }
+    int count() const
+    {
+        int c = 0;
+        for(uint n : _container)
+            c += bit_count(n);
+        return c;
+    }
+    // the first set bit at or after pos, -1 if none.
+    int find_next(int pos) const
+    {
+        if(pos < 0)
+            pos = 0;
+        if(pos >= _size)
+            return -1;
+        int cc = cycle_count(pos);
+        int kc = knot_count();
+        uint n = _container.at(cc) & ~((1u << cycle_index(pos)) - 1);
+        for(;;) {
+            if(n)
+                return cc * knot_size + bitscan_forward(n);
+            if(++ cc >= kc)
+                return -1;
+            n = _container.at(cc);
         }
     }
+    bool operator==(const vbitset& that) const { return _size == that._size && _container == that._container; }
+    bool operator!=(const vbitset& that) const { return !(*this == that); }
+    // set operations, done by 128 bits per step, the shorter set was taken as padded with zeros.
+    vbitset& unite(const vbitset& that)
+    {
+        if(that._size > _size)
+            resize(that._size);
+        combine(that, that.knot_count(), [](__m128i a, __m128i b) { return _mm_or_si128(a, b); }, [](uint a, uint b) { return a | b; });
+        return *this;
+    }
+    vbitset& subtract(const vbitset& that)
+    {
+        int kc = knot_count() < that.knot_count() ? knot_count() : that.knot_count();
+        combine(that, kc, [](__m128i a, __m128i b) { return _mm_andnot_si128(b, a); }, [](uint a, uint b) { return a & ~b; });
+        return *this;
+    }
+    vbitset& intersect(const vbitset& that)
+    {
+        int kc = knot_count() < that.knot_count() ? knot_count() : that.knot_count();
+        combine(that, kc, [](__m128i a, __m128i b) { return _mm_and_si128(a, b); }, [](uint a, uint b) { return a & b; });
+        if(kc < knot_count())
+            memset(&_container.at(kc), 0, (knot_count() - kc) * sizeof(uint));
+        return *this;
+    }
+    vbitset& differ(const vbitset& that)
+    {
+        if(that._size > _size)
+            resize(that._size);
+        combine(that, that.knot_count(), [](__m128i a, __m128i b) { return _mm_xor_si128(a, b); }, [](uint a, uint b) { return a ^ b; });
+        return *this;
+    }
+    vbitset& invert()
+    {
+        if(!_size)
+            return *this;
+        combine(*this, knot_count(), [](__m128i a, __m128i) { return _mm_xor_si128(a, _mm_set1_epi32(-1)); }, [](uint a, uint) { return ~a; });
+        clear_tail();
+        return *this;
+    }
     void rotate_left(int bias)
     {
         if(!bias)
@@ -205,19 +270,34 @@ protected:
         assert(cc * knot_size + cidx == pos);
         if(pos < _size)
             return;
-        int kc = knot_count();
-        assert(kc <= cc);
-        if(kc == cc) {
-            _container.push_back(0);
-            _size = pos + 1;
-        }
-        else {
-            cc ++;
-            _container.resize(cc);
-            int delta = cc - kc;
-            memset(&_container.at(kc), 0, delta * sizeof(uint));
-            _size = pos + 1;
+        // the last knot may have room for pos already
+        if(cc >= knot_count())
+            _container.resize(cc + 1, 0);
+        _size = pos + 1;
+    }
+    // keep the bits beyond the size zero, so that the knots could be compared and counted directly
+    void clear_tail()
+    {
+        int cidx = cycle_index(_size);
+        if(cidx)
+            _container.back() &= (1u << cidx) - 1;
+    }
+    template<class _simdop, class _op>
+    void combine(const vbitset& that, int kc, _simdop simdop, _op op)
+    {
+        assert(kc <= knot_count() && kc <= that.knot_count());
+        if(kc <= 0)
+            return;
+        uint* dest = &_container.front();
+        const uint* src = &that._container.front();
+        int i = 0;
+        for(; i + 4 <= kc; i += 4) {
+            __m128i a = _mm_loadu_si128((const __m128i*)(dest + i));
+            __m128i b = _mm_loadu_si128((const __m128i*)(src + i));
+            _mm_storeu_si128((__m128i*)(dest + i), simdop(a, b));
         }
+        for(; i < kc; i ++)
+            dest[i] = op(dest[i], src[i]);
     }
 };
 
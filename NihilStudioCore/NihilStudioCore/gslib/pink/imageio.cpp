@@ -728,4 +728,75 @@ bool imageio::read_bmp_image(image& img, const void* ptr, int size)
     return true;
 }
 
+static inline void write_dib_le(byte*& p, uint d, int bytes)
+{
+    for(int i = 0; i < bytes; i ++, d >>= 8)
+        *p ++ = (byte)(d & 0xff);
+}
+
+bool imageio::save_bmp_image(const image& img, const string& path)
+{
+    /* saved as an uncompressed 24 bits BMP, bottom-up, the alpha channel was dropped */
+    if(!img.is_valid())
+        return false;
+    int cbytes = 0;
+    switch(img.get_format())
+    {
+    case image::fmt_rgb:
+        cbytes = 3;
+        break;
+    case image::fmt_rgba:
+        cbytes = 4;
+        break;
+    default:
+        assert(!"unsupported format.");
+        return false;
+    }
+    int width = img.get_width(), height = img.get_height();
+    int bpl = (width * 3 + 3) & ~3;
+    int data_size = bpl * height;
+    byte header[BMP_FILEHDR_SIZE + BMP_WIN];
+    byte* p = header;
+    *p ++ = 'B';
+    *p ++ = 'M';
+    write_dib_le(p, sizeof(header) + data_size, 4);
+    write_dib_le(p, 0, 4);                      /* reserved */
+    write_dib_le(p, sizeof(header), 4);         /* off bits */
+    write_dib_le(p, BMP_WIN, 4);
+    write_dib_le(p, width, 4);
+    write_dib_le(p, height, 4);
+    write_dib_le(p, 1, 2);                      /* planes */
+    write_dib_le(p, 24, 2);
+    write_dib_le(p, BMP_RGB, 4);
+    write_dib_le(p, data_size, 4);
+    write_dib_le(p, img._xpels_per_meter, 4);
+    write_dib_le(p, img._ypels_per_meter, 4);
+    write_dib_le(p, 0, 4);                      /* colors used */
+    write_dib_le(p, 0, 4);                      /* colors important */
+    assert(p == header + sizeof(header));
+    file f(path.c_str(), _t("wb"));
+    if(!f.is_valid())
+        return false;
+    if(f.put(header, sizeof(header)) != sizeof(header))
+        return false;
+    byte* line = new byte[bpl];
+    memset(line, 0, bpl);
+    bool ret = true;
+    for(int y = height - 1; y >= 0; y --) {
+        const byte* src = img.get_data(0, y);
+        byte* des = line;
+        for(int x = 0; x < width; x ++, src += cbytes, des += 3) {
+            des[0] = src[2];
+            des[1] = src[1];
+            des[2] = src[0];
+        }
+        if(f.put(line, bpl) != bpl) {
+            ret = false;
+            break;
+        }
+    }
+    delete [] line;
+    return ret;
+}
+
 __pink_end__
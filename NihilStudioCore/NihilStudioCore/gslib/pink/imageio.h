@@ -47,7 +47,7 @@ class imageio
 public:
     static bool read_image(image& img, const string& path);
     static bool read_bmp_image(image& img, const void* ptr, int size);
-    static bool save_bmp_image(image& img, const string& path);
+    static bool save_bmp_image(const image& img, const string& path);
     static bool read_png_image(image& img, const void* ptr, int size);
 };
 
@@ -0,0 +1,326 @@
+#include <assert.h>
+#include <math.h>
+#include <algorithm>
+#include "idbuffer.h"
+#include "lasso.h"
+#include "threadpool.h"
+
+#define ASSERT assert
+#undef min
+#undef max
+
+#define NIHIL_ID_TILE_SIZE          32
+#define NIHIL_ID_DEPTH_TOLERANCE    0.01f   // relative, the surfaces nearer than that are not occluders
+#define NIHIL_ID_NEIGHBOR_RADIUS    1       // pixels around a point tested for visibility
+
+void NihilIdBuffer::setup(int width, int height, int shrink)
+{
+    ASSERT(width > 0 && height > 0 && shrink > 0);
+    m_shrink = shrink;
+    m_width = std::max(width / shrink, 1);
+    m_height = std::max(height / shrink, 1);
+    m_tileColumns = (m_width + NIHIL_ID_TILE_SIZE - 1) / NIHIL_ID_TILE_SIZE;
+    m_tileRows = (m_height + NIHIL_ID_TILE_SIZE - 1) / NIHIL_ID_TILE_SIZE;
+    clear();
+}
+
+void NihilIdBuffer::clear()
+{
+    m_depths.assign(m_width * m_height, 0.f);
+    m_objects.assign(m_width * m_height, -1);
+    m_triangles.assign(m_width * m_height, -1);
+    m_setups.clear();
+    m_binStarts.clear();
+    m_bins.clear();
+}
+
+// in front of the near plane, the projection of the buffer keeps z, 0 on the near plane
+static inline bool nihilIsInFront(const NihilScreenPoints& projected, int i)
+{
+    return projected.ws[i] > 0.f && projected.zs[i] >= 0.f;
+}
+
+void NihilIdBuffer::addMesh(int object, const gs::vec3* positions, int stride, int pointCount, const int* indices, int triangleCount, const gs::matrix& mat, NihilThreadPool* pool)
+{
+    ASSERT(m_width > 0 && "Setup before drawing.");
+    if (pointCount <= 0 || triangleCount <= 0)
+        return;
+    // 1.ndc => the pixels of the buffer, keep z to tell the near plane
+    gs::matrix ssm;
+    ssm.multiply(mat, gs::matrix().scaling(0.5f * m_width, -0.5f * m_height, 1.f));
+    ssm.multiply(gs::matrix().translation(0.5f * m_width, 0.5f * m_height, 0.f));
+    nihilProjectPoints(m_projected, positions, stride, nullptr, pointCount, ssm, pool);
+    // 2.setup the front faces, clip the ones crossing the near plane
+    for (int t = 0; t < triangleCount; t ++)
+    {
+        const int* triangle = indices + t * 3;
+        int front = 0;
+        for (int k = 0; k < 3; k ++)
+        {
+            if (nihilIsInFront(m_projected, triangle[k]))
+                front ++;
+        }
+        if (!front)
+            continue;
+        Triangle setup;
+        setup.object = object;
+        setup.triangle = t;
+        if (front < 3)
+        {
+            clipTriangle(setup, positions, stride, triangle, ssm);
+            continue;
+        }
+        for (int k = 0; k < 3; k ++)
+        {
+            int i = triangle[k];
+            setup.xs[k] = m_projected.xs[i];
+            setup.ys[k] = m_projected.ys[i];
+            setup.depths[k] = 1.f / m_projected.ws[i];
+        }
+        addTriangle(setup);
+    }
+}
+
+void NihilIdBuffer::clipTriangle(Triangle& setup, const gs::vec3* positions, int stride, const int* triangle, const gs::matrix& ssm)
+{
+    // the crossing ones are rare, transform them again to get the homogeneous points the projection divides
+    gs::vec4 points[3];
+    for (int k = 0; k < 3; k ++)
+        ((const gs::vec3*)((const char*)positions + (size_t)triangle[k] * stride))->transform(points[k], ssm);
+    // 1.cut the triangle by z = 0 in order, at most a quad is left
+    gs::vec4 polygon[4];
+    int count = 0;
+    for (int k = 0; k < 3; k ++)
+    {
+        const gs::vec4& a = points[k];
+        const gs::vec4& b = points[(k + 1) % 3];
+        if (a.z >= 0.f)
+            polygon[count ++] = a;
+        if ((a.z >= 0.f) != (b.z >= 0.f))
+        {
+            float s = a.z / (a.z - b.z);
+            polygon[count ++] = gs::vec4(a.x + (b.x - a.x) * s, a.y + (b.y - a.y) * s, 0.f, a.w + (b.w - a.w) * s);
+        }
+    }
+    ASSERT(count <= 4);
+    // 2.a fan of the kept part, in the winding of the triangle
+    for (int i = 1; i + 1 < count; i ++)
+    {
+        const gs::vec4* fan[3] = { &polygon[0], &polygon[i], &polygon[i + 1] };
+        bool behind = false;
+        for (int k = 0; k < 3; k ++)
+        {
+            float w = fan[k]->w;
+            if (!(w > 0.f))
+            {
+                behind = true;
+                break;
+            }
+            setup.xs[k] = fan[k]->x / w;
+            setup.ys[k] = fan[k]->y / w;
+            setup.depths[k] = 1.f / w;
+        }
+        if (!behind)
+            addTriangle(setup);
+    }
+}
+
+void NihilIdBuffer::addTriangle(const Triangle& setup)
+{
+    float area = (setup.xs[1] - setup.xs[0]) * (setup.ys[2] - setup.ys[0]) - (setup.ys[1] - setup.ys[0]) * (setup.xs[2] - setup.xs[0]);
+    if (!(area > 0.f))  // flip y already make counter clockwised.
+        return;
+    float left = std::min(std::min(setup.xs[0], setup.xs[1]), setup.xs[2]);
+    float right = std::max(std::max(setup.xs[0], setup.xs[1]), setup.xs[2]);
+    float top = std::min(std::min(setup.ys[0], setup.ys[1]), setup.ys[2]);
+    float bottom = std::max(std::max(setup.ys[0], setup.ys[1]), setup.ys[2]);
+    if (right < 0.f || bottom < 0.f || left >= (float)m_width || top >= (float)m_height)
+        return;
+    m_setups.push_back(setup);
+}
+
+void NihilIdBuffer::getTileRange(const Triangle& setup, int& c0, int& c1, int& r0, int& r1) const
+{
+    float left = std::min(std::min(setup.xs[0], setup.xs[1]), setup.xs[2]);
+    float right = std::max(std::max(setup.xs[0], setup.xs[1]), setup.xs[2]);
+    float top = std::min(std::min(setup.ys[0], setup.ys[1]), setup.ys[2]);
+    float bottom = std::max(std::max(setup.ys[0], setup.ys[1]), setup.ys[2]);
+    c0 = (int)std::max(left, 0.f) / NIHIL_ID_TILE_SIZE;
+    c1 = (int)std::min(right, (float)(m_width - 1)) / NIHIL_ID_TILE_SIZE;
+    r0 = (int)std::max(top, 0.f) / NIHIL_ID_TILE_SIZE;
+    r1 = (int)std::min(bottom, (float)(m_height - 1)) / NIHIL_ID_TILE_SIZE;
+}
+
+void NihilIdBuffer::binTriangles()
+{
+    // counting sort by the tiles the boxes overlap, a triangle is in the order of submission in each bin
+    int tileCount = m_tileColumns * m_tileRows;
+    m_binStarts.assign(tileCount + 1, 0);
+    int c0, c1, r0, r1;
+    for (const Triangle& setup : m_setups)
+    {
+        getTileRange(setup, c0, c1, r0, r1);
+        for (int r = r0; r <= r1; r ++)
+        {
+            for (int c = c0; c <= c1; c ++)
+                m_binStarts.at(r * m_tileColumns + c + 1) ++;
+        }
+    }
+    for (int t = 0; t < tileCount; t ++)
+        m_binStarts.at(t + 1) += m_binStarts.at(t);
+    std::vector<int> cursors(m_binStarts.begin(), m_binStarts.end() - 1);
+    m_bins.resize(m_binStarts.back());
+    for (int i = 0; i < (int)m_setups.size(); i ++)
+    {
+        getTileRange(m_setups.at(i), c0, c1, r0, r1);
+        for (int r = r0; r <= r1; r ++)
+        {
+            for (int c = c0; c <= c1; c ++)
+                m_bins.at(cursors.at(r * m_tileColumns + c) ++) = i;
+        }
+    }
+}
+
+void NihilIdBuffer::rasterize(NihilThreadPool* pool)
+{
+    binTriangles();
+    int tileCount = m_tileColumns * m_tileRows;
+    if (!pool)
+    {
+        for (int t = 0; t < tileCount; t ++)
+            rasterizeTile(t);
+        return;
+    }
+    pool->parallelFor(tileCount, 1, [this](int first, int last) {
+        for (int t = first; t < last; t ++)
+            rasterizeTile(t);
+    });
+}
+
+void NihilIdBuffer::rasterizeTile(int tile)
+{
+    int tileLeft = tile % m_tileColumns * NIHIL_ID_TILE_SIZE;
+    int tileTop = tile / m_tileColumns * NIHIL_ID_TILE_SIZE;
+    int tileRight = std::min(tileLeft + NIHIL_ID_TILE_SIZE, m_width) - 1;
+    int tileBottom = std::min(tileTop + NIHIL_ID_TILE_SIZE, m_height) - 1;
+    for (int b = m_binStarts.at(tile); b < m_binStarts.at(tile + 1); b ++)
+    {
+        const Triangle& setup = m_setups.at(m_bins.at(b));
+        const float* xs = setup.xs;
+        const float* ys = setup.ys;
+        // the box of the triangle clipped by the tile, sampled at the centers of the pixels
+        int left = (int)std::max(floorf(std::min(std::min(xs[0], xs[1]), xs[2])), (float)tileLeft);
+        int right = (int)std::min(ceilf(std::max(std::max(xs[0], xs[1]), xs[2])), (float)tileRight);
+        int top = (int)std::max(floorf(std::min(std::min(ys[0], ys[1]), ys[2])), (float)tileTop);
+        int bottom = (int)std::min(ceilf(std::max(std::max(ys[0], ys[1]), ys[2])), (float)tileBottom);
+        if (left > right || top > bottom)
+            continue;
+        // edge functions, e[k] is the edge opposite to the kth vertex, stepped by the pixels
+        float area = (xs[1] - xs[0]) * (ys[2] - ys[0]) - (ys[1] - ys[0]) * (xs[2] - xs[0]);
+        float rarea = 1.f / area;
+        float dx[3], dy[3], e0[3];
+        float px = left + 0.5f, py = top + 0.5f;
+        for (int k = 0; k < 3; k ++)
+        {
+            int i = (k + 1) % 3, j = (k + 2) % 3;
+            dx[k] = -(ys[j] - ys[i]);
+            dy[k] = xs[j] - xs[i];
+            e0[k] = (xs[j] - xs[i]) * (py - ys[i]) - (ys[j] - ys[i]) * (px - xs[i]);
+        }
+        for (int y = top; y <= bottom; y ++)
+        {
+            float e[3] = { e0[0], e0[1], e0[2] };
+            int row = y * m_width;
+            for (int x = left; x <= right; x ++)
+            {
+                if (e[0] >= 0.f && e[1] >= 0.f && e[2] >= 0.f)
+                {
+                    float depth = (e[0] * setup.depths[0] + e[1] * setup.depths[1] + e[2] * setup.depths[2]) * rarea;
+                    int p = row + x;
+                    if (depth > m_depths[p])
+                    {
+                        m_depths[p] = depth;
+                        m_objects[p] = setup.object;
+                        m_triangles[p] = setup.triangle;
+                    }
+                }
+                e[0] += dx[0];
+                e[1] += dx[1];
+                e[2] += dx[2];
+            }
+            e0[0] += dy[0];
+            e0[1] += dy[1];
+            e0[2] += dy[2];
+        }
+    }
+}
+
+int NihilIdBuffer::getPixel(float x, float y) const
+{
+    x /= m_shrink;
+    y /= m_shrink;
+    if (!(x >= 0.f && y >= 0.f && x < (float)m_width && y < (float)m_height))
+        return -1;
+    return (int)y * m_width + (int)x;
+}
+
+int NihilIdBuffer::getObject(float x, float y) const
+{
+    int p = getPixel(x, y);
+    return p < 0 ? -1 : m_objects.at(p);
+}
+
+int NihilIdBuffer::getTriangle(float x, float y) const
+{
+    int p = getPixel(x, y);
+    return p < 0 ? -1 : m_triangles.at(p);
+}
+
+float NihilIdBuffer::getDepth(float x, float y) const
+{
+    int p = getPixel(x, y);
+    return p < 0 ? 0.f : m_depths.at(p);
+}
+
+bool NihilIdBuffer::isVisible(float x, float y, float depth) const
+{
+    // the point is on the surface, its own triangles sample away from it, so test a few pixels around
+    x /= m_shrink;
+    y /= m_shrink;
+    if (!(x >= 0.f && y >= 0.f && x < (float)m_width && y < (float)m_height))
+        return false;
+    int cx = (int)x, cy = (int)y;
+    float limit = depth * (1.f + NIHIL_ID_DEPTH_TOLERANCE);
+    for (int py = std::max(cy - NIHIL_ID_NEIGHBOR_RADIUS, 0); py <= std::min(cy + NIHIL_ID_NEIGHBOR_RADIUS, m_height - 1); py ++)
+    {
+        for (int px = std::max(cx - NIHIL_ID_NEIGHBOR_RADIUS, 0); px <= std::min(cx + NIHIL_ID_NEIGHBOR_RADIUS, m_width - 1); px ++)
+        {
+            if (m_depths.at(py * m_width + px) <= limit)
+                return true;
+        }
+    }
+    return false;
+}
+
+void NihilIdBuffer::collectObjects(const gs::pink::rectf& rc, const NihilLasso* lasso, gs::vbitset& objects) const
+{
+    // the pixels whose centers are in the rect
+    float shrink = (float)m_shrink;
+    int left = std::max((int)ceilf(rc.left / shrink - 0.5f), 0);
+    int right = std::min((int)floorf(rc.right / shrink - 0.5f), m_width - 1);
+    int top = std::max((int)ceilf(rc.top / shrink - 0.5f), 0);
+    int bottom = std::min((int)floorf(rc.bottom / shrink - 0.5f), m_height - 1);
+    for (int y = top; y <= bottom; y ++)
+    {
+        const int* row = &m_objects.at(y * m_width);
+        for (int x = left; x <= right; x ++)
+        {
+            int object = row[x];
+            if (object < 0 || objects.test(object))
+                continue;
+            if (lasso && !lasso->contains((x + 0.5f) * shrink, (y + 0.5f) * shrink))
+                continue;
+            objects.set(object);
+        }
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+#include <gslib/math.h>
+#include <gslib/vbitset.h>
+#include <pink/type.h>
+#include "projection.h"
+
+class NihilThreadPool;
+class NihilLasso;
+
+/*
+ * Software depth and id buffer, rendered on the CPU without any window or device, so that it also runs headless.
+ * The meshes are projected and set up as screen triangles first, then binned to the tiles of the buffer,
+ * the tiles rasterize over the thread pool and only a single thread touches each one.
+ * The depth is 1/w, linear in screen space, the larger the nearer, only the front faces are drawn.
+ * The near plane clips the triangles crossing it, so a mesh around the eye still occludes the rest.
+ */
+class NihilIdBuffer
+{
+public:
+    void setup(int width, int height, int shrink = 1);  // the viewport size, the buffer shrinks by the factor
+    void clear();
+    void addMesh(int object, const gs::vec3* positions, int stride, int pointCount, const int* indices, int triangleCount, const gs::matrix& mat, NihilThreadPool* pool);
+    void rasterize(NihilThreadPool* pool);
+    int getWidth() const { return m_width; }
+    int getHeight() const { return m_height; }
+    int getShrink() const { return m_shrink; }
+    // in the pixels of the viewport, -1 for the background
+    int getObject(float x, float y) const;
+    int getTriangle(float x, float y) const;
+    float getDepth(float x, float y) const;
+    bool isVisible(float x, float y, float depth) const;  // if a point at (x, y) with the depth 1/w is not hidden
+    // set the bits of the objects seen at the pixels in the rect, and in the lasso if given, the caller sizes the bits
+    void collectObjects(const gs::pink::rectf& rc, const NihilLasso* lasso, gs::vbitset& objects) const;
+
+protected:
+    struct Triangle
+    {
+        float               xs[3];                  // in the pixels of the buffer
+        float               ys[3];
+        float               depths[3];
+        int                 object;
+        int                 triangle;
+    };
+
+    int                     m_width = 0;
+    int                     m_height = 0;
+    int                     m_shrink = 1;
+    int                     m_tileColumns = 0;
+    int                     m_tileRows = 0;
+    std::vector<float>      m_depths;
+    std::vector<int>        m_objects;
+    std::vector<int>        m_triangles;
+    std::vector<Triangle>   m_setups;               // the triangles to rasterize
+    std::vector<int>        m_binStarts;            // the bin of tile t is [m_binStarts[t], m_binStarts[t + 1]) of m_bins
+    std::vector<int>        m_bins;
+    NihilScreenPoints       m_projected;
+
+protected:
+    int getPixel(float x, float y) const;           // -1 if out of the buffer
+    void clipTriangle(Triangle& setup, const gs::vec3* positions, int stride, const int* triangle, const gs::matrix& ssm);
+    void addTriangle(const Triangle& setup);        // culled by the facing and the bounds of the buffer
+    void getTileRange(const Triangle& setup, int& c0, int& c1, int& r0, int& r1) const;
+    void binTriangles();
+    void rasterizeTile(int tile);
+};
@@ -0,0 +1,243 @@
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+#include "journal.h"
+
+#define ASSERT assert
+
+static void nihilWriteVarint(std::vector<unsigned char>& bytes, unsigned int n)
+{
+    while (n >= 0x80)
+    {
+        bytes.push_back((unsigned char)(n | 0x80));
+        n >>= 7;
+    }
+    bytes.push_back((unsigned char)n);
+}
+
+static const unsigned char* nihilReadVarint(const unsigned char* p, unsigned int& n)
+{
+    n = 0;
+    for (int shift = 0;; shift += 7)
+    {
+        unsigned char b = *p ++;
+        n |= (unsigned int)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return p;
+    }
+}
+
+void NihilEditJournal::setBudget(size_t bytes)
+{
+    m_budget = bytes;
+    trimToBudget();
+}
+
+void NihilEditJournal::clear()
+{
+    m_undoEdits.clear();
+    m_redoEdits.clear();
+    m_memoryUsage = 0;
+    m_editing = false;
+    m_openChanges.clear();
+    m_openSlots.clear();
+}
+
+void NihilEditJournal::beginEdit()
+{
+    // seal an edit left open first, e.g. by a lost mouse capture
+    endEdit();
+    m_editing = true;
+    m_openChanges.clear();
+    m_openSlots.clear();
+}
+
+void NihilEditJournal::endEdit()
+{
+    if (!m_editing)
+        return;
+    m_editing = false;
+    // the clicks without any move leave nothing
+    Edit edit;
+    for (const OpenChange& open : m_openChanges)
+    {
+        if (open.offset.x == 0.f && open.offset.y == 0.f && open.offset.z == 0.f)
+            continue;
+        edit.push_back(Change());
+        sealChange(open, edit.back());
+    }
+    m_openChanges.clear();
+    m_openSlots.clear();
+    if (edit.empty())
+        return;
+    for (const Edit& e : m_redoEdits)
+        m_memoryUsage -= getEditSize(e);
+    m_redoEdits.clear();
+    m_memoryUsage += getEditSize(edit);
+    m_undoEdits.push_back(std::move(edit));
+    trimToBudget();
+}
+
+void NihilEditJournal::recordPoints(int slot, const int indices[], int count, const gs::vec3& offset)
+{
+    ASSERT(slot >= 0 && indices && count > 0);
+    if (!m_editing)
+    {
+        // a single change makes an edit by itself
+        beginEdit();
+        recordPoints(slot, indices, count, offset);
+        endEdit();
+        return;
+    }
+    // the same points moved again during the drag, add up the offsets
+    OpenChange* open = findOpenChange(CT_Points, slot, indices, count);
+    if (open)
+    {
+        open->offset += offset;
+        return;
+    }
+    m_openSlots.insert(std::make_pair(slot, (int)m_openChanges.size()));
+    m_openChanges.push_back(OpenChange());
+    OpenChange& change = m_openChanges.back();
+    change.type = CT_Points;
+    change.slot = slot;
+    change.offset = offset;
+    change.indices.assign(indices, indices + count);
+}
+
+void NihilEditJournal::recordObject(int slot, const gs::vec3& offset)
+{
+    ASSERT(slot >= 0);
+    if (!m_editing)
+    {
+        beginEdit();
+        recordObject(slot, offset);
+        endEdit();
+        return;
+    }
+    OpenChange* open = findOpenChange(CT_Object, slot, nullptr, 0);
+    if (open)
+    {
+        open->offset += offset;
+        return;
+    }
+    m_openSlots.insert(std::make_pair(slot, (int)m_openChanges.size()));
+    m_openChanges.push_back(OpenChange());
+    OpenChange& change = m_openChanges.back();
+    change.type = CT_Object;
+    change.slot = slot;
+    change.offset = offset;
+}
+
+bool NihilEditJournal::undo(NihilJournalTarget* target)
+{
+    ASSERT(target);
+    endEdit();
+    if (m_undoEdits.empty())
+        return false;
+    applyEdit(m_undoEdits.back(), target, true);
+    m_redoEdits.push_back(std::move(m_undoEdits.back()));
+    m_undoEdits.pop_back();
+    return true;
+}
+
+bool NihilEditJournal::redo(NihilJournalTarget* target)
+{
+    ASSERT(target);
+    endEdit();
+    if (m_redoEdits.empty())
+        return false;
+    applyEdit(m_redoEdits.back(), target, false);
+    m_undoEdits.push_back(std::move(m_redoEdits.back()));
+    m_redoEdits.pop_back();
+    return true;
+}
+
+NihilEditJournal::OpenChange* NihilEditJournal::findOpenChange(ChangeType type, int slot, const int indices[], int count)
+{
+    auto range = m_openSlots.equal_range(slot);
+    for (auto i = range.first; i != range.second; ++ i)
+    {
+        OpenChange& open = m_openChanges.at(i->second);
+        if (open.type != type || (int)open.indices.size() != count)
+            continue;
+        if (!count || !memcmp(open.indices.data(), indices, sizeof(int) * count))
+            return &open;
+    }
+    return nullptr;
+}
+
+void NihilEditJournal::sealChange(const OpenChange& open, Change& change) const
+{
+    change.type = open.type;
+    change.slot = open.slot;
+    change.offset = open.offset;
+    change.count = 0;
+    if (open.indices.empty())
+        return;
+    std::vector<int> sorted = open.indices;
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+    change.count = (int)sorted.size();
+    // the first one is the gap from 0
+    int last = 0;
+    for (int i : sorted)
+    {
+        ASSERT(i >= last);
+        nihilWriteVarint(change.indices, (unsigned int)(i - last));
+        last = i;
+    }
+    change.indices.shrink_to_fit();
+}
+
+void NihilEditJournal::applyEdit(const Edit& edit, NihilJournalTarget* target, bool revert)
+{
+    ASSERT(target);
+    // revert from the last change, in case the changes of an edit depend on each other
+    for (int k = 0; k < (int)edit.size(); k ++)
+    {
+        const Change& change = edit.at(revert ? (int)edit.size() - 1 - k : k);
+        gs::vec3 offset = change.offset;
+        if (revert)
+            offset = -offset;
+        if (change.type == CT_Object)
+        {
+            target->translateObject(change.slot, offset);
+            continue;
+        }
+        m_scratch.resize(change.count);
+        const unsigned char* p = change.indices.data();
+        int last = 0;
+        for (int i = 0; i < change.count; i ++)
+        {
+            unsigned int gap;
+            p = nihilReadVarint(p, gap);
+            last += (int)gap;
+            m_scratch[i] = last;
+        }
+        target->translatePoints(change.slot, m_scratch.data(), change.count, offset);
+    }
+}
+
+void NihilEditJournal::trimToBudget()
+{
+    // drop the redo edits first, then the oldest ones
+    while (m_memoryUsage > m_budget && !m_redoEdits.empty())
+    {
+        m_memoryUsage -= getEditSize(m_redoEdits.front());
+        m_redoEdits.pop_front();
+    }
+    while (m_memoryUsage > m_budget && m_undoEdits.size() > 1)
+    {
+        m_memoryUsage -= getEditSize(m_undoEdits.front());
+        m_undoEdits.pop_front();
+    }
+}
+
+size_t NihilEditJournal::getEditSize(const Edit& edit)
+{
+    size_t size = sizeof(Edit) + sizeof(Change) * edit.capacity();
+    for (const Change& change : edit)
+        size += change.indices.capacity();
+    return size;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <gslib/math.h>
+#include "nihilplatform.h"
+
+class __declspec(novtable) NihilJournalTarget abstract
+{
+public:
+    virtual ~NihilJournalTarget() {}
+    virtual void translatePoints(int slot, const int indices[], int count, const gs::vec3& offset) = 0;  // the points of the object in the slot
+    virtual void translateObject(int slot, const gs::vec3& offset) = 0;     // in world space
+};
+
+/*
+ * Undo and redo of the edits, kept as the translations instead of the copies of the points.
+ * A change is an offset and the points it moves, the moves of a drag add up into the changes of one edit,
+ * so a drag costs a change per object however long it is.
+ * The indices of the sealed edits are sorted and kept as the varint gaps between them, a few bytes per point.
+ * Undo and redo walk the touched points only, the oldest edits drop if the journal goes over the budget.
+ * The objects are referred by the slots of the object table, the journal clears with the scene.
+ */
+class NihilEditJournal
+{
+public:
+    enum ChangeType
+    {
+        CT_Points,
+        CT_Object,
+    };
+
+public:
+    void setBudget(size_t bytes);       // the newest edit stays even if it goes over
+    size_t getBudget() const { return m_budget; }
+    size_t getMemoryUsage() const { return m_memoryUsage; }
+    void clear();
+    void beginEdit();                   // the changes till endEdit undo at once, not nested
+    void endEdit();                     // drop the redo edits if anything changes
+    bool isEditing() const { return m_editing; }
+    void recordPoints(int slot, const int indices[], int count, const gs::vec3& offset);
+    void recordObject(int slot, const gs::vec3& offset);
+    bool canUndo() const { return !m_undoEdits.empty(); }
+    bool canRedo() const { return !m_redoEdits.empty(); }
+    int getUndoCount() const { return (int)m_undoEdits.size(); }
+    int getRedoCount() const { return (int)m_redoEdits.size(); }
+    bool undo(NihilJournalTarget* target);
+    bool redo(NihilJournalTarget* target);
+
+protected:
+    struct Change
+    {
+        ChangeType          type;
+        int                 slot;
+        int                 count;              // of the points
+        gs::vec3            offset;
+        std::vector<unsigned char> indices;     // the varint gaps of the sorted indices
+    };
+    typedef std::vector<Change> Edit;
+
+    // a change of the open edit, the indices stay as they are to compare them cheaply during the drag
+    struct OpenChange
+    {
+        ChangeType          type;
+        int                 slot;
+        gs::vec3            offset;
+        std::vector<int>    indices;
+    };
+
+    size_t                  m_budget = 16 * 1024 * 1024;
+    size_t                  m_memoryUsage = 0;  // of the sealed edits
+    std::deque<Edit>        m_undoEdits;        // the newest at the back
+    std::deque<Edit>        m_redoEdits;
+    bool                    m_editing = false;
+    std::vector<OpenChange> m_openChanges;
+    std::unordered_multimap<int, int> m_openSlots;  // slot => index of m_openChanges
+    std::vector<int>        m_scratch;
+
+protected:
+    OpenChange* findOpenChange(ChangeType type, int slot, const int indices[], int count);
+    void sealChange(const OpenChange& open, Change& change) const;
+    void applyEdit(const Edit& edit, NihilJournalTarget* target, bool revert);
+    void trimToBudget();
+    static size_t getEditSize(const Edit& edit);
+};
@@ -0,0 +1,155 @@
+#include <assert.h>
+#include <math.h>
+#include <algorithm>
+#include "lasso.h"
+
+#define ASSERT assert
+#undef min
+#undef max
+
+#define NIHIL_LASSO_MIN_STEP        2.f     // in pixels, drop the nearer points of the stroke
+#define NIHIL_LASSO_EDGES_PER_ROW   4
+
+void NihilLasso::clear()
+{
+    m_points.clear();
+    m_rc.set_rect(0.f, 0.f, 0.f, 0.f);
+    m_rows = 0;
+    m_rowStarts.clear();
+    m_rowEdges.clear();
+}
+
+bool NihilLasso::addPoint(const gs::vec2& pt)
+{
+    if (m_points.size() >= NIHIL_LASSO_MAX_POINTS)
+        return false;
+    if (!m_points.empty())
+    {
+        const gs::vec2& last = m_points.back();
+        if (fabsf(pt.x - last.x) < NIHIL_LASSO_MIN_STEP && fabsf(pt.y - last.y) < NIHIL_LASSO_MIN_STEP)
+            return false;
+    }
+    if (m_points.empty())
+        m_rc.set_ltrb(pt.x, pt.y, pt.x, pt.y);
+    else
+    {
+        m_rc.left = std::min(m_rc.left, pt.x);
+        m_rc.top = std::min(m_rc.top, pt.y);
+        m_rc.right = std::max(m_rc.right, pt.x);
+        m_rc.bottom = std::max(m_rc.bottom, pt.y);
+    }
+    m_points.push_back(pt);
+    m_rows = 0;
+    return true;
+}
+
+int NihilLasso::getRow(float y) const
+{
+    int r = (int)((y - m_rc.top) / m_rowHeight);
+    return std::min(std::max(r, 0), m_rows - 1);
+}
+
+void NihilLasso::prepare()
+{
+    ASSERT(isValid());
+    int count = size();
+    m_rows = std::max(count / NIHIL_LASSO_EDGES_PER_ROW, 1);
+    m_rowHeight = std::max(m_rc.height() / m_rows, 1e-3f);
+    // counting sort of the edges by the rows they cross
+    m_rowStarts.assign(m_rows + 1, 0);
+    for (int i = 0; i < count; i ++)
+    {
+        const gs::vec2& a = m_points.at(i);
+        const gs::vec2& b = m_points.at((i + 1) % count);
+        int r0 = getRow(std::min(a.y, b.y)), r1 = getRow(std::max(a.y, b.y));
+        for (int r = r0; r <= r1; r ++)
+            m_rowStarts.at(r + 1) ++;
+    }
+    for (int r = 0; r < m_rows; r ++)
+        m_rowStarts.at(r + 1) += m_rowStarts.at(r);
+    std::vector<int> cursors(m_rowStarts.begin(), m_rowStarts.end() - 1);
+    m_rowEdges.resize(m_rowStarts.back());
+    for (int i = 0; i < count; i ++)
+    {
+        const gs::vec2& a = m_points.at(i);
+        const gs::vec2& b = m_points.at((i + 1) % count);
+        int r0 = getRow(std::min(a.y, b.y)), r1 = getRow(std::max(a.y, b.y));
+        for (int r = r0; r <= r1; r ++)
+            m_rowEdges.at(cursors.at(r) ++) = i;
+    }
+}
+
+bool NihilLasso::contains(float x, float y) const
+{
+    ASSERT(m_rows > 0 && "Prepare before the tests.");
+    if (!(x >= m_rc.left && x <= m_rc.right && y >= m_rc.top && y <= m_rc.bottom))
+        return false;
+    // even-odd, count the edges crossing the horizontal ray to the right, the edges of the row are enough
+    int count = size();
+    int r = getRow(y);
+    bool inside = false;
+    for (int e = m_rowStarts.at(r); e < m_rowStarts.at(r + 1); e ++)
+    {
+        int i = m_rowEdges.at(e);
+        const gs::vec2& a = m_points.at(i);
+        const gs::vec2& b = m_points.at((i + 1) % count);
+        if ((a.y > y) != (b.y > y) && x < a.x + (y - a.y) * (b.x - a.x) / (b.y - a.y))
+            inside = !inside;
+    }
+    return inside;
+}
+
+static float nihilCross(const gs::vec2& o, const gs::vec2& a, const gs::vec2& b)
+{
+    return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+}
+
+static bool nihilSegmentsCross(const gs::vec2& a1, const gs::vec2& a2, const gs::vec2& b1, const gs::vec2& b2)
+{
+    float d1 = nihilCross(b1, b2, a1), d2 = nihilCross(b1, b2, a2);
+    float d3 = nihilCross(a1, a2, b1), d4 = nihilCross(a1, a2, b2);
+    return ((d1 > 0.f) != (d2 > 0.f)) && ((d3 > 0.f) != (d4 > 0.f));
+}
+
+bool NihilLasso::crossesEdges(const gs::vec2& p1, const gs::vec2& p2) const
+{
+    int count = size();
+    int r0 = getRow(std::min(p1.y, p2.y)), r1 = getRow(std::max(p1.y, p2.y));
+    float left = std::min(p1.x, p2.x), right = std::max(p1.x, p2.x);
+    for (int r = r0; r <= r1; r ++)
+    {
+        for (int e = m_rowStarts.at(r); e < m_rowStarts.at(r + 1); e ++)
+        {
+            int i = m_rowEdges.at(e);
+            const gs::vec2& a = m_points.at(i);
+            const gs::vec2& b = m_points.at((i + 1) % count);
+            if (std::max(a.x, b.x) < left || std::min(a.x, b.x) > right)
+                continue;
+            if (nihilSegmentsCross(p1, p2, a, b))
+                return true;
+        }
+    }
+    return false;
+}
+
+bool NihilLasso::overlapsTriangle(const gs::vec2& p1, const gs::vec2& p2, const gs::vec2& p3) const
+{
+    ASSERT(m_rows > 0 && "Prepare before the tests.");
+    // 1.the boxes
+    float left = std::min(std::min(p1.x, p2.x), p3.x);
+    float right = std::max(std::max(p1.x, p2.x), p3.x);
+    float top = std::min(std::min(p1.y, p2.y), p3.y);
+    float bottom = std::max(std::max(p1.y, p2.y), p3.y);
+    if (right < m_rc.left || left > m_rc.right || bottom < m_rc.top || top > m_rc.bottom)
+        return false;
+    // 2.a corner of the triangle inside the lasso
+    if (contains(p1.x, p1.y) || contains(p2.x, p2.y) || contains(p3.x, p3.y))
+        return true;
+    // 3.the lasso inside the triangle
+    const gs::vec2& q = m_points.front();
+    float d1 = nihilCross(p1, p2, q), d2 = nihilCross(p2, p3, q), d3 = nihilCross(p3, p1, q);
+    if ((d1 >= 0.f && d2 >= 0.f && d3 >= 0.f) || (d1 <= 0.f && d2 <= 0.f && d3 <= 0.f))
+        return true;
+    // 4.the edges crossed
+    return crossesEdges(p1, p2) || crossesEdges(p2, p3) || crossesEdges(p3, p1);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+#include <gslib/math.h>
+#include <pink/type.h>
+
+#define NIHIL_LASSO_MAX_POINTS      1024    // the lasso stops growing after this, so that the ui buffer is fixed
+
+/*
+ * Freehand selection area in screen space, closed from the last point back to the first one.
+ * The even-odd rule decides the inside, so a self crossing stroke selects what the clipper would leave
+ * after excluding the overlapped parts. The edges are bucketed by the rows they cross, prepare before the tests.
+ */
+class NihilLasso
+{
+public:
+    void clear();
+    bool addPoint(const gs::vec2& pt);              // false if the point is too near to the last one or the lasso is full
+    int size() const { return (int)m_points.size(); }
+    const gs::vec2& getPoint(int i) const { return m_points.at(i); }
+    bool isValid() const { return size() >= 3; }
+    const gs::pink::rectf& getBoundingRect() const { return m_rc; }
+    void prepare();
+    bool contains(float x, float y) const;
+    bool overlapsTriangle(const gs::vec2& p1, const gs::vec2& p2, const gs::vec2& p3) const;
+
+protected:
+    std::vector<gs::vec2>   m_points;
+    gs::pink::rectf         m_rc;
+    float                   m_rowHeight = 1.f;
+    int                     m_rows = 0;
+    std::vector<int>        m_rowStarts;            // the edges of row r are [m_rowStarts[r], m_rowStarts[r + 1]) of m_rowEdges
+    std::vector<int>        m_rowEdges;             // edge i goes from point i to the next one
+
+protected:
+    int getRow(float y) const;
+    bool crossesEdges(const gs::vec2& p1, const gs::vec2& p2) const;
+};
@@ -0,0 +1,355 @@
+#include <assert.h>
+#include <math.h>
+#include <queue>
+#include <algorithm>
+#include "meshlod.h"
+
+#define ASSERT assert
+
+#define NIHIL_LOD_BOUNDARY_WEIGHT       100.0       // weight of the planes standing on the boundary edges
+#define NIHIL_LOD_MIN_NORMAL_DOT        0.2         // reject the collapses that fold any face further than this
+
+struct NihilQuadric
+{
+    double                  a[10];                  // upper triangle of the symmetric 4x4 matrix
+
+    NihilQuadric() { std::fill(a, a + 10, 0.0); }
+    void addPlane(double nx, double ny, double nz, double d, double w)
+    {
+        a[0] += w * nx * nx; a[1] += w * nx * ny; a[2] += w * nx * nz; a[3] += w * nx * d;
+        a[4] += w * ny * ny; a[5] += w * ny * nz; a[6] += w * ny * d;
+        a[7] += w * nz * nz; a[8] += w * nz * d;
+        a[9] += w * d * d;
+    }
+    void add(const NihilQuadric& q)
+    {
+        for (int i = 0; i < 10; i++)
+            a[i] += q.a[i];
+    }
+    double evaluate(const gs::vec3& v) const
+    {
+        double x = v.x, y = v.y, z = v.z;
+        return a[0] * x * x + 2.0 * a[1] * x * y + 2.0 * a[2] * x * z + 2.0 * a[3] * x +
+            a[4] * y * y + 2.0 * a[5] * y * z + 2.0 * a[6] * y +
+            a[7] * z * z + 2.0 * a[8] * z + a[9];
+    }
+};
+
+static void nihilFaceNormal(double n[3], const gs::vec3& p1, const gs::vec3& p2, const gs::vec3& p3)
+{
+    double ux = p2.x - p1.x, uy = p2.y - p1.y, uz = p2.z - p1.z;
+    double vx = p3.x - p1.x, vy = p3.y - p1.y, vz = p3.z - p1.z;
+    n[0] = uy * vz - uz * vy;
+    n[1] = uz * vx - ux * vz;
+    n[2] = ux * vy - uy * vx;
+}
+
+static double nihilNormalize(double n[3])
+{
+    double len = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (len > 0.0)
+    {
+        n[0] /= len;
+        n[1] /= len;
+        n[2] /= len;
+    }
+    return len;
+}
+
+class NihilMeshSimplifier
+{
+public:
+    NihilMeshSimplifier(const NihilPointList& points, const NihilIndexList& indices);
+    void simplify(int targetFaces);
+    void exportIndices(NihilIndexList& indices) const;
+    int getFaceCount() const { return m_faceCount; }
+    float getError() const { return (float)sqrt(m_maxCost); }
+
+protected:
+    struct Collapse
+    {
+        double              cost;
+        int                 from, to;
+        int                 fromStamp, toStamp;
+
+        // reversed, so that the priority queue pops the cheapest one first
+        bool operator<(const Collapse& c) const { return cost > c.cost; }
+    };
+    typedef std::priority_queue<Collapse> CollapseQueue;
+    typedef std::vector<int> FaceRefs;
+
+    const NihilPointList&       m_points;
+    std::vector<int>            m_faces;            // 3 indices per face
+    std::vector<bool>           m_faceRemoved;
+    std::vector<FaceRefs>       m_vertexFaces;
+    std::vector<NihilQuadric>   m_quadrics;
+    std::vector<int>            m_stamps;           // bumped whenever the vertex changed, outdates the queued collapses
+    std::vector<bool>           m_vertexRemoved;
+    CollapseQueue               m_queue;
+    int                         m_faceCount = 0;
+    double                      m_maxCost = 0.0;
+
+protected:
+    void setupQuadrics();
+    void gatherNeighbours(FaceRefs& neighbours, int v) const;
+    void pushCollapse(int v1, int v2);
+    bool isCollapseValid(int from, int to) const;
+    void applyCollapse(int from, int to);
+};
+
+NihilMeshSimplifier::NihilMeshSimplifier(const NihilPointList& points, const NihilIndexList& indices):
+    m_points(points)
+{
+    ASSERT(indices.size() % 3 == 0);
+    int vertexCount = (int)points.size();
+    m_vertexFaces.resize(vertexCount);
+    m_quadrics.resize(vertexCount);
+    m_stamps.resize(vertexCount, 0);
+    m_vertexRemoved.resize(vertexCount, false);
+    m_faces.reserve(indices.size());
+    for (int m = 0; m < (int)indices.size(); m += 3)
+    {
+        int i = indices.at(m), j = indices.at(m + 1), k = indices.at(m + 2);
+        ASSERT(i >= 0 && i < vertexCount && j >= 0 && j < vertexCount && k >= 0 && k < vertexCount);
+        // degenerated faces never show up, drop them right away
+        if (i == j || j == k || k == i)
+            continue;
+        int f = (int)m_faces.size() / 3;
+        m_faces.push_back(i);
+        m_faces.push_back(j);
+        m_faces.push_back(k);
+        m_vertexFaces.at(i).push_back(f);
+        m_vertexFaces.at(j).push_back(f);
+        m_vertexFaces.at(k).push_back(f);
+    }
+    m_faceCount = (int)m_faces.size() / 3;
+    m_faceRemoved.resize(m_faceCount, false);
+    setupQuadrics();
+}
+
+void NihilMeshSimplifier::setupQuadrics()
+{
+    struct EdgeInfo
+    {
+        int                 count;
+        int                 face;
+    };
+    typedef std::unordered_map<unsigned long long, EdgeInfo> EdgeMap;
+    EdgeMap edges;
+    edges.reserve(m_faces.size());
+    for (int f = 0; f < m_faceCount; f++)
+    {
+        const int* v = &m_faces.at(f * 3);
+        const gs::vec3& p = m_points.at(v[0]).pos;
+        double n[3];
+        nihilFaceNormal(n, p, m_points.at(v[1]).pos, m_points.at(v[2]).pos);
+        if (nihilNormalize(n) > 0.0)
+        {
+            double d = -(n[0] * p.x + n[1] * p.y + n[2] * p.z);
+            for (int i = 0; i < 3; i++)
+                m_quadrics.at(v[i]).addPlane(n[0], n[1], n[2], d, 1.0);
+        }
+        for (int i = 0; i < 3; i++)
+        {
+            unsigned long long a = (unsigned)v[i], b = (unsigned)v[(i + 1) % 3];
+            auto r = edges.insert(std::make_pair(a < b ? (a << 32) | b : (b << 32) | a, EdgeInfo { 0, f }));
+            r.first->second.count ++;
+        }
+    }
+    // pin the open borders with planes perpendicular to their faces, or they shrink inwards quickly
+    for (const auto& e : edges)
+    {
+        if (e.second.count != 1)
+            continue;
+        int a = (int)(e.first >> 32), b = (int)(e.first & 0xffffffff);
+        const int* v = &m_faces.at(e.second.face * 3);
+        const gs::vec3& pa = m_points.at(a).pos;
+        const gs::vec3& pb = m_points.at(b).pos;
+        double n[3], bn[3];
+        nihilFaceNormal(n, m_points.at(v[0]).pos, m_points.at(v[1]).pos, m_points.at(v[2]).pos);
+        double ex = pb.x - pa.x, ey = pb.y - pa.y, ez = pb.z - pa.z;
+        bn[0] = ey * n[2] - ez * n[1];
+        bn[1] = ez * n[0] - ex * n[2];
+        bn[2] = ex * n[1] - ey * n[0];
+        if (nihilNormalize(bn) <= 0.0)
+            continue;
+        double d = -(bn[0] * pa.x + bn[1] * pa.y + bn[2] * pa.z);
+        m_quadrics.at(a).addPlane(bn[0], bn[1], bn[2], d, NIHIL_LOD_BOUNDARY_WEIGHT);
+        m_quadrics.at(b).addPlane(bn[0], bn[1], bn[2], d, NIHIL_LOD_BOUNDARY_WEIGHT);
+    }
+    for (const auto& e : edges)
+        pushCollapse((int)(e.first >> 32), (int)(e.first & 0xffffffff));
+}
+
+void NihilMeshSimplifier::gatherNeighbours(FaceRefs& neighbours, int v) const
+{
+    neighbours.clear();
+    for (int f : m_vertexFaces.at(v))
+    {
+        if (m_faceRemoved.at(f))
+            continue;
+        for (int i = 0; i < 3; i++)
+        {
+            int n = m_faces.at(f * 3 + i);
+            if (n != v)
+                neighbours.push_back(n);
+        }
+    }
+    std::sort(neighbours.begin(), neighbours.end());
+    neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+}
+
+void NihilMeshSimplifier::pushCollapse(int v1, int v2)
+{
+    NihilQuadric q = m_quadrics.at(v1);
+    q.add(m_quadrics.at(v2));
+    double cost12 = q.evaluate(m_points.at(v2).pos);
+    double cost21 = q.evaluate(m_points.at(v1).pos);
+    Collapse c;
+    if (cost12 <= cost21)
+    {
+        c.from = v1;
+        c.to = v2;
+        c.cost = cost12;
+    }
+    else
+    {
+        c.from = v2;
+        c.to = v1;
+        c.cost = cost21;
+    }
+    c.cost = std::max(c.cost, 0.0);
+    c.fromStamp = m_stamps.at(c.from);
+    c.toStamp = m_stamps.at(c.to);
+    m_queue.push(c);
+}
+
+bool NihilMeshSimplifier::isCollapseValid(int from, int to) const
+{
+    int sharedFaces = 0;
+    const gs::vec3& target = m_points.at(to).pos;
+    for (int f : m_vertexFaces.at(from))
+    {
+        if (m_faceRemoved.at(f))
+            continue;
+        const int* v = &m_faces.at(f * 3);
+        if (v[0] == to || v[1] == to || v[2] == to)
+        {
+            sharedFaces ++;
+            continue;
+        }
+        // the face survives the collapse, make sure it doesn't flip over or degenerate
+        const gs::vec3* p[3];
+        for (int i = 0; i < 3; i++)
+            p[i] = &m_points.at(v[i]).pos;
+        double n1[3], n2[3];
+        nihilFaceNormal(n1, *p[0], *p[1], *p[2]);
+        for (int i = 0; i < 3; i++)
+        {
+            if (v[i] == from)
+                p[i] = &target;
+        }
+        nihilFaceNormal(n2, *p[0], *p[1], *p[2]);
+        if (nihilNormalize(n1) <= 0.0 || nihilNormalize(n2) <= 0.0)
+            return false;
+        if (n1[0] * n2[0] + n1[1] * n2[1] + n1[2] * n2[2] < NIHIL_LOD_MIN_NORMAL_DOT)
+            return false;
+    }
+    if (!sharedFaces)
+        return false;
+    // link condition: the only common neighbours should be the opposite corners of the shared faces,
+    // otherwise the collapse pinches the surface into a non-manifold one.
+    FaceRefs n1, n2, common;
+    gatherNeighbours(n1, from);
+    gatherNeighbours(n2, to);
+    std::set_intersection(n1.begin(), n1.end(), n2.begin(), n2.end(), std::back_inserter(common));
+    return (int)common.size() == sharedFaces;
+}
+
+void NihilMeshSimplifier::applyCollapse(int from, int to)
+{
+    FaceRefs& toFaces = m_vertexFaces.at(to);
+    for (int f : m_vertexFaces.at(from))
+    {
+        if (m_faceRemoved.at(f))
+            continue;
+        int* v = &m_faces.at(f * 3);
+        if (v[0] == to || v[1] == to || v[2] == to)
+        {
+            m_faceRemoved.at(f) = true;
+            m_faceCount --;
+            continue;
+        }
+        for (int i = 0; i < 3; i++)
+        {
+            if (v[i] == from)
+                v[i] = to;
+        }
+        toFaces.push_back(f);
+    }
+    m_vertexFaces.at(from).clear();
+    m_vertexRemoved.at(from) = true;
+    toFaces.erase(std::remove_if(toFaces.begin(), toFaces.end(), [this](int f)-> bool { return m_faceRemoved.at(f); }), toFaces.end());
+    m_quadrics.at(to).add(m_quadrics.at(from));
+    m_stamps.at(from) ++;
+    m_stamps.at(to) ++;
+    // re-evaluate the edges around the merged vertex
+    FaceRefs neighbours;
+    gatherNeighbours(neighbours, to);
+    for (int n : neighbours)
+        pushCollapse(to, n);
+}
+
+void NihilMeshSimplifier::simplify(int targetFaces)
+{
+    while (m_faceCount > targetFaces && !m_queue.empty())
+    {
+        Collapse c = m_queue.top();
+        m_queue.pop();
+        if (m_vertexRemoved.at(c.from) || m_vertexRemoved.at(c.to) ||
+            m_stamps.at(c.from) != c.fromStamp || m_stamps.at(c.to) != c.toStamp
+            )
+            continue;
+        if (!isCollapseValid(c.from, c.to))
+            continue;
+        applyCollapse(c.from, c.to);
+        m_maxCost = std::max(m_maxCost, c.cost);
+    }
+}
+
+void NihilMeshSimplifier::exportIndices(NihilIndexList& indices) const
+{
+    indices.clear();
+    indices.reserve(m_faceCount * 3);
+    for (int f = 0; f < (int)m_faceRemoved.size(); f++)
+    {
+        if (m_faceRemoved.at(f))
+            continue;
+        indices.push_back(m_faces.at(f * 3));
+        indices.push_back(m_faces.at(f * 3 + 1));
+        indices.push_back(m_faces.at(f * 3 + 2));
+    }
+}
+
+void nihilBuildLodChain(NihilLodChain& chain, const NihilPointList& points, const NihilIndexList& indices, int maxLevels)
+{
+    chain.clear();
+    NihilMeshSimplifier simplifier(points, indices);
+    int lastFaces = simplifier.getFaceCount();
+    for (int i = 0; i < maxLevels; i++)
+    {
+        int targetFaces = lastFaces / 2;
+        if (targetFaces < NIHIL_LOD_MIN_LEVEL_FACES)
+            break;
+        simplifier.simplify(targetFaces);
+        int faces = simplifier.getFaceCount();
+        // most of the remaining collapses are rejected, another level doesn't pay for its index buffer
+        if (faces > lastFaces - lastFaces / 4)
+            break;
+        chain.push_back(NihilLodLevel());
+        NihilLodLevel& level = chain.back();
+        simplifier.exportIndices(level.indexList);
+        level.error = simplifier.getError();
+        lastFaces = faces;
+    }
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "core.h"
+
+#define NIHIL_LOD_MAX_LEVELS            4           // levels generated besides the source mesh
+#define NIHIL_LOD_MIN_SOURCE_FACES      8192        // polygons with less faces than this won't get a chain
+#define NIHIL_LOD_MIN_LEVEL_FACES       256         // stop halving once a level drops below this
+
+struct NihilLodLevel
+{
+    NihilIndexList          indexList;              // indices into the source point list
+    float                   error = 0.f;            // approximate geometric error in object space
+};
+typedef std::vector<NihilLodLevel> NihilLodChain;
+
+/*
+ * Build a chain of simplified index lists by quadric error metric edge collapsing.
+ * The collapses are restricted to half edges (a vertex merges into one of its neighbours),
+ * so every level draws with the vertex buffer of the source mesh.
+ * Each level halves the face count of the previous one, chain[0] is the first reduced level.
+ */
+extern void nihilBuildLodChain(NihilLodChain& chain, const NihilPointList& points, const NihilIndexList& indices, int maxLevels = NIHIL_LOD_MAX_LEVELS);
@@ -0,0 +1,88 @@
+#pragma once
+
+/*
+ * The Win32 parts the core uses. On Windows it is simply <windows.h>, elsewhere the core only runs headless by
+ * setupHeadless, so the types and the messages are declared here for the controls, and the window calls do nothing.
+ */
+#ifdef _WIN32
+#include <windows.h>
+#include <windowsx.h>
+#else
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <wchar.h>
+#include <string>
+
+#ifndef _MSC_VER
+#define abstract
+#define __declspec(x)
+#endif
+
+typedef unsigned int UINT;
+typedef int BOOL;
+typedef long LONG;
+typedef unsigned long DWORD;
+typedef void* HWND;
+typedef void* HDC;
+typedef uintptr_t WPARAM;
+typedef intptr_t LPARAM;
+typedef intptr_t LRESULT;
+typedef LRESULT (*WNDPROC)(HWND, UINT, WPARAM, LPARAM);
+
+struct PAINTSTRUCT
+{
+    HDC                     hdc;
+};
+
+#define CALLBACK
+#define S_OK                        0
+#define WM_PAINT                    0x000f
+#define WM_QUIT                     0x0012
+#define WM_MOUSEMOVE                0x0200
+#define WM_LBUTTONDOWN              0x0201
+#define WM_LBUTTONUP                0x0202
+#define WM_RBUTTONDOWN              0x0204
+#define WM_RBUTTONUP                0x0205
+#define WM_MOUSEWHEEL               0x020a
+#define MK_SHIFT                    0x0004
+#define MK_CONTROL                  0x0008
+#define WHEEL_DELTA                 120
+#define GWL_WNDPROC                 (-4)
+#define GWL_USERDATA                (-21)
+#define VREFRESH                    116
+#define MOVEFILE_REPLACE_EXISTING   0x1
+#define MOVEFILE_WRITE_THROUGH      0x8
+#define GET_X_LPARAM(lp)            ((int)(short)((lp) & 0xffff))
+#define GET_Y_LPARAM(lp)            ((int)(short)(((lp) >> 16) & 0xffff))
+#define GET_WHEEL_DELTA_WPARAM(wp)  ((short)(((wp) >> 16) & 0xffff))
+
+// there is never a window, the tests may still send the messages to the controls
+inline LONG GetWindowLong(HWND, int) { return 0; }
+inline LONG SetWindowLong(HWND, int, LONG) { return 0; }
+inline HWND SetCapture(HWND) { return 0; }
+inline BOOL ReleaseCapture() { return 1; }
+inline HDC GetDC(HWND) { return 0; }
+inline int ReleaseDC(HWND, HDC) { return 1; }
+inline int GetDeviceCaps(HDC, int) { return 0; }
+inline LRESULT DefWindowProc(HWND, UINT, WPARAM, LPARAM) { return 0; }
+inline HDC BeginPaint(HWND, PAINTSTRUCT*) { return 0; }
+inline BOOL EndPaint(HWND, const PAINTSTRUCT*) { return 1; }
+
+// rename replaces the target at once as well, convert the paths to the multibyte ones of the locale
+inline BOOL MoveFileEx(const wchar_t* from, const wchar_t* to, DWORD flags)
+{
+    auto narrow = [](const wchar_t* path)-> std::string {
+        size_t len = wcstombs(nullptr, path, 0);
+        if (len == (size_t)-1)
+            return std::string();
+        std::string s(len, 0);
+        wcstombs(&s.front(), path, len);
+        return s;
+    };
+    std::string src = narrow(from), dest = narrow(to);
+    if (src.empty() || dest.empty())
+        return 0;
+    return rename(src.c_str(), dest.c_str()) == 0;
+}
+#endif
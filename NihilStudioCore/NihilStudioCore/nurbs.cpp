@@ -0,0 +1,346 @@
+#include <assert.h>
+#include <math.h>
+#include <algorithm>
+#include <xmmintrin.h>
+#include "nurbs.h"
+
+#define ASSERT assert
+
+int nihilFindNurbsSpan(int numCvs, int degree, float t, const std::vector<float>& knots)
+{
+    // the end of the domain belongs to the last span that isn't empty
+    if (t >= knots.at(numCvs))
+    {
+        int span = numCvs - 1;
+        while (span > degree && knots.at(span) == knots.at(span + 1))
+            span --;
+        return span;
+    }
+    int low = degree;
+    int high = numCvs;
+    int mid = (low + high) / 2;
+    while (t < knots.at(mid) || t >= knots.at(mid + 1))
+    {
+        if (t < knots.at(mid))
+            high = mid;
+        else
+            low = mid;
+        mid = (low + high) / 2;
+    }
+    return mid;
+}
+
+void nihilNurbsBasisFunc(int i, float u, int degree, const std::vector<float>& knots, float N[])
+{
+    ASSERT(N && degree >= 0);
+    N[0] = 1.f;
+    std::vector<float> left(degree + 1), right(degree + 1);
+    for (int j = 1; j <= degree; j ++)
+    {
+        left[j] = u - knots.at(i + 1 - j);
+        right[j] = knots.at(i + j) - u;
+        float saved = 0.f;
+        for (int r = 0; r < j; r ++)
+        {
+            float temp = N[r] / (right[r + 1] + left[j - r]);
+            N[r] = saved + right[r + 1] * temp;
+            saved = left[j - r] * temp;
+        }
+        N[j] = saved;
+    }
+}
+
+void nihilNurbsBasisDerivs(int i, float u, int degree, const std::vector<float>& knots, float N[], float D[])
+{
+    ASSERT(N && D && degree >= 1);
+    nihilNurbsBasisFunc(i, u, degree, knots, N);
+    // by the basis functions a degree lower of the same span, N'(k, p) = p * (N(k, p-1) / (t(k+p) - t(k)) - N(k+1, p-1) / (t(k+p+1) - t(k+1)))
+    std::vector<float> lower(degree);
+    nihilNurbsBasisFunc(i, u, degree - 1, knots, lower.data());
+    for (int r = 0; r <= degree; r ++)
+    {
+        int k = i - degree + r;
+        float d = 0.f;
+        if (r > 0)
+        {
+            float span = knots.at(k + degree) - knots.at(k);
+            if (span > 0.f)
+                d += lower[r - 1] / span;
+        }
+        if (r < degree)
+        {
+            float span = knots.at(k + degree + 1) - knots.at(k + 1);
+            if (span > 0.f)
+                d -= lower[r] / span;
+        }
+        D[r] = degree * d;
+    }
+}
+
+// the degree is a constant for the unrolled kernels, 0 for the loop of any degree
+template<int _Degree>
+static inline __m128 nihilBlendHomogeneous(const float* src, int stride, const float* N, int degree)
+{
+    const int d = _Degree ? _Degree : degree;
+    __m128 r = _mm_mul_ps(_mm_set1_ps(N[0]), _mm_loadu_ps(src));
+    for (int l = 1; l <= d; l ++)
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(N[l]), _mm_loadu_ps(src + l * stride)));
+    return r;
+}
+
+static inline __m128 nihilCross(__m128 a, __m128 b)
+{
+    __m128 ayzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 azxy = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 0, 2));
+    __m128 byzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 bzxy = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 1, 0, 2));
+    return _mm_sub_ps(_mm_mul_ps(ayzx, bzxy), _mm_mul_ps(azxy, byzx));
+}
+
+static inline void nihilStoreVec3(gs::vec3* p, __m128 r)
+{
+    float f[4];
+    _mm_storeu_ps(f, r);
+    p->x = f[0];
+    p->y = f[1];
+    p->z = f[2];
+}
+
+// blend the cvs of each column along v, the columns are vcvs * 4 floats apart, skip the derivatives if null
+template<int _Degree>
+static void nihilBlendColumns(float* row, float* rowDerivs, const float* homogeneous, int ucvs, int vcvs, int first, const float* N, const float* D, int degree)
+{
+    const float* src = homogeneous + first * 4;
+    for (int a = 0; a < ucvs; a ++, src += vcvs * 4)
+    {
+        _mm_storeu_ps(row + a * 4, nihilBlendHomogeneous<_Degree>(src, 4, N, degree));
+        if (rowDerivs)
+            _mm_storeu_ps(rowDerivs + a * 4, nihilBlendHomogeneous<_Degree>(src, 4, D, degree));
+    }
+}
+
+// leave the vanished normals 0
+template<int _Degree>
+static void nihilBlendSamples(gs::vec3* points, gs::vec3* normals, int stride, const float* row, const float* rowDerivs, int samples, const int* firsts, const float* basis, const float* derivs, int degree, bool rational, float degenerate)
+{
+    const int d = _Degree ? _Degree : degree;
+    char* dst = (char*)points;
+    char* ndst = (char*)normals;
+    for (int j = 0; j < samples; j ++, dst += stride, ndst += stride, basis += d + 1, derivs += d + 1)
+    {
+        const float* src = row + firsts[j] * 4;
+        __m128 r = nihilBlendHomogeneous<_Degree>(src, 4, basis, degree);
+        __m128 w = _mm_shuffle_ps(r, r, _MM_SHUFFLE(3, 3, 3, 3));
+        if (rational)
+            r = _mm_div_ps(r, w);
+        nihilStoreVec3((gs::vec3*)dst, r);
+        if (!normals)
+            continue;
+        __m128 ru = nihilBlendHomogeneous<_Degree>(src, 4, derivs, degree);
+        __m128 rv = nihilBlendHomogeneous<_Degree>(rowDerivs + firsts[j] * 4, 4, basis, degree);
+        // S' = (H' - w' * S) / w, leave out the division as w is positive
+        if (rational)
+        {
+            ru = _mm_sub_ps(ru, _mm_mul_ps(_mm_shuffle_ps(ru, ru, _MM_SHUFFLE(3, 3, 3, 3)), r));
+            rv = _mm_sub_ps(rv, _mm_mul_ps(_mm_shuffle_ps(rv, rv, _MM_SHUFFLE(3, 3, 3, 3)), r));
+        }
+        float n[4];
+        _mm_storeu_ps(n, nihilCross(ru, rv));
+        float len2 = n[0] * n[0] + n[1] * n[1] + n[2] * n[2];
+        if (rational)
+        {
+            float w2 = _mm_cvtss_f32(w);
+            w2 *= w2;
+            len2 /= w2 * w2;
+        }
+        gs::vec3& q = *(gs::vec3*)ndst;
+        if (len2 <= degenerate)
+        {
+            q = gs::vec3(0.f, 0.f, 0.f);
+            continue;
+        }
+        float s = 1.f / sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        q.x = n[0] * s;
+        q.y = n[1] * s;
+        q.z = n[2] * s;
+    }
+}
+
+bool NihilNurbsEvaluator::setup(int udegree, int vdegree, const std::vector<float>& uknots, const std::vector<float>& vknots, int usteps, int vsteps)
+{
+    return setupDirection(m_u, udegree, uknots, usteps) && setupDirection(m_v, vdegree, vknots, vsteps);
+}
+
+bool NihilNurbsEvaluator::setupDirection(Direction& dir, int degree, const std::vector<float>& knots, int steps)
+{
+    dir = Direction();
+    int cvs = (int)knots.size() - degree - 1;
+    if (degree < 1 || cvs <= degree || steps < 1)
+        return false;
+    for (int i = 1; i < (int)knots.size(); i ++)
+    {
+        if (knots.at(i) < knots.at(i - 1))
+            return false;
+    }
+    // an empty domain left no span to sample
+    float lower = knots.at(degree), upper = knots.at(cvs);
+    if (!(lower < upper))
+        return false;
+    dir.degree = degree;
+    dir.cvs = cvs;
+    dir.samples = steps + 1;
+    dir.lower = lower;
+    dir.upper = upper;
+    dir.knots = knots;
+    dir.params.resize(dir.samples);
+    dir.firsts.resize(dir.samples);
+    dir.basis.resize(dir.samples * (degree + 1));
+    dir.derivs.resize(dir.samples * (degree + 1));
+    for (int i = 0; i < dir.samples; i ++)
+    {
+        float t = ((float)i / steps) * (upper - lower) + lower;
+        int span = nihilFindNurbsSpan(cvs, degree, t, knots);
+        dir.params[i] = t;
+        dir.firsts[i] = span - degree;
+        nihilNurbsBasisDerivs(span, t, degree, knots, &dir.basis[i * (degree + 1)], &dir.derivs[i * (degree + 1)]);
+    }
+    return true;
+}
+
+void NihilNurbsEvaluator::evaluate(const gs::vec3* cvs, const float* weights, gs::vec3* points, gs::vec3* normals, int stride)
+{
+    ASSERT(cvs && points && m_u.samples && m_v.samples);
+    // 1.the homogeneous cvs, the weights are 1 if non-rational
+    int count = m_u.cvs * m_v.cvs;
+    m_homogeneous.resize(count * 4);
+    float* h = m_homogeneous.data();
+    gs::vec3 lower = cvs[0], upper = cvs[0];
+    for (int i = 0; i < count; i ++, h += 4)
+    {
+        float w = weights ? weights[i] : 1.f;
+        h[0] = cvs[i].x * w;
+        h[1] = cvs[i].y * w;
+        h[2] = cvs[i].z * w;
+        h[3] = w;
+        lower.x = std::min(lower.x, cvs[i].x);
+        lower.y = std::min(lower.y, cvs[i].y);
+        lower.z = std::min(lower.z, cvs[i].z);
+        upper.x = std::max(upper.x, cvs[i].x);
+        upper.y = std::max(upper.y, cvs[i].y);
+        upper.z = std::max(upper.z, cvs[i].z);
+    }
+    // the normals as long as a millionth of the size of the surface count as vanished, the domains scale the derivatives
+    float size2 = gs::vec3().sub(upper, lower).lengthsq() / ((m_u.upper - m_u.lower) * (m_v.upper - m_v.lower));
+    m_degenerate = size2 * size2 * 1e-12f;
+    // 2.each row of the grid, blended along v then u
+    m_row.resize(m_u.cvs * 4);
+    m_rowDerivs.resize(normals ? m_u.cvs * 4 : 0);
+    for (int i = 0; i < m_v.samples; i ++)
+    {
+        blendRow(i, normals != nullptr);
+        size_t offset = (size_t)stride * m_u.samples * i;
+        evaluateRow(i, (gs::vec3*)((char*)points + offset), normals ? (gs::vec3*)((char*)normals + offset) : nullptr, stride, weights != nullptr);
+    }
+}
+
+void NihilNurbsEvaluator::blendRow(int i, bool derivs)
+{
+    float* row = m_row.data();
+    float* rowDerivs = derivs ? m_rowDerivs.data() : nullptr;
+    const float* h = m_homogeneous.data();
+    const float* N = &m_v.basis[i * (m_v.degree + 1)];
+    const float* D = &m_v.derivs[i * (m_v.degree + 1)];
+    int first = m_v.firsts[i];
+    switch (m_v.degree)
+    {
+    case 1:
+        nihilBlendColumns<1>(row, rowDerivs, h, m_u.cvs, m_v.cvs, first, N, D, 1);
+        break;
+    case 2:
+        nihilBlendColumns<2>(row, rowDerivs, h, m_u.cvs, m_v.cvs, first, N, D, 2);
+        break;
+    case 3:
+        nihilBlendColumns<3>(row, rowDerivs, h, m_u.cvs, m_v.cvs, first, N, D, 3);
+        break;
+    default:
+        nihilBlendColumns<0>(row, rowDerivs, h, m_u.cvs, m_v.cvs, first, N, D, m_v.degree);
+        break;
+    }
+}
+
+void NihilNurbsEvaluator::evaluateRow(int i, gs::vec3* points, gs::vec3* normals, int stride, bool rational)
+{
+    const float* row = m_row.data();
+    const float* rowDerivs = m_rowDerivs.data();
+    const int* firsts = m_u.firsts.data();
+    const float* basis = m_u.basis.data();
+    const float* derivs = m_u.derivs.data();
+    switch (m_u.degree)
+    {
+    case 1:
+        nihilBlendSamples<1>(points, normals, stride, row, rowDerivs, m_u.samples, firsts, basis, derivs, 1, rational, m_degenerate);
+        break;
+    case 2:
+        nihilBlendSamples<2>(points, normals, stride, row, rowDerivs, m_u.samples, firsts, basis, derivs, 2, rational, m_degenerate);
+        break;
+    case 3:
+        nihilBlendSamples<3>(points, normals, stride, row, rowDerivs, m_u.samples, firsts, basis, derivs, 3, rational, m_degenerate);
+        break;
+    default:
+        nihilBlendSamples<0>(points, normals, stride, row, rowDerivs, m_u.samples, firsts, basis, derivs, m_u.degree, rational, m_degenerate);
+        break;
+    }
+    if (!normals)
+        return;
+    // take the vanished ones a thousandth of the domain inside, toward the middle
+    float v = m_v.params[i];
+    float dv = (m_v.upper - m_v.lower) * 1e-3f;
+    v += (v < (m_v.lower + m_v.upper) * 0.5f) ? dv : -dv;
+    for (int j = 0; j < m_u.samples; j ++)
+    {
+        gs::vec3& n = *(gs::vec3*)((char*)normals + (size_t)stride * j);
+        if (n.x != 0.f || n.y != 0.f || n.z != 0.f)
+            continue;
+        float u = m_u.params[j];
+        float du = (m_u.upper - m_u.lower) * 1e-3f;
+        u += (u < (m_u.lower + m_u.upper) * 0.5f) ? du : -du;
+        evaluateNormal(n, u, v, rational);
+    }
+}
+
+void NihilNurbsEvaluator::evaluateNormal(gs::vec3& normal, float u, float v, bool rational) const
+{
+    int p = m_u.degree, q = m_v.degree;
+    int uspan = nihilFindNurbsSpan(m_u.cvs, p, u, m_u.knots);
+    int vspan = nihilFindNurbsSpan(m_v.cvs, q, v, m_v.knots);
+    std::vector<float> Nu(p + 1), Du(p + 1), Nv(q + 1), Dv(q + 1);
+    nihilNurbsBasisDerivs(uspan, u, p, m_u.knots, Nu.data(), Du.data());
+    nihilNurbsBasisDerivs(vspan, v, q, m_v.knots, Nv.data(), Dv.data());
+    // the point and the partial derivatives, homogeneous
+    float h[4] = { 0.f }, hu[4] = { 0.f }, hv[4] = { 0.f };
+    for (int k = 0; k <= p; k ++)
+    {
+        for (int l = 0; l <= q; l ++)
+        {
+            const float* src = &m_homogeneous[((uspan - p + k) * m_v.cvs + (vspan - q + l)) * 4];
+            for (int c = 0; c < 4; c ++)
+            {
+                h[c] += Nu[k] * Nv[l] * src[c];
+                hu[c] += Du[k] * Nv[l] * src[c];
+                hv[c] += Nu[k] * Dv[l] * src[c];
+            }
+        }
+    }
+    gs::vec3 su(hu[0], hu[1], hu[2]), sv(hv[0], hv[1], hv[2]);
+    if (rational)
+    {
+        gs::vec3 s(h[0] / h[3], h[1] / h[3], h[2] / h[3]);
+        su = su - s * hu[3];
+        sv = sv - s * hv[3];
+    }
+    normal.cross(su, sv);
+    // left 0 if the surface collapses here as well
+    float len2 = normal.lengthsq();
+    if (len2 > 0.f)
+        normal.scale(1.f / sqrtf(len2));
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+#include <gslib/math.h>
+
+/*
+ * Evaluates a NURBS surface of any degrees over a grid of samples, evenly spaced in the domain of the knots.
+ * The cvs are in u major order, cv(a, b) is cvs[a * vcvs + b], with optional weights in the same order.
+ * As the grid is a tensor product, setup finds the spans and the basis functions of each direction once,
+ * the evaluation blends each row of the grid along v into a row of points first, then blends the row along u,
+ * which takes (q + 1) * ucvs + (p + 1) * usamples blends a row instead of (p + 1) * (q + 1) a point.
+ * The blends run on the homogeneous points 4 floats at a time by SSE, the degrees 1 to 3 by kernels unrolled at
+ * compile time, the others by a loop over the basis functions of Cox-de Boor.
+ * Non-rational surfaces have no weights and skip the division.
+ * The normals are the cross products of the partial derivatives, blended by the derivatives of the basis functions
+ * in the same pass. Where the derivatives vanish, e.g. on the collapsed edges, they are taken a bit inside.
+ */
+class NihilNurbsEvaluator
+{
+public:
+    bool setup(int udegree, int vdegree, const std::vector<float>& uknots, const std::vector<float>& vknots, int usteps, int vsteps);    // false if the knots don't fit
+    int getUSamples() const { return m_u.samples; }
+    int getVSamples() const { return m_v.samples; }
+    int getUCvs() const { return m_u.cvs; }
+    int getVCvs() const { return m_v.cvs; }
+    // the points of a row in u are next to each other, stride in bytes, skip the normals if null
+    void evaluate(const gs::vec3* cvs, const float* weights, gs::vec3* points, gs::vec3* normals, int stride);
+
+protected:
+    struct Direction
+    {
+        int                 degree = 0;
+        int                 cvs = 0;
+        int                 samples = 0;
+        float               lower = 0.f;            // of the domain
+        float               upper = 0.f;
+        std::vector<float>  knots;
+        std::vector<float>  params;
+        std::vector<int>    firsts;                 // the first cv of the span of each sample
+        std::vector<float>  basis;                  // degree + 1 for each sample
+        std::vector<float>  derivs;                 // of the basis functions
+    };
+
+    Direction               m_u;
+    Direction               m_v;
+    std::vector<float>      m_homogeneous;          // 4 for each cv, the positions multiplied by the weights
+    std::vector<float>      m_row;                  // 4 for each cv in u, a row blended along v
+    std::vector<float>      m_rowDerivs;            // the row blended by the derivatives along v
+    float                   m_degenerate = 0.f;     // the squared length of the normals taken as vanished
+
+protected:
+    bool setupDirection(Direction& dir, int degree, const std::vector<float>& knots, int steps);
+    void blendRow(int i, bool derivs);
+    void evaluateRow(int i, gs::vec3* points, gs::vec3* normals, int stride, bool rational);
+    void evaluateNormal(gs::vec3& normal, float u, float v, bool rational) const;
+};
+
+extern int nihilFindNurbsSpan(int numCvs, int degree, float t, const std::vector<float>& knots);
+extern void nihilNurbsBasisFunc(int i, float u, int degree, const std::vector<float>& knots, float N[]);   // degree + 1 of N
+extern void nihilNurbsBasisDerivs(int i, float u, int degree, const std::vector<float>& knots, float N[], float D[]);
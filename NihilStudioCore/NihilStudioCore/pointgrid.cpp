@@ -0,0 +1,116 @@
+#include <assert.h>
+#include <math.h>
+#include <algorithm>
+#include "pointgrid.h"
+
+#define ASSERT assert
+#undef min
+#undef max
+
+#define NIHIL_GRID_POINTS_PER_CELL  4.f
+#define NIHIL_GRID_MIN_CELL_SIZE    4.f
+#define NIHIL_GRID_MAX_CELL_SIZE    64.f
+
+void NihilPointGrid::build(const float* xs, const float* ys, int count, int width, int height)
+{
+    clear();
+    if (count <= 0 || width <= 0 || height <= 0)
+        return;
+    ASSERT(xs && ys);
+    // sized to hold a few points a cell on average
+    m_cellSize = sqrtf((float)width * (float)height * NIHIL_GRID_POINTS_PER_CELL / count);
+    m_cellSize = std::min(std::max(m_cellSize, NIHIL_GRID_MIN_CELL_SIZE), NIHIL_GRID_MAX_CELL_SIZE);
+    m_columns = std::max((int)ceilf(width / m_cellSize), 1);
+    m_rows = std::max((int)ceilf(height / m_cellSize), 1);
+    // 1.count the points of the cells, the points out of the screen go to the border cells
+    std::vector<int> cells;
+    cells.resize(count);
+    m_cellStarts.assign(m_columns * m_rows + 1, 0);
+    for (int i = 0; i < count; i ++)
+    {
+        int c = getRow(ys[i]) * m_columns + getColumn(xs[i]);
+        cells.at(i) = c;
+        m_cellStarts.at(c + 1) ++;
+    }
+    for (int c = 0; c < m_columns * m_rows; c ++)
+        m_cellStarts.at(c + 1) += m_cellStarts.at(c);
+    // 2.scatter them, the buckets are in the ascending order of the points
+    std::vector<int> cursors(m_cellStarts.begin(), m_cellStarts.end() - 1);
+    m_points.resize(count);
+    for (int i = 0; i < count; i ++)
+        m_points.at(cursors.at(cells.at(i)) ++) = i;
+}
+
+void NihilPointGrid::clear()
+{
+    m_columns = m_rows = 0;
+    m_cellStarts.clear();
+    m_points.clear();
+}
+
+int NihilPointGrid::getColumn(float x) const
+{
+    ASSERT(m_columns > 0);
+    x /= m_cellSize;
+    if (!(x > 0.f))     // NaN as well
+        return 0;
+    return x < (float)m_columns ? (int)x : m_columns - 1;
+}
+
+int NihilPointGrid::getRow(float y) const
+{
+    ASSERT(m_rows > 0);
+    y /= m_cellSize;
+    if (!(y > 0.f))
+        return 0;
+    return y < (float)m_rows ? (int)y : m_rows - 1;
+}
+
+void NihilPointGrid::query(const gs::pink::rectf& rc, const float* xs, const float* ys, gs::vbitset& hits) const
+{
+    if (isEmpty())
+        return;
+    ASSERT(xs && ys && hits.size() >= (int)m_points.size());
+    int left = getColumn(rc.left), right = getColumn(rc.right);
+    int top = getRow(rc.top), bottom = getRow(rc.bottom);
+    for (int r = top; r <= bottom; r ++)
+    {
+        // the cells of a row are contiguous, so are their buckets
+        int first = m_cellStarts.at(r * m_columns + left);
+        int last = m_cellStarts.at(r * m_columns + right + 1);
+        for (int k = first; k < last; k ++)
+        {
+            int i = m_points.at(k);
+            if (rc.in_rect(gs::pink::pointf(xs[i], ys[i])))
+                hits.set(i);
+        }
+    }
+}
+
+int NihilPointGrid::pick(float x, float y, float radius, const float* xs, const float* ys) const
+{
+    if (isEmpty())
+        return -1;
+    ASSERT(xs && ys && radius >= 0.f);
+    int left = getColumn(x - radius), right = getColumn(x + radius);
+    int top = getRow(y - radius), bottom = getRow(y + radius);
+    int nearest = -1;
+    float nearestDist = radius * radius;
+    for (int r = top; r <= bottom; r ++)
+    {
+        int first = m_cellStarts.at(r * m_columns + left);
+        int last = m_cellStarts.at(r * m_columns + right + 1);
+        for (int k = first; k < last; k ++)
+        {
+            int i = m_points.at(k);
+            float dx = xs[i] - x, dy = ys[i] - y;
+            float dist = dx * dx + dy * dy;
+            if (dist <= nearestDist)
+            {
+                nearest = i;
+                nearestDist = dist;
+            }
+        }
+    }
+    return nearest;
+}
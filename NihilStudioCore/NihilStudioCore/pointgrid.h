@@ -0,0 +1,31 @@
+#pragma once
+
+#include <vector>
+#include <gslib/vbitset.h>
+#include <pink/type.h>
+
+/*
+ * Uniform grid over the projected points of the points layer, in screen space.
+ * The points are bucketed by a counting sort into one flat array, a cell only keeps the offset of its bucket.
+ * The coordinates come in separated arrays, indexed the same as the point selection.
+ */
+class NihilPointGrid
+{
+public:
+    void build(const float* xs, const float* ys, int count, int width, int height);
+    void clear();
+    bool isEmpty() const { return m_points.empty(); }
+    void query(const gs::pink::rectf& rc, const float* xs, const float* ys, gs::vbitset& hits) const;
+    int pick(float x, float y, float radius, const float* xs, const float* ys) const;    // the nearest point within the radius, -1 if none
+
+protected:
+    float                   m_cellSize = 1.f;
+    int                     m_columns = 0;
+    int                     m_rows = 0;
+    std::vector<int>        m_cellStarts;           // the bucket of cell c is [m_cellStarts[c], m_cellStarts[c + 1])
+    std::vector<int>        m_points;
+
+protected:
+    int getColumn(float x) const;
+    int getRow(float y) const;
+};
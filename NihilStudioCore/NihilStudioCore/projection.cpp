@@ -0,0 +1,77 @@
+#include <assert.h>
+#include <emmintrin.h>
+#include "projection.h"
+#include "threadpool.h"
+
+#define ASSERT assert
+
+#define NIHIL_PROJECTION_GRAIN  8192            // points of a task
+
+void NihilScreenPoints::resize(int count)
+{
+    xs.resize(count);
+    ys.resize(count);
+    zs.resize(count);
+    ws.resize(count);
+}
+
+static inline const gs::vec3& nihilGetPosition(const gs::vec3* positions, int stride, const int* indices, int i)
+{
+    int j = indices ? indices[i] : i;
+    return *(const gs::vec3*)((const char*)positions + (size_t)j * stride);
+}
+
+static void nihilProjectRange(NihilScreenPoints& out, const gs::vec3* positions, int stride, const int* indices, int first, int last, const gs::matrix& mat)
+{
+    __m128 m[4][4];
+    for (int i = 0; i < 4; i ++)
+    {
+        for (int j = 0; j < 4; j ++)
+            m[i][j] = _mm_set1_ps(mat.m[i][j]);
+    }
+    int i = first;
+    for (; i + 4 <= last; i += 4)
+    {
+        // transpose 4 positions into x, y, z lanes
+        const gs::vec3& p0 = nihilGetPosition(positions, stride, indices, i);
+        const gs::vec3& p1 = nihilGetPosition(positions, stride, indices, i + 1);
+        const gs::vec3& p2 = nihilGetPosition(positions, stride, indices, i + 2);
+        const gs::vec3& p3 = nihilGetPosition(positions, stride, indices, i + 3);
+        __m128 x = _mm_setr_ps(p0.x, p1.x, p2.x, p3.x);
+        __m128 y = _mm_setr_ps(p0.y, p1.y, p2.y, p3.y);
+        __m128 z = _mm_setr_ps(p0.z, p1.z, p2.z, p3.z);
+        // (x, y, z, 1) * mat, the row vector convention
+        __m128 r[4];
+        for (int j = 0; j < 4; j ++)
+            r[j] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m[0][j]), _mm_mul_ps(y, m[1][j])), _mm_add_ps(_mm_mul_ps(z, m[2][j]), m[3][j]));
+        __m128 rw = _mm_div_ps(_mm_set1_ps(1.f), r[3]);
+        _mm_storeu_ps(&out.xs[i], _mm_mul_ps(r[0], rw));
+        _mm_storeu_ps(&out.ys[i], _mm_mul_ps(r[1], rw));
+        _mm_storeu_ps(&out.zs[i], _mm_mul_ps(r[2], rw));
+        _mm_storeu_ps(&out.ws[i], r[3]);
+    }
+    for (; i < last; i ++)
+    {
+        gs::vec4 t;
+        nihilGetPosition(positions, stride, indices, i).transform(t, mat);
+        out.ws[i] = t.w;
+        t.scale(1.f / t.w);
+        out.xs[i] = t.x;
+        out.ys[i] = t.y;
+        out.zs[i] = t.z;
+    }
+}
+
+void nihilProjectPoints(NihilScreenPoints& out, const gs::vec3* positions, int stride, const int* indices, int count, const gs::matrix& mat, NihilThreadPool* pool)
+{
+    ASSERT(count >= 0 && (positions || !count));
+    out.resize(count);
+    if (!pool)
+    {
+        nihilProjectRange(out, positions, stride, indices, 0, count, mat);
+        return;
+    }
+    pool->parallelFor(count, NIHIL_PROJECTION_GRAIN, [&](int first, int last) {
+        nihilProjectRange(out, positions, stride, indices, first, last, mat);
+    });
+}
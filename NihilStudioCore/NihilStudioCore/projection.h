@@ -0,0 +1,28 @@
+#pragma once
+
+#include <vector>
+#include <gslib/math.h>
+
+class NihilThreadPool;
+
+/*
+ * Projected points in structure of arrays, x, y, z are divided by w already.
+ * The w stays so that the points behind the eye (w <= 0) can be told apart.
+ */
+struct NihilScreenPoints
+{
+    std::vector<float>      xs;
+    std::vector<float>      ys;
+    std::vector<float>      zs;
+    std::vector<float>      ws;
+
+    int size() const { return (int)xs.size(); }
+    void resize(int count);
+};
+
+/*
+ * Project the positions by the matrix 4 at a time with SSE, the large batches split over the thread pool.
+ * The positions are read with the stride in bytes, by the indices if given, or in order.
+ * The results are written in the order of the input, the pool can be null.
+ */
+extern void nihilProjectPoints(NihilScreenPoints& out, const gs::vec3* positions, int stride, const int* indices, int count, const gs::matrix& mat, NihilThreadPool* pool);
@@ -0,0 +1,176 @@
+#include <assert.h>
+#include <algorithm>
+#include "recordrenderer.h"
+
+#define ASSERT assert
+
+bool NihilRecordGeometry::createVertexStream(const NihilVertex vertices[], int size)
+{
+    ASSERT(vertices && size > 0);
+    ASSERT(m_mesh->vertices.empty());
+    m_mesh->vertices.assign(vertices, vertices + size);
+    m_renderer->addUploadedBytes(sizeof(NihilVertex) * size);
+    return true;
+}
+
+bool NihilRecordGeometry::createIndexStream(const int indices[], int size)
+{
+    ASSERT(indices && size > 0);
+    ASSERT(m_mesh->indices.empty());
+    m_mesh->indices.assign(indices, indices + size);
+    m_renderer->addUploadedBytes(sizeof(int) * size);
+    return true;
+}
+
+bool NihilRecordGeometry::createLodIndexStream(int level, const int indices[], int size)
+{
+    ASSERT(level == (int)m_mesh->lodIndices.size() + 1 && "Lod levels should be created in order.");
+    ASSERT(indices && size > 0);
+    m_mesh->lodIndices.push_back(NihilIndexList(indices, indices + size));
+    m_renderer->addUploadedBytes(sizeof(int) * size);
+    return true;
+}
+
+bool NihilRecordGeometry::updateVertexStream(const NihilVertex vertices[], int size)
+{
+    ASSERT(vertices);
+    ASSERT((int)m_mesh->vertices.size() == size);
+    std::copy(vertices, vertices + size, m_mesh->vertices.begin());
+    m_renderer->addUploadedBytes(sizeof(NihilVertex) * size);
+    return true;
+}
+
+void NihilRecordGeometry::shareStreamsOf(NihilGeometry* source)
+{
+    ASSERT(source && source != this);
+    auto* p = static_cast<NihilRecordGeometry*>(source);
+    ASSERT(p->m_renderer == m_renderer);
+    m_mesh = p->m_mesh;
+    m_lodCenter = p->m_lodCenter;
+    m_lodErrors = p->m_lodErrors;
+}
+
+void NihilRecordGeometry::unshareStreams()
+{
+    m_mesh = std::make_shared<NihilRecordMesh>();
+    // the levels belong to the shared streams as well, setupLodStreams sets them again
+    m_lodCenter = gs::vec3(0.f, 0.f, 0.f);
+    m_lodErrors.clear();
+}
+
+bool NihilRecordUIObject::createVertexStream(NihilUIVertex vertices[], int size)
+{
+    ASSERT(vertices && size > 0);
+    ASSERT(m_vertices.empty());
+    m_vertices.assign(vertices, vertices + size);
+    m_renderer->addUploadedBytes(sizeof(NihilUIVertex) * size);
+    return true;
+}
+
+bool NihilRecordUIObject::createIndexStream(int indices[], int size)
+{
+    ASSERT(indices && size > 0);
+    ASSERT(m_indices.empty());
+    m_indices.assign(indices, indices + size);
+    m_renderer->addUploadedBytes(sizeof(int) * size);
+    return true;
+}
+
+bool NihilRecordUIObject::updateVertexStream(NihilUIVertex vertices[], int size)
+{
+    ASSERT(vertices);
+    ASSERT((int)m_vertices.size() == size);
+    std::copy(vertices, vertices + size, m_vertices.begin());
+    m_renderer->addUploadedBytes(sizeof(NihilUIVertex) * size);
+    return true;
+}
+
+NihilRecordRenderer::~NihilRecordRenderer()
+{
+    for (auto* p : m_geometries)
+        delete p;
+    for (auto* p : m_uiObjects)
+        delete p;
+    m_geometries.clear();
+    m_uiObjects.clear();
+}
+
+void NihilRecordRenderer::render(const NihilCommandList& commands)
+{
+    m_stats.frames ++;
+    m_stats.packets += commands.size();
+    m_stats.stateChanges += commands.getStateChanges();
+    for (int i = 0; i < commands.size(); i ++)
+    {
+        const NihilDrawPacket& packet = commands.getPacket(i);
+        switch (packet.getPass())
+        {
+        case NihilDrawPacket::Pass_Geometry:
+        case NihilDrawPacket::Pass_InstancedGeometry:
+            {
+                auto* geometry = static_cast<NihilRecordGeometry*>(packet.geometry);
+                ASSERT(geometry);
+                m_stats.drawnIndices += geometry->getMesh()->getIndicesCount(packet.getLevel());
+                // a call for the run of the instances of the same streams, as the device would
+                if (packet.getPass() == NihilDrawPacket::Pass_Geometry || !i || !packet.isSameStreams(commands.getPacket(i - 1)))
+                    m_stats.drawCalls ++;
+                break;
+            }
+        case NihilDrawPacket::Pass_UI:
+            {
+                auto* uiObject = static_cast<NihilRecordUIObject*>(packet.uiObject);
+                ASSERT(uiObject);
+                m_stats.drawnIndices += uiObject->getIndicesCount();
+                m_stats.drawCalls ++;
+                break;
+            }
+        default:
+            ASSERT(!"Unexpected pass.");
+            break;
+        }
+    }
+}
+
+void NihilRecordRenderer::getViewSize(float& width, float& height) const
+{
+    width = m_viewWidth;
+    height = m_viewHeight;
+}
+
+NihilGeometry* NihilRecordRenderer::addGeometry()
+{
+    auto* p = new NihilRecordGeometry(this);
+    ASSERT(p);
+    m_geometries.insert(p);
+    return p;
+}
+
+NihilUIObject* NihilRecordRenderer::addUIObject()
+{
+    auto* p = new NihilRecordUIObject(this);
+    ASSERT(p);
+    m_uiObjects.push_back(p);
+    return p;
+}
+
+void NihilRecordRenderer::removeGeometry(NihilGeometry* ptr)
+{
+    ASSERT(ptr);
+    m_geometries.erase(ptr);
+    delete ptr;
+}
+
+void NihilRecordRenderer::removeUIObject(NihilUIObject* ptr)
+{
+    ASSERT(ptr);
+    auto f = std::find(m_uiObjects.begin(), m_uiObjects.end(), ptr);
+    ASSERT(f != m_uiObjects.end());
+    m_uiObjects.erase(f);
+    delete ptr;
+}
+
+void NihilRecordRenderer::setViewSize(UINT width, UINT height)
+{
+    m_viewWidth = (float)width;
+    m_viewHeight = (float)height;
+}
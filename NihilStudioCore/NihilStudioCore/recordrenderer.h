@@ -0,0 +1,111 @@
+#pragma once
+
+#include <unordered_set>
+#include "core.h"
+
+// the counters of the frames drawn and the streams uploaded since the last reset
+struct NihilRecordStats
+{
+    int                     frames = 0;
+    int                     packets = 0;
+    int                     drawCalls = 0;          // one call draws the instances of the same streams
+    int                     stateChanges = 0;       // switches of the shader, topology and material
+    long long               drawnIndices = 0;       // of all the instances
+    long long               uploadedBytes = 0;      // by the creates and the updates of the streams
+};
+
+// the streams of a geometry, shared by its instances
+struct NihilRecordMesh
+{
+    NihilPointList              vertices;
+    NihilIndexList              indices;
+    std::vector<NihilIndexList> lodIndices;         // level 1 to n
+
+    int getIndicesCount(int level) const { return (int)(level ? lodIndices.at(level - 1).size() : indices.size()); }
+};
+typedef std::shared_ptr<NihilRecordMesh> NihilRecordMeshPtr;
+
+class NihilRecordRenderer;
+
+class NihilRecordGeometry :
+    public NihilGeometry
+{
+public:
+    NihilRecordGeometry(NihilRecordRenderer* renderer): m_renderer(renderer), m_mesh(std::make_shared<NihilRecordMesh>()) {}
+    virtual bool createVertexStream(const NihilVertex vertices[], int size) override;
+    virtual bool createIndexStream(const int indices[], int size) override;
+    virtual bool createLodIndexStream(int level, const int indices[], int size) override;
+    virtual bool updateVertexStream(const NihilVertex vertices[], int size) override;
+    virtual void setLocalMat(const gs::matrix& m) override { m_localMat = m; }
+    virtual const gs::matrix& getLocalMat() const override { return m_localMat; }
+    virtual void shareStreamsOf(NihilGeometry* source) override;
+    virtual void unshareStreams() override;
+    virtual bool isInstanced() const override { return m_mesh.use_count() > 1; }
+    virtual const void* getStreams() const override { return m_mesh.get(); }
+
+public:
+    const NihilRecordMesh* getMesh() const { return m_mesh.get(); }
+
+private:
+    NihilRecordRenderer*        m_renderer = nullptr;
+    NihilRecordMeshPtr          m_mesh;
+    gs::matrix                  m_localMat;
+};
+
+class NihilRecordUIObject :
+    public NihilUIObject
+{
+public:
+    NihilRecordUIObject(NihilRecordRenderer* renderer): m_renderer(renderer) {}
+    virtual bool createVertexStream(NihilUIVertex vertices[], int size) override;
+    virtual bool createIndexStream(int indices[], int size) override;
+    virtual bool updateVertexStream(NihilUIVertex vertices[], int size) override;
+
+public:
+    const std::vector<NihilUIVertex>& getVertices() const { return m_vertices; }
+    const NihilIndexList& getIndices() const { return m_indices; }
+    int getIndicesCount() const { return (int)(m_indices.empty() ? m_vertices.size() : m_indices.size()); }
+
+private:
+    NihilRecordRenderer*        m_renderer = nullptr;
+    std::vector<NihilUIVertex>  m_vertices;
+    NihilIndexList              m_indices;
+};
+
+/*
+ * Renderer without any device, for the benchmarks and the tests.
+ * The streams stay in memory as they are uploaded, the frames are only counted, so that the core can load,
+ * edit and pick without a window, and the costs of the uploads and the draws can be measured.
+ */
+class NihilRecordRenderer :
+    public NihilRenderer
+{
+public:
+    NihilRecordRenderer(UINT width, UINT height): m_viewWidth((float)width), m_viewHeight((float)height) {}
+    virtual ~NihilRecordRenderer();
+    virtual bool setup(HWND hwnd) override { return true; }
+    virtual void render(const NihilCommandList& commands) override;
+    virtual void notifyResize() override {}
+    virtual void getViewSize(float& width, float& height) const override;
+    virtual NihilGeometry* addGeometry() override;
+    virtual NihilUIObject* addUIObject() override;
+    virtual void removeGeometry(NihilGeometry* ptr) override;
+    virtual void removeUIObject(NihilUIObject* ptr) override;
+    virtual void showSolidMode() override { m_wireframe = false; }
+    virtual void showWireframeMode() override { m_wireframe = true; }
+
+public:
+    void setViewSize(UINT width, UINT height);      // then resizeWindow of the core, as if the window resized
+    bool isWireframeMode() const { return m_wireframe; }
+    int getGeometryCount() const { return (int)m_geometries.size(); }
+    const NihilRecordStats& getStats() const { return m_stats; }
+    void resetStats() { m_stats = NihilRecordStats(); }
+    void addUploadedBytes(size_t bytes) { m_stats.uploadedBytes += (long long)bytes; }
+
+protected:
+    std::unordered_set<NihilGeometry*> m_geometries;   // only owned here, the frames draw from the command lists
+    float                       m_viewWidth = 0.f;
+    float                       m_viewHeight = 0.f;
+    bool                        m_wireframe = false;
+    NihilRecordStats            m_stats;
+};
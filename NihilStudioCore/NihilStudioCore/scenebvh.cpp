@@ -0,0 +1,595 @@
+#include <assert.h>
+#include <math.h>
+#include <algorithm>
+#include <functional>
+#include "core.h"
+
+#define ASSERT assert
+#undef min
+#undef max
+
+#define NIHIL_BVH_LEAF_SIZE     4
+#define NIHIL_BVH_MAX_DEPTH     64
+#define NIHIL_MESH_BVH_LEAF_SIZE    8
+
+void NihilBoundingBox::reset()
+{
+    minpt = gs::vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+    maxpt = gs::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+}
+
+void NihilBoundingBox::expand(const gs::vec3& p)
+{
+    minpt.x = std::min(minpt.x, p.x);
+    minpt.y = std::min(minpt.y, p.y);
+    minpt.z = std::min(minpt.z, p.z);
+    maxpt.x = std::max(maxpt.x, p.x);
+    maxpt.y = std::max(maxpt.y, p.y);
+    maxpt.z = std::max(maxpt.z, p.z);
+}
+
+void NihilBoundingBox::expand(const NihilBoundingBox& box)
+{
+    if (box.isEmpty())
+        return;
+    expand(box.minpt);
+    expand(box.maxpt);
+}
+
+void NihilBoundingBox::transform(const NihilBoundingBox& box, const gs::matrix& m)
+{
+    if (box.isEmpty())
+    {
+        reset();
+        return;
+    }
+    // Arvo's method, in the row vector convention: p' = p * m
+    float bmin[3] = { box.minpt.x, box.minpt.y, box.minpt.z };
+    float bmax[3] = { box.maxpt.x, box.maxpt.y, box.maxpt.z };
+    float rmin[3], rmax[3];
+    for (int j = 0; j < 3; j ++)
+    {
+        rmin[j] = rmax[j] = m.m[3][j];
+        for (int i = 0; i < 3; i ++)
+        {
+            float a = m.m[i][j] * bmin[i];
+            float b = m.m[i][j] * bmax[i];
+            rmin[j] += std::min(a, b);
+            rmax[j] += std::max(a, b);
+        }
+    }
+    minpt = gs::vec3(rmin[0], rmin[1], rmin[2]);
+    maxpt = gs::vec3(rmax[0], rmax[1], rmax[2]);
+}
+
+gs::vec3 NihilBoundingBox::getCenter() const
+{
+    return gs::vec3((minpt.x + maxpt.x) * 0.5f, (minpt.y + maxpt.y) * 0.5f, (minpt.z + maxpt.z) * 0.5f);
+}
+
+bool nihilIntersectRayBox(const NihilBoundingBox& box, const gs::vec3& origin, const gs::vec3& invDir, float maxDistance, float& distance)
+{
+    // the slabs, the order of min/max drops NaN from 0 * inf
+    float t1 = (box.minpt.x - origin.x) * invDir.x;
+    float t2 = (box.maxpt.x - origin.x) * invDir.x;
+    float tmin = std::min(t1, t2), tmax = std::max(t1, t2);
+    t1 = (box.minpt.y - origin.y) * invDir.y;
+    t2 = (box.maxpt.y - origin.y) * invDir.y;
+    tmin = std::max(tmin, std::min(t1, t2));
+    tmax = std::min(tmax, std::max(t1, t2));
+    t1 = (box.minpt.z - origin.z) * invDir.z;
+    t2 = (box.maxpt.z - origin.z) * invDir.z;
+    tmin = std::max(tmin, std::min(t1, t2));
+    tmax = std::min(tmax, std::max(t1, t2));
+    tmin = std::max(tmin, 0.f);
+    if (!(tmin <= tmax) || tmin > maxDistance)
+        return false;
+    distance = tmin;
+    return true;
+}
+
+static gs::vec3 nihilGetInverseDir(const gs::vec3& dir)
+{
+    return gs::vec3(1.f / dir.x, 1.f / dir.y, 1.f / dir.z);
+}
+
+static float nihilGetAxisOf(const gs::vec3& v, int axis)
+{
+    return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+void NihilSceneBvh::build(const std::vector<NihilObject*>& objects)
+{
+    clear();
+    m_objects = objects;
+    if (m_objects.empty())
+        return;
+    m_nodes.reserve(m_objects.size() / NIHIL_BVH_LEAF_SIZE * 2 + 1);
+    buildNode(-1, 0, (int)m_objects.size());
+}
+
+void NihilSceneBvh::clear()
+{
+    for (auto* p : m_objects)
+        p->setSceneBvhLeaf(nullptr, -1);
+    m_nodes.clear();
+    m_objects.clear();
+    m_dirtyNodes.clear();
+}
+
+int NihilSceneBvh::buildNode(int parent, int first, int count)
+{
+    ASSERT(count > 0);
+    int index = (int)m_nodes.size();
+    m_nodes.push_back(Node());
+    NihilBoundingBox centers;
+    {
+        Node& node = m_nodes.back();
+        node.parent = parent;
+        node.first = first;
+        node.count = count;
+        for (int i = first; i < first + count; i ++)
+        {
+            const NihilBoundingBox& box = m_objects.at(i)->getBoundingBox();
+            node.box.expand(box);
+            if (!box.isEmpty())
+                centers.expand(box.getCenter());
+        }
+    }
+    if (count <= NIHIL_BVH_LEAF_SIZE || centers.isEmpty())
+    {
+        for (int i = first; i < first + count; i ++)
+            m_objects.at(i)->setSceneBvhLeaf(this, index);
+        return index;
+    }
+    // split at the median along the longest axis of the centers
+    float dx = centers.maxpt.x - centers.minpt.x;
+    float dy = centers.maxpt.y - centers.minpt.y;
+    float dz = centers.maxpt.z - centers.minpt.z;
+    int axis = (dx >= dy && dx >= dz) ? 0 : (dy >= dz ? 1 : 2);
+    int half = count / 2;
+    auto begin = m_objects.begin() + first;
+    std::nth_element(begin, begin + half, begin + count, [axis](NihilObject* a, NihilObject* b)-> bool {
+        return nihilGetAxisOf(a->getBoundingBox().getCenter(), axis) < nihilGetAxisOf(b->getBoundingBox().getCenter(), axis);
+    });
+    // DONOT hold the reference of the node here, the recursion reallocates the list
+    int left = buildNode(index, first, half);
+    int right = buildNode(index, first + half, count - half);
+    m_nodes.at(index).left = left;
+    m_nodes.at(index).right = right;
+    return index;
+}
+
+void NihilSceneBvh::markDirty(int leaf)
+{
+    ASSERT(leaf >= 0 && leaf < (int)m_nodes.size() && m_nodes.at(leaf).isLeaf());
+    Node& node = m_nodes.at(leaf);
+    if (node.dirty)
+        return;
+    node.dirty = true;
+    m_dirtyNodes.push_back(leaf);
+}
+
+void NihilSceneBvh::refit()
+{
+    if (m_dirtyNodes.empty())
+        return;
+    // mark the ancestors of the moved leaves, the branches shared by several leaves are walked only once
+    for (int i = 0, count = (int)m_dirtyNodes.size(); i < count; i ++)
+    {
+        int p = m_nodes.at(m_dirtyNodes.at(i)).parent;
+        while (p >= 0 && !m_nodes.at(p).dirty)
+        {
+            m_nodes.at(p).dirty = true;
+            m_dirtyNodes.push_back(p);
+            p = m_nodes.at(p).parent;
+        }
+    }
+    // the children come after their parents, refit them by the descending order
+    std::sort(m_dirtyNodes.begin(), m_dirtyNodes.end(), std::greater<int>());
+    for (int i : m_dirtyNodes)
+    {
+        Node& node = m_nodes.at(i);
+        refitNode(node);
+        node.dirty = false;
+    }
+    m_dirtyNodes.clear();
+}
+
+void NihilSceneBvh::refitNode(Node& node)
+{
+    node.box.reset();
+    if (node.isLeaf())
+    {
+        for (int i = node.first; i < node.first + node.count; i ++)
+            node.box.expand(m_objects.at(i)->getBoundingBox());
+        return;
+    }
+    node.box.expand(m_nodes.at(node.left).box);
+    node.box.expand(m_nodes.at(node.right).box);
+}
+
+void nihilExtractClipPlanes(gs::vec4 planes[6], const gs::matrix& m)
+{
+    // (x, y, z, w) = (p, 1) * m is visible if -w <= x <= w, -w <= y <= w, 0 <= z <= w
+    gs::vec4 col[4];
+    for (int j = 0; j < 4; j ++)
+        col[j] = gs::vec4(m.m[0][j], m.m[1][j], m.m[2][j], m.m[3][j]);
+    planes[0].add(col[3], col[0]);
+    planes[1].sub(col[3], col[0]);
+    planes[2].add(col[3], col[1]);
+    planes[3].sub(col[3], col[1]);
+    planes[4] = col[2];
+    planes[5].sub(col[3], col[2]);
+}
+
+bool nihilClassifyBox(const NihilBoundingBox& box, const gs::vec4 planes[6], int& mask)
+{
+    if (box.isEmpty())
+        return false;
+    for (int i = 0; i < 6; i ++)
+    {
+        if (!(mask & (1 << i)))
+            continue;
+        const gs::vec4& p = planes[i];
+        float farthest = p.x * (p.x > 0.f ? box.maxpt.x : box.minpt.x) +
+            p.y * (p.y > 0.f ? box.maxpt.y : box.minpt.y) +
+            p.z * (p.z > 0.f ? box.maxpt.z : box.minpt.z) + p.w;
+        if (farthest < 0.f)
+            return false;
+        float nearest = p.x * (p.x > 0.f ? box.minpt.x : box.maxpt.x) +
+            p.y * (p.y > 0.f ? box.minpt.y : box.maxpt.y) +
+            p.z * (p.z > 0.f ? box.minpt.z : box.maxpt.z) + p.w;
+        if (nearest >= 0.f)
+            mask &= ~(1 << i);
+    }
+    return true;
+}
+
+void NihilSceneBvh::cull(const gs::matrix& viewProj)
+{
+    if (m_nodes.empty())
+        return;
+    ASSERT(m_dirtyNodes.empty() && "Refit before culling.");
+    gs::vec4 planes[6];
+    nihilExtractClipPlanes(planes, viewProj);
+    struct
+    {
+        int                 node;
+        int                 mask;
+    } stack[NIHIL_BVH_MAX_DEPTH];
+    int top = 0;
+    stack[top].node = 0;
+    stack[top ++].mask = 0x3f;
+    while (top > 0)
+    {
+        top --;
+        const Node& node = m_nodes.at(stack[top].node);
+        int mask = stack[top].mask;
+        if (!nihilClassifyBox(node.box, planes, mask))
+        {
+            setRangeVisible(node, false);
+            continue;
+        }
+        if (!mask)
+        {
+            setRangeVisible(node, true);
+            continue;
+        }
+        if (node.isLeaf())
+        {
+            for (int i = node.first; i < node.first + node.count; i ++)
+            {
+                NihilObject* object = m_objects.at(i);
+                int objectMask = mask;
+                object->setVisible(nihilClassifyBox(object->getBoundingBox(), planes, objectMask));
+            }
+            continue;
+        }
+        ASSERT(top + 2 <= NIHIL_BVH_MAX_DEPTH);
+        stack[top].node = node.left;
+        stack[top ++].mask = mask;
+        stack[top].node = node.right;
+        stack[top ++].mask = mask;
+    }
+}
+
+void NihilSceneBvh::setRangeVisible(const Node& node, bool b)
+{
+    for (int i = node.first; i < node.first + node.count; i ++)
+        m_objects.at(i)->setVisible(b);
+}
+
+void NihilSceneBvh::query(const gs::matrix& viewProj, std::vector<NihilObject*>& objects) const
+{
+    if (m_nodes.empty())
+        return;
+    ASSERT(m_dirtyNodes.empty() && "Refit before query.");
+    gs::vec4 planes[6];
+    nihilExtractClipPlanes(planes, viewProj);
+    struct
+    {
+        int                 node;
+        int                 mask;
+    } stack[NIHIL_BVH_MAX_DEPTH];
+    int top = 0;
+    stack[top].node = 0;
+    stack[top ++].mask = 0x3f;
+    while (top > 0)
+    {
+        top --;
+        const Node& node = m_nodes.at(stack[top].node);
+        int mask = stack[top].mask;
+        if (!nihilClassifyBox(node.box, planes, mask))
+            continue;
+        if (!mask || node.isLeaf())
+        {
+            for (int i = node.first; i < node.first + node.count; i ++)
+            {
+                NihilObject* object = m_objects.at(i);
+                int objectMask = mask;
+                if (nihilClassifyBox(object->getBoundingBox(), planes, objectMask))
+                    objects.push_back(object);
+            }
+            continue;
+        }
+        ASSERT(top + 2 <= NIHIL_BVH_MAX_DEPTH);
+        stack[top].node = node.left;
+        stack[top ++].mask = mask;
+        stack[top].node = node.right;
+        stack[top ++].mask = mask;
+    }
+}
+
+void NihilSceneBvh::raycast(const gs::vec3& origin, const gs::vec3& dir, std::vector<NihilRayCandidate>& candidates) const
+{
+    if (m_nodes.empty())
+        return;
+    ASSERT(m_dirtyNodes.empty() && "Refit before raycast.");
+    gs::vec3 invDir = nihilGetInverseDir(dir);
+    int stack[NIHIL_BVH_MAX_DEPTH];
+    int top = 0;
+    stack[top ++] = 0;
+    while (top > 0)
+    {
+        const Node& node = m_nodes.at(stack[-- top]);
+        float distance;
+        if (!nihilIntersectRayBox(node.box, origin, invDir, FLT_MAX, distance))
+            continue;
+        if (node.isLeaf())
+        {
+            for (int i = node.first; i < node.first + node.count; i ++)
+            {
+                NihilObject* object = m_objects.at(i);
+                if (nihilIntersectRayBox(object->getBoundingBox(), origin, invDir, FLT_MAX, distance))
+                    candidates.push_back({ distance, object });
+            }
+            continue;
+        }
+        ASSERT(top + 2 <= NIHIL_BVH_MAX_DEPTH);
+        stack[top ++] = node.left;
+        stack[top ++] = node.right;
+    }
+    std::sort(candidates.begin(), candidates.end());
+}
+
+void NihilMeshBvh::build(const NihilVertex* points, const int* indices, int triangleCount)
+{
+    clear();
+    if (triangleCount <= 0)
+        return;
+    ASSERT(points && indices);
+    std::vector<gs::vec3> centers;
+    centers.resize(triangleCount);
+    m_triangles.resize(triangleCount);
+    for (int i = 0; i < triangleCount; i ++)
+    {
+        const gs::vec3& p1 = points[indices[i * 3]].pos;
+        const gs::vec3& p2 = points[indices[i * 3 + 1]].pos;
+        const gs::vec3& p3 = points[indices[i * 3 + 2]].pos;
+        centers.at(i) = gs::vec3((p1.x + p2.x + p3.x) / 3.f, (p1.y + p2.y + p3.y) / 3.f, (p1.z + p2.z + p3.z) / 3.f);
+        m_triangles.at(i) = i;
+    }
+    m_nodes.reserve(triangleCount / NIHIL_MESH_BVH_LEAF_SIZE * 2 + 1);
+    buildNode(centers, points, indices, 0, triangleCount);
+}
+
+void NihilMeshBvh::clear()
+{
+    m_nodes.clear();
+    m_triangles.clear();
+}
+
+int NihilMeshBvh::buildNode(const std::vector<gs::vec3>& centers, const NihilVertex* points, const int* indices, int first, int count)
+{
+    ASSERT(count > 0);
+    int index = (int)m_nodes.size();
+    m_nodes.push_back(Node());
+    m_nodes.back().first = first;
+    m_nodes.back().count = count;
+    NihilBoundingBox bounds;
+    for (int i = first; i < first + count; i ++)
+        bounds.expand(centers.at(m_triangles.at(i)));
+    float dx = bounds.maxpt.x - bounds.minpt.x;
+    float dy = bounds.maxpt.y - bounds.minpt.y;
+    float dz = bounds.maxpt.z - bounds.minpt.z;
+    if (count <= NIHIL_MESH_BVH_LEAF_SIZE || (dx <= 0.f && dy <= 0.f && dz <= 0.f))
+    {
+        refitLeaf(m_nodes.back(), points, indices);
+        return index;
+    }
+    // split at the median along the longest axis of the centers
+    int axis = (dx >= dy && dx >= dz) ? 0 : (dy >= dz ? 1 : 2);
+    int half = count / 2;
+    auto begin = m_triangles.begin() + first;
+    std::nth_element(begin, begin + half, begin + count, [&centers, axis](int a, int b)-> bool {
+        return nihilGetAxisOf(centers.at(a), axis) < nihilGetAxisOf(centers.at(b), axis);
+    });
+    // DONOT hold the reference of the node here, the recursion reallocates the list
+    int left = buildNode(centers, points, indices, first, half);
+    int right = buildNode(centers, points, indices, first + half, count - half);
+    Node& node = m_nodes.at(index);
+    node.right = right;
+    node.box = m_nodes.at(left).box;
+    node.box.expand(m_nodes.at(right).box);
+    return index;
+}
+
+void NihilMeshBvh::refitLeaf(Node& node, const NihilVertex* points, const int* indices)
+{
+    node.box.reset();
+    for (int i = node.first; i < node.first + node.count; i ++)
+    {
+        const int* triangle = indices + m_triangles.at(i) * 3;
+        node.box.expand(points[triangle[0]].pos);
+        node.box.expand(points[triangle[1]].pos);
+        node.box.expand(points[triangle[2]].pos);
+    }
+}
+
+void NihilMeshBvh::refit(const NihilVertex* points, const int* indices)
+{
+    // the children come after their parents
+    for (int i = (int)m_nodes.size() - 1; i >= 0; i --)
+    {
+        Node& node = m_nodes.at(i);
+        if (node.isLeaf())
+        {
+            refitLeaf(node, points, indices);
+            continue;
+        }
+        node.box = m_nodes.at(i + 1).box;
+        node.box.expand(m_nodes.at(node.right).box);
+    }
+}
+
+void NihilMeshBvh::query(const gs::matrix& clipMat, std::vector<int>& triangles) const
+{
+    if (m_nodes.empty())
+        return;
+    gs::vec4 planes[6];
+    nihilExtractClipPlanes(planes, clipMat);
+    struct
+    {
+        int                 node;
+        int                 mask;
+    } stack[NIHIL_BVH_MAX_DEPTH];
+    int top = 0;
+    stack[top].node = 0;
+    stack[top ++].mask = 0x3f;
+    while (top > 0)
+    {
+        top --;
+        int index = stack[top].node;
+        const Node& node = m_nodes.at(index);
+        int mask = stack[top].mask;
+        if (!nihilClassifyBox(node.box, planes, mask))
+            continue;
+        if (!mask || node.isLeaf())
+        {
+            triangles.insert(triangles.end(), m_triangles.begin() + node.first, m_triangles.begin() + node.first + node.count);
+            continue;
+        }
+        ASSERT(top + 2 <= NIHIL_BVH_MAX_DEPTH);
+        stack[top].node = index + 1;
+        stack[top ++].mask = mask;
+        stack[top].node = node.right;
+        stack[top ++].mask = mask;
+    }
+}
+
+// Moller-Trumbore, both sides of the triangle count
+static bool nihilIntersectRayTriangle(const gs::vec3& origin, const gs::vec3& dir, const gs::vec3& p1, const gs::vec3& p2, const gs::vec3& p3, float& distance, float& u, float& v)
+{
+    float e1[3] = { p2.x - p1.x, p2.y - p1.y, p2.z - p1.z };
+    float e2[3] = { p3.x - p1.x, p3.y - p1.y, p3.z - p1.z };
+    float pv[3] = { dir.y * e2[2] - dir.z * e2[1], dir.z * e2[0] - dir.x * e2[2], dir.x * e2[1] - dir.y * e2[0] };
+    float det = e1[0] * pv[0] + e1[1] * pv[1] + e1[2] * pv[2];
+    if (fabsf(det) < FLT_MIN)
+        return false;
+    float rdet = 1.f / det;
+    float tv[3] = { origin.x - p1.x, origin.y - p1.y, origin.z - p1.z };
+    u = (tv[0] * pv[0] + tv[1] * pv[1] + tv[2] * pv[2]) * rdet;
+    if (u < 0.f || u > 1.f)
+        return false;
+    float qv[3] = { tv[1] * e1[2] - tv[2] * e1[1], tv[2] * e1[0] - tv[0] * e1[2], tv[0] * e1[1] - tv[1] * e1[0] };
+    v = (dir.x * qv[0] + dir.y * qv[1] + dir.z * qv[2]) * rdet;
+    if (v < 0.f || u + v > 1.f)
+        return false;
+    distance = (e2[0] * qv[0] + e2[1] * qv[1] + e2[2] * qv[2]) * rdet;
+    return distance >= 0.f;
+}
+
+bool NihilMeshBvh::raycast(const NihilVertex* points, const int* indices, const gs::vec3& origin, const gs::vec3& dir, NihilRayHit& hit) const
+{
+    if (m_nodes.empty())
+        return false;
+    ASSERT(points && indices);
+    gs::vec3 invDir = nihilGetInverseDir(dir);
+    struct
+    {
+        int                 node;
+        float               distance;
+    } stack[NIHIL_BVH_MAX_DEPTH];
+    int top = 0;
+    bool found = false;
+    float distance;
+    if (!nihilIntersectRayBox(m_nodes.front().box, origin, invDir, hit.distance, distance))
+        return false;
+    stack[top].node = 0;
+    stack[top ++].distance = distance;
+    while (top > 0)
+    {
+        top --;
+        // the nearer hits found since pushing this node may prune it now
+        if (stack[top].distance > hit.distance)
+            continue;
+        const Node& node = m_nodes.at(stack[top].node);
+        if (node.isLeaf())
+        {
+            for (int i = node.first; i < node.first + node.count; i ++)
+            {
+                int t = m_triangles.at(i);
+                float u, v;
+                if (nihilIntersectRayTriangle(origin, dir, points[indices[t * 3]].pos, points[indices[t * 3 + 1]].pos, points[indices[t * 3 + 2]].pos, distance, u, v) && distance < hit.distance)
+                {
+                    hit.distance = distance;
+                    hit.triangle = t;
+                    hit.u = u;
+                    hit.v = v;
+                    found = true;
+                }
+            }
+            continue;
+        }
+        // push the farther child first, so the nearer one is visited first
+        int nearNode = stack[top].node + 1, farNode = node.right;
+        float nearDistance, farDistance;
+        bool hitNear = nihilIntersectRayBox(m_nodes.at(nearNode).box, origin, invDir, hit.distance, nearDistance);
+        bool hitFar = nihilIntersectRayBox(m_nodes.at(farNode).box, origin, invDir, hit.distance, farDistance);
+        if (hitNear && hitFar && farDistance < nearDistance)
+        {
+            std::swap(nearNode, farNode);
+            std::swap(nearDistance, farDistance);
+        }
+        else if (!hitNear)
+        {
+            nearNode = farNode;
+            nearDistance = farDistance;
+            hitNear = hitFar;
+            hitFar = false;
+        }
+        ASSERT(top + 2 <= NIHIL_BVH_MAX_DEPTH);
+        if (hitFar)
+        {
+            stack[top].node = farNode;
+            stack[top ++].distance = farDistance;
+        }
+        if (hitNear)
+        {
+            stack[top].node = nearNode;
+            stack[top ++].distance = nearDistance;
+        }
+    }
+    return found;
+}
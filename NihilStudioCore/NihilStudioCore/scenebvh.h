@@ -0,0 +1,122 @@
+#pragma once
+
+#include <float.h>
+#include <vector>
+#include <gslib/math.h>
+
+class NihilObject;
+struct NihilVertex;
+
+struct NihilBoundingBox
+{
+    gs::vec3                minpt = gs::vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+    gs::vec3                maxpt = gs::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+    bool isEmpty() const { return minpt.x > maxpt.x; }
+    void reset();
+    void expand(const gs::vec3& p);
+    void expand(const NihilBoundingBox& box);
+    void transform(const NihilBoundingBox& box, const gs::matrix& m);
+    gs::vec3 getCenter() const;
+};
+
+// the clip planes of (x, y, z, w) = (p, 1) * m, p is inside if dot(plane, (p, 1)) >= 0 for all of them
+extern void nihilExtractClipPlanes(gs::vec4 planes[6], const gs::matrix& m);
+// return false if the box is totally outside, otherwise clear the bits of the planes that the box is totally inside
+extern bool nihilClassifyBox(const NihilBoundingBox& box, const gs::vec4 planes[6], int& mask);
+
+// the ray is p = origin + dir * distance, dir is not normalized, so that the distance stays the same in every space
+struct NihilRayHit
+{
+    float                   distance = FLT_MAX;
+    int                     triangle = -1;
+    float                   u = 0.f;                // the barycentric coordinates of the second and the third point
+    float                   v = 0.f;
+};
+
+struct NihilRayCandidate
+{
+    float                   distance;               // where the ray enters the bounding box
+    NihilObject*            object;
+
+    bool operator<(const NihilRayCandidate& that) const { return distance < that.distance; }
+};
+
+// return false if the ray misses the box before maxDistance, otherwise the distance where it enters the box
+extern bool nihilIntersectRayBox(const NihilBoundingBox& box, const gs::vec3& origin, const gs::vec3& invDir, float maxDistance, float& distance);
+
+/*
+ * Bounding volume hierarchy over the world space bounding boxes of the scene objects.
+ * The objects report their moves with markDirty, the hierarchy refits lazily before culling,
+ * only the branches above the moved leaves are touched.
+ */
+class NihilSceneBvh
+{
+public:
+    void build(const std::vector<NihilObject*>& objects);
+    void clear();
+    void markDirty(int leaf);
+    void refit();
+    void cull(const gs::matrix& viewProj);
+    void query(const gs::matrix& viewProj, std::vector<NihilObject*>& objects) const;     // the objects that may intersect the frustum
+    void raycast(const gs::vec3& origin, const gs::vec3& dir, std::vector<NihilRayCandidate>& candidates) const;   // the objects that may be hit, nearest first
+    int getObjectCount() const { return (int)m_objects.size(); }
+
+protected:
+    struct Node
+    {
+        NihilBoundingBox    box;
+        int                 parent = -1;
+        int                 left = -1;              // the right child always follows the subtree of the left one
+        int                 right = -1;
+        int                 first = 0;              // range in m_objects, the subtree of a node is contiguous
+        int                 count = 0;
+        bool                dirty = false;
+
+        bool isLeaf() const { return left < 0; }
+    };
+    typedef std::vector<Node> NodeList;
+
+    NodeList                m_nodes;                // parents always come before their children
+    std::vector<NihilObject*> m_objects;
+    std::vector<int>        m_dirtyNodes;
+
+protected:
+    int buildNode(int parent, int first, int count);
+    void refitNode(Node& node);
+    void setRangeVisible(const Node& node, bool b);
+};
+
+/*
+ * Bounding volume hierarchy over the triangles of a mesh, in the object space of the mesh, so that it stays valid
+ * whatever the transforms are. Moving the points only refits the boxes, a new index list needs another build.
+ */
+class NihilMeshBvh
+{
+public:
+    void build(const NihilVertex* points, const int* indices, int triangleCount);
+    void refit(const NihilVertex* points, const int* indices);
+    void clear();
+    bool isEmpty() const { return m_nodes.empty(); }
+    void query(const gs::matrix& clipMat, std::vector<int>& triangles) const;   // the triangles that may intersect the frustum
+    bool raycast(const NihilVertex* points, const int* indices, const gs::vec3& origin, const gs::vec3& dir, NihilRayHit& hit) const;  // only a hit nearer than the given one counts
+
+protected:
+    struct Node
+    {
+        NihilBoundingBox    box;
+        int                 right = -1;             // the left child always follows its parent
+        int                 first = 0;              // range in m_triangles
+        int                 count = 0;
+
+        bool isLeaf() const { return right < 0; }
+    };
+    typedef std::vector<Node> NodeList;
+
+    NodeList                m_nodes;
+    std::vector<int>        m_triangles;            // ordered by the leaves
+
+protected:
+    int buildNode(const std::vector<gs::vec3>& centers, const NihilVertex* points, const int* indices, int first, int count);
+    void refitLeaf(Node& node, const NihilVertex* points, const int* indices);
+};
@@ -0,0 +1,78 @@
+#include <assert.h>
+#include "selection.h"
+
+#define ASSERT assert
+
+void NihilSelectionSet::resize(int count)
+{
+    ASSERT(count >= 0);
+    m_bits.resize(count);
+}
+
+void NihilSelectionSet::select(int i, bool b)
+{
+    ASSERT(i >= 0 && i < size());
+    if (m_bits.test(i) == b)
+        return;
+    m_bits.reset(i, b);
+    if (m_listener)
+        m_listener->onElementChanged(this, i);
+}
+
+void NihilSelectionSet::clear()
+{
+    if (!m_bits.any())
+        return;
+    gs::vbitset bits;
+    bits.resize(size());
+    commit(bits);
+}
+
+void NihilSelectionSet::add(const gs::vbitset& bits)
+{
+    ASSERT(bits.size() <= size());
+    gs::vbitset result = m_bits;
+    commit(result.unite(bits));
+}
+
+void NihilSelectionSet::subtract(const gs::vbitset& bits)
+{
+    gs::vbitset result = m_bits;
+    commit(result.subtract(bits));
+}
+
+void NihilSelectionSet::intersect(const gs::vbitset& bits)
+{
+    gs::vbitset result = m_bits;
+    commit(result.intersect(bits));
+}
+
+void NihilSelectionSet::invert()
+{
+    gs::vbitset result = m_bits;
+    commit(result.invert());
+}
+
+void NihilSelectionSet::replace(const gs::vbitset& bits)
+{
+    ASSERT(bits.size() <= size());
+    gs::vbitset result = bits;
+    result.resize(size());
+    commit(result);
+}
+
+void NihilSelectionSet::commit(gs::vbitset& bits)
+{
+    ASSERT(bits.size() == size());
+    if (!m_listener)
+    {
+        m_bits = bits;
+        return;
+    }
+    // the elements that flipped
+    gs::vbitset changed = m_bits;
+    changed.differ(bits);
+    m_bits = bits;
+    if (changed.any())
+        m_listener->onSelectionChanged(this, changed);
+}
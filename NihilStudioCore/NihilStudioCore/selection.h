@@ -0,0 +1,52 @@
+#pragma once
+
+#include <gslib/vbitset.h>
+#include "nihilplatform.h"
+
+class NihilSelectionSet;
+
+class __declspec(novtable) NihilSelectionListener abstract
+{
+public:
+    virtual ~NihilSelectionListener() {}
+    virtual void onSelectionChanged(const NihilSelectionSet* selection, const gs::vbitset& changed) = 0;
+    virtual void onElementChanged(const NihilSelectionSet* selection, int i) = 0;     // a single flip by select
+};
+
+/*
+ * Selection over densely indexed elements (the slots of the object table, or the points of the points layer).
+ * The bulk edits (box, lasso) work on whole bitsets, the listener gets the flipped elements by another bitset.
+ * A single select flips the bit in place and tells the listener the element only, so a click is O(1) not O(n).
+ * A snapshot is simply a copy of the bits.
+ */
+class NihilSelectionSet
+{
+public:
+    typedef gs::vbitset Snapshot;
+
+public:
+    void setListener(NihilSelectionListener* listener) { m_listener = listener; }
+    void resize(int count);             // the new elements are unselected, no notification
+    int size() const { return m_bits.size(); }
+    const gs::vbitset& getBits() const { return m_bits; }
+    bool isSelected(int i) const { return m_bits.test(i); }
+    bool isEmpty() const { return !m_bits.any(); }
+    int getSelectedCount() const { return m_bits.count(); }
+    int findNext(int i) const { return m_bits.find_next(i); }      // iterate the selected ones, -1 at the end
+    void select(int i, bool b = true);
+    void clear();
+    void add(const gs::vbitset& bits);
+    void subtract(const gs::vbitset& bits);
+    void intersect(const gs::vbitset& bits);
+    void invert();
+    void replace(const gs::vbitset& bits);
+    Snapshot snapshot() const { return m_bits; }
+    void restore(const Snapshot& snapshot) { replace(snapshot); }
+
+protected:
+    gs::vbitset             m_bits;
+    NihilSelectionListener* m_listener = nullptr;
+
+protected:
+    void commit(gs::vbitset& bits);
+};
@@ -0,0 +1,565 @@
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <emmintrin.h>
+#include "softrenderer.h"
+
+#define ASSERT assert
+#undef min
+#undef max
+
+#define NIHIL_SOFT_TILE_SIZE        32
+#define NIHIL_SOFT_VERTEX_GRAIN     4096    // vertices of a task
+#define NIHIL_SOFT_TRIANGLE_GRAIN   4096    // triangles of a task
+
+// the clear color of the dx11 renderer
+static const float nihilClearColor[] = { 0.275f, 0.31f, 0.349f };
+
+// the constants of geometry.hlsl
+static const gs::vec3 nihilLightPos(10.f, 10.f, 10.f);
+static const gs::vec3 nihilAmbientColor(0.1f, 0.f, 0.f);
+static const gs::vec3 nihilSpecColor(1.f, 1.f, 1.f);
+static const float nihilShininess = 22.f;
+
+static inline float nihilDot(const gs::vec3& a, const gs::vec3& b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static inline void nihilNormalize(gs::vec3& v)
+{
+    float len = sqrtf(nihilDot(v, v));
+    if (len > 0.f)
+    {
+        float r = 1.f / len;
+        v.x *= r;
+        v.y *= r;
+        v.z *= r;
+    }
+}
+
+// Shade of geometry.hlsl, the position in object space as the shader does
+static gs::vec3 nihilShade(const gs::vec3& pos, gs::vec3 normal, const gs::vec3& diffuse)
+{
+    nihilNormalize(normal);
+    gs::vec3 lightDir(nihilLightPos.x - pos.x, nihilLightPos.y - pos.y, nihilLightPos.z - pos.z);
+    nihilNormalize(lightDir);
+    float lambertian = std::max(nihilDot(lightDir, normal), 0.f);
+    float specular = 0.f;
+    if (lambertian > 0.f)
+    {
+        gs::vec3 viewDir(-pos.x, -pos.y, -pos.z);
+        nihilNormalize(viewDir);
+        gs::vec3 halfDir(lightDir.x + viewDir.x, lightDir.y + viewDir.y, lightDir.z + viewDir.z);
+        nihilNormalize(halfDir);
+        float specAngle = std::max(nihilDot(halfDir, normal), 0.f);
+        specular = powf(specAngle, nihilShininess);
+    }
+    return gs::vec3(
+        nihilAmbientColor.x + lambertian * diffuse.x + specular * nihilSpecColor.x,
+        nihilAmbientColor.y + lambertian * diffuse.y + specular * nihilSpecColor.y,
+        nihilAmbientColor.z + lambertian * diffuse.z + specular * nihilSpecColor.z
+        );
+}
+
+// (p, 1) * m, the row vector convention
+static inline void nihilTransform(gs::vec4& out, const gs::vec3& p, const gs::matrix& m)
+{
+    out.x = p.x * m.m[0][0] + p.y * m.m[1][0] + p.z * m.m[2][0] + m.m[3][0];
+    out.y = p.x * m.m[0][1] + p.y * m.m[1][1] + p.z * m.m[2][1] + m.m[3][1];
+    out.z = p.x * m.m[0][2] + p.y * m.m[1][2] + p.z * m.m[2][2] + m.m[3][2];
+    out.w = p.x * m.m[0][3] + p.y * m.m[1][3] + p.z * m.m[2][3] + m.m[3][3];
+}
+
+// rgba8 in the order of the bytes, saturated as the render target does
+static inline unsigned nihilPackColor(float r, float g, float b)
+{
+    unsigned ir = (unsigned)(std::min(std::max(r, 0.f), 1.f) * 255.f + 0.5f);
+    unsigned ig = (unsigned)(std::min(std::max(g, 0.f), 1.f) * 255.f + 0.5f);
+    unsigned ib = (unsigned)(std::min(std::max(b, 0.f), 1.f) * 255.f + 0.5f);
+    return ir | (ig << 8) | (ib << 16) | 0xff000000;
+}
+
+static inline __m128i nihilPackColors(__m128 r, __m128 g, __m128 b)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 scale = _mm_set1_ps(255.f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    __m128i ir = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_min_ps(_mm_max_ps(r, zero), one), scale), half));
+    __m128i ig = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_min_ps(_mm_max_ps(g, zero), one), scale), half));
+    __m128i ib = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_min_ps(_mm_max_ps(b, zero), one), scale), half));
+    return _mm_or_si128(_mm_or_si128(ir, _mm_slli_epi32(ig, 8)), _mm_or_si128(_mm_slli_epi32(ib, 16), _mm_set1_epi32((int)0xff000000)));
+}
+
+// the part [t0, t1] of p0 + d * t in the box, false if none
+static bool nihilClipSegment(float x0, float y0, float dx, float dy, float left, float top, float right, float bottom, float& t0, float& t1)
+{
+    float p[4] = { -dx, dx, -dy, dy };
+    float q[4] = { x0 - left, right - x0, y0 - top, bottom - y0 };
+    for (int k = 0; k < 4; k ++)
+    {
+        if (p[k] == 0.f)
+        {
+            if (q[k] < 0.f)
+                return false;
+            continue;
+        }
+        float r = q[k] / p[k];
+        if (p[k] < 0.f)
+            t0 = std::max(t0, r);
+        else
+            t1 = std::min(t1, r);
+    }
+    return t0 <= t1;
+}
+
+// make the triangle clockwise on the screen, which is the front face, return false if it is culled
+static bool nihilOrientTriangle(float xs[3], float ys[3], float zs[3], float rws[3], gs::vec3 colors[3], bool cullBack)
+{
+    float area = (xs[1] - xs[0]) * (ys[2] - ys[0]) - (ys[1] - ys[0]) * (xs[2] - xs[0]);
+    if (area > 0.f)     // flip y already make counter clockwised.
+        return true;
+    if (!(area < 0.f) || cullBack)
+        return false;
+    std::swap(xs[1], xs[2]);
+    std::swap(ys[1], ys[2]);
+    std::swap(zs[1], zs[2]);
+    std::swap(rws[1], rws[2]);
+    std::swap(colors[1], colors[2]);
+    return true;
+}
+
+NihilSoftRenderer::NihilSoftRenderer(UINT width, UINT height, NihilThreadPool* threadPool):
+    NihilRecordRenderer(width, height), m_threadPool(threadPool)
+{
+}
+
+bool NihilSoftRenderer::setup(HWND hwnd)
+{
+    if (!m_threadPool)
+    {
+        m_ownThreadPool.setup();
+        m_threadPool = &m_ownThreadPool;
+    }
+    createBuffers();
+    return m_image.is_valid();
+}
+
+void NihilSoftRenderer::notifyResize()
+{
+    createBuffers();
+}
+
+void NihilSoftRenderer::createBuffers()
+{
+    m_width = std::max((int)m_viewWidth, 1);
+    m_height = std::max((int)m_viewHeight, 1);
+    m_pitch = (m_width + 3) & ~3;
+    m_tileColumns = (m_width + NIHIL_SOFT_TILE_SIZE - 1) / NIHIL_SOFT_TILE_SIZE;
+    m_tileRows = (m_height + NIHIL_SOFT_TILE_SIZE - 1) / NIHIL_SOFT_TILE_SIZE;
+    m_colors.assign(m_pitch * m_height, 0);
+    m_depths.assign(m_pitch * m_height, 1.f);
+    m_image.create(gs::pink::image::fmt_rgba, m_width, m_height);
+}
+
+void NihilSoftRenderer::render(const NihilCommandList& commands)
+{
+    ASSERT(m_threadPool && m_image.is_valid() && "Setup before drawing.");
+    // the counts of the frame
+    NihilRecordRenderer::render(commands);
+    // 1.clear
+    std::fill(m_colors.begin(), m_colors.end(), nihilPackColor(nihilClearColor[0], nihilClearColor[1], nihilClearColor[2]));
+    std::fill(m_depths.begin(), m_depths.end(), 1.f);
+    // 2.shade the vertices of all the geometries
+    collectBatches(commands);
+    int vertexCount = m_batches.empty() ? 0 : m_batches.back().firstVertex + m_batches.back().vertexCount;
+    int triangleCount = m_batches.empty() ? 0 : m_batches.back().firstTriangle + m_batches.back().triangleCount;
+    m_vertices.resize(vertexCount);
+    m_threadPool->parallelFor(vertexCount, NIHIL_SOFT_VERTEX_GRAIN, [this](int first, int last) {
+        shadeVertices(first, last);
+    });
+    // 3.setup the triangles in screen space
+    m_setups.resize(triangleCount * 2);
+    m_threadPool->parallelFor(triangleCount, NIHIL_SOFT_TRIANGLE_GRAIN, [this](int first, int last) {
+        setupTriangles(first, last);
+    });
+    // 4.bin them to the tiles and rasterize the tiles
+    binTriangles();
+    m_threadPool->parallelFor(m_tileColumns * m_tileRows, 1, [this](int first, int last) {
+        for (int t = first; t < last; t ++)
+            rasterizeTile(t);
+    });
+    // 5.the ui objects over them
+    for (const NihilDrawPacket& packet : commands.getPackets())
+    {
+        if (packet.getPass() == NihilDrawPacket::Pass_UI)
+            drawUIObject(static_cast<const NihilRecordUIObject*>(packet.uiObject));
+    }
+    resolveImage();
+}
+
+void NihilSoftRenderer::collectBatches(const NihilCommandList& commands)
+{
+    m_batches.clear();
+    int vertexCount = 0;
+    int triangleCount = 0;
+    for (const NihilDrawPacket& packet : commands.getPackets())
+    {
+        if (packet.getPass() == NihilDrawPacket::Pass_UI)
+            continue;
+        auto* geometry = static_cast<const NihilRecordGeometry*>(packet.geometry);
+        ASSERT(geometry);
+        const NihilRecordMesh* mesh = geometry->getMesh();
+        int level = packet.getLevel();
+        const NihilIndexList& indices = level ? mesh->lodIndices.at(level - 1) : mesh->indices;
+        if (mesh->vertices.empty() || indices.size() < 3)
+            continue;
+        Batch batch;
+        batch.vertices = &mesh->vertices.front();
+        batch.indices = &indices.front();
+        batch.firstVertex = vertexCount;
+        batch.vertexCount = (int)mesh->vertices.size();
+        batch.firstTriangle = triangleCount;
+        batch.triangleCount = (int)indices.size() / 3;
+        batch.mvp = packet.mvp;
+        batch.diffuseColor = nihilGetDiffuseColor(packet.material);
+        m_batches.push_back(batch);
+        vertexCount += batch.vertexCount;
+        triangleCount += batch.triangleCount;
+    }
+}
+
+void NihilSoftRenderer::shadeVertices(int first, int last)
+{
+    // the batch of the first vertex, then walk on through the following ones
+    auto batch = std::upper_bound(m_batches.begin(), m_batches.end(), first, [](int i, const Batch& b)-> bool {
+        return i < b.firstVertex;
+    }) - 1;
+    for (int i = first; i < last; ++ batch)
+    {
+        int end = std::min(last, batch->firstVertex + batch->vertexCount);
+        for (; i < end; i ++)
+        {
+            const NihilVertex& v = batch->vertices[i - batch->firstVertex];
+            Vertex& out = m_vertices[i];
+            nihilTransform(out.clip, v.pos, batch->mvp);
+            out.color = nihilShade(v.pos, v.normal, batch->diffuseColor);
+        }
+    }
+}
+
+void NihilSoftRenderer::setupTriangles(int first, int last)
+{
+    bool cullBack = !m_wireframe;
+    float width = (float)m_width, height = (float)m_height;
+    auto setupScreenTriangle = [&](Triangle& setup, const Vertex& v0, const Vertex& v1, const Vertex& v2) {
+        const Vertex* vs[3] = { &v0, &v1, &v2 };
+        for (int k = 0; k < 3; k ++)
+        {
+            const gs::vec4& clip = vs[k]->clip;
+            float rw = 1.f / clip.w;
+            setup.xs[k] = (clip.x * rw + 1.f) * 0.5f * width;
+            setup.ys[k] = (1.f - clip.y * rw) * 0.5f * height;
+            setup.zs[k] = clip.z * rw;
+            setup.rws[k] = rw;
+            setup.colors[k] = gs::vec3(vs[k]->color.x * rw, vs[k]->color.y * rw, vs[k]->color.z * rw);
+        }
+        if (!nihilOrientTriangle(setup.xs, setup.ys, setup.zs, setup.rws, setup.colors, cullBack))
+            return;
+        float left = std::min(std::min(setup.xs[0], setup.xs[1]), setup.xs[2]);
+        float right = std::max(std::max(setup.xs[0], setup.xs[1]), setup.xs[2]);
+        float top = std::min(std::min(setup.ys[0], setup.ys[1]), setup.ys[2]);
+        float bottom = std::max(std::max(setup.ys[0], setup.ys[1]), setup.ys[2]);
+        if (right < 0.f || bottom < 0.f || left >= width || top >= height)
+            return;
+        setup.valid = true;
+    };
+    auto batch = std::upper_bound(m_batches.begin(), m_batches.end(), first, [](int i, const Batch& b)-> bool {
+        return i < b.firstTriangle;
+    }) - 1;
+    for (int t = first; t < last; ++ batch)
+    {
+        int end = std::min(last, batch->firstTriangle + batch->triangleCount);
+        for (; t < end; t ++)
+        {
+            Triangle& setup0 = m_setups[t * 2];
+            Triangle& setup1 = m_setups[t * 2 + 1];
+            setup0.valid = setup1.valid = false;
+            const int* triangle = batch->indices + (t - batch->firstTriangle) * 3;
+            const Vertex* vs[3];
+            int inside = 0;
+            for (int k = 0; k < 3; k ++)
+            {
+                vs[k] = &m_vertices[batch->firstVertex + triangle[k]];
+                if (vs[k]->clip.z >= 0.f)
+                    inside ++;
+            }
+            if (inside == 3)
+            {
+                setupScreenTriangle(setup0, *vs[0], *vs[1], *vs[2]);
+                continue;
+            }
+            if (!inside)
+                continue;
+            // cut by the near plane z = 0, the rest is a triangle or a quad
+            Vertex clipped[4];
+            int count = 0;
+            for (int k = 0; k < 3; k ++)
+            {
+                const Vertex& cur = *vs[k];
+                const Vertex& next = *vs[(k + 1) % 3];
+                if (cur.clip.z >= 0.f)
+                    clipped[count ++] = cur;
+                if ((cur.clip.z >= 0.f) != (next.clip.z >= 0.f))
+                {
+                    float s = cur.clip.z / (cur.clip.z - next.clip.z);
+                    Vertex& v = clipped[count ++];
+                    v.clip.x = cur.clip.x + (next.clip.x - cur.clip.x) * s;
+                    v.clip.y = cur.clip.y + (next.clip.y - cur.clip.y) * s;
+                    v.clip.z = 0.f;
+                    v.clip.w = cur.clip.w + (next.clip.w - cur.clip.w) * s;
+                    v.color.x = cur.color.x + (next.color.x - cur.color.x) * s;
+                    v.color.y = cur.color.y + (next.color.y - cur.color.y) * s;
+                    v.color.z = cur.color.z + (next.color.z - cur.color.z) * s;
+                }
+            }
+            ASSERT(count == 3 || count == 4);
+            setupScreenTriangle(setup0, clipped[0], clipped[1], clipped[2]);
+            if (count == 4)
+                setupScreenTriangle(setup1, clipped[0], clipped[2], clipped[3]);
+        }
+    }
+}
+
+void NihilSoftRenderer::getTileRange(const Triangle& setup, int& c0, int& c1, int& r0, int& r1) const
+{
+    float left = std::min(std::min(setup.xs[0], setup.xs[1]), setup.xs[2]);
+    float right = std::max(std::max(setup.xs[0], setup.xs[1]), setup.xs[2]);
+    float top = std::min(std::min(setup.ys[0], setup.ys[1]), setup.ys[2]);
+    float bottom = std::max(std::max(setup.ys[0], setup.ys[1]), setup.ys[2]);
+    c0 = (int)std::max(left, 0.f) / NIHIL_SOFT_TILE_SIZE;
+    c1 = (int)std::min(right, (float)(m_width - 1)) / NIHIL_SOFT_TILE_SIZE;
+    r0 = (int)std::max(top, 0.f) / NIHIL_SOFT_TILE_SIZE;
+    r1 = (int)std::min(bottom, (float)(m_height - 1)) / NIHIL_SOFT_TILE_SIZE;
+}
+
+void NihilSoftRenderer::binTriangles()
+{
+    // counting sort by the tiles the boxes overlap, a triangle is in the order of the command list in each bin
+    int tileCount = m_tileColumns * m_tileRows;
+    m_binStarts.assign(tileCount + 1, 0);
+    int c0, c1, r0, r1;
+    for (const Triangle& setup : m_setups)
+    {
+        if (!setup.valid)
+            continue;
+        getTileRange(setup, c0, c1, r0, r1);
+        for (int r = r0; r <= r1; r ++)
+        {
+            for (int c = c0; c <= c1; c ++)
+                m_binStarts[r * m_tileColumns + c + 1] ++;
+        }
+    }
+    for (int t = 0; t < tileCount; t ++)
+        m_binStarts[t + 1] += m_binStarts[t];
+    std::vector<int> cursors(m_binStarts.begin(), m_binStarts.end() - 1);
+    m_bins.resize(m_binStarts.back());
+    for (int i = 0; i < (int)m_setups.size(); i ++)
+    {
+        const Triangle& setup = m_setups[i];
+        if (!setup.valid)
+            continue;
+        getTileRange(setup, c0, c1, r0, r1);
+        for (int r = r0; r <= r1; r ++)
+        {
+            for (int c = c0; c <= c1; c ++)
+                m_bins[cursors[r * m_tileColumns + c] ++] = i;
+        }
+    }
+}
+
+void NihilSoftRenderer::rasterizeTile(int tile)
+{
+    int tileLeft = tile % m_tileColumns * NIHIL_SOFT_TILE_SIZE;
+    int tileTop = tile / m_tileColumns * NIHIL_SOFT_TILE_SIZE;
+    int tileRight = std::min(tileLeft + NIHIL_SOFT_TILE_SIZE, m_width) - 1;
+    int tileBottom = std::min(tileTop + NIHIL_SOFT_TILE_SIZE, m_height) - 1;
+    for (int b = m_binStarts[tile]; b < m_binStarts[tile + 1]; b ++)
+    {
+        const Triangle& setup = m_setups[m_bins[b]];
+        if (!m_wireframe)
+        {
+            fillTriangle(setup, tileLeft, tileTop, tileRight, tileBottom, true);
+            continue;
+        }
+        drawLine(setup, 0, 1, tileLeft, tileTop, tileRight, tileBottom, true);
+        drawLine(setup, 1, 2, tileLeft, tileTop, tileRight, tileBottom, true);
+        drawLine(setup, 2, 0, tileLeft, tileTop, tileRight, tileBottom, true);
+    }
+}
+
+void NihilSoftRenderer::fillTriangle(const Triangle& setup, int left, int top, int right, int bottom, bool depthTest)
+{
+    const float* xs = setup.xs;
+    const float* ys = setup.ys;
+    // the box of the triangle clipped by the given one, sampled at the centers of the pixels
+    left = (int)std::max(floorf(std::min(std::min(xs[0], xs[1]), xs[2])), (float)left);
+    right = (int)std::min(ceilf(std::max(std::max(xs[0], xs[1]), xs[2])), (float)right);
+    top = (int)std::max(floorf(std::min(std::min(ys[0], ys[1]), ys[2])), (float)top);
+    bottom = (int)std::min(ceilf(std::max(std::max(ys[0], ys[1]), ys[2])), (float)bottom);
+    if (left > right || top > bottom)
+        return;
+    // the groups of 4 pixels align to the pitch, so they never cross the tiles, which align as well
+    left &= ~3;
+    // edge functions, e[k] is the edge opposite to the kth vertex, the attributes are the planes of them
+    float area = (xs[1] - xs[0]) * (ys[2] - ys[0]) - (ys[1] - ys[0]) * (xs[2] - xs[0]);
+    float rarea = 1.f / area;
+    float px = left + 0.5f, py = top + 0.5f;
+    const __m128 lanes = _mm_setr_ps(0.f, 1.f, 2.f, 3.f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.f);
+    __m128 rowEdges[3], stepX[3], stepY[3], zs[3], rws[3], rs[3], gs[3], bs[3];
+    for (int k = 0; k < 3; k ++)
+    {
+        int i = (k + 1) % 3, j = (k + 2) % 3;
+        float dx = -(ys[j] - ys[i]);
+        float dy = xs[j] - xs[i];
+        float e = (xs[j] - xs[i]) * (py - ys[i]) - (ys[j] - ys[i]) * (px - xs[i]);
+        rowEdges[k] = _mm_add_ps(_mm_set1_ps(e), _mm_mul_ps(_mm_set1_ps(dx), lanes));
+        stepX[k] = _mm_set1_ps(dx * 4.f);
+        stepY[k] = _mm_set1_ps(dy);
+        zs[k] = _mm_set1_ps(setup.zs[k] * rarea);
+        rws[k] = _mm_set1_ps(setup.rws[k]);
+        rs[k] = _mm_set1_ps(setup.colors[k].x);
+        gs[k] = _mm_set1_ps(setup.colors[k].y);
+        bs[k] = _mm_set1_ps(setup.colors[k].z);
+    }
+    for (int y = top; y <= bottom; y ++)
+    {
+        __m128 e0 = rowEdges[0], e1 = rowEdges[1], e2 = rowEdges[2];
+        int row = y * m_pitch;
+        for (int x = left; x <= right; x += 4)
+        {
+            __m128 mask = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+            if (_mm_movemask_ps(mask))
+            {
+                float* depths = &m_depths[row + x];
+                __m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e0, zs[0]), _mm_mul_ps(e1, zs[1])), _mm_mul_ps(e2, zs[2]));
+                __m128 depth = _mm_loadu_ps(depths);
+                if (depthTest)
+                    mask = _mm_and_ps(mask, _mm_cmplt_ps(z, depth));
+                if (_mm_movemask_ps(mask))
+                {
+                    // perspective correct, the colors over w divided by 1/w, where the area cancels
+                    __m128 w = _mm_div_ps(one, _mm_add_ps(_mm_add_ps(_mm_mul_ps(e0, rws[0]), _mm_mul_ps(e1, rws[1])), _mm_mul_ps(e2, rws[2])));
+                    __m128 r = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e0, rs[0]), _mm_mul_ps(e1, rs[1])), _mm_mul_ps(e2, rs[2])), w);
+                    __m128 g = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e0, gs[0]), _mm_mul_ps(e1, gs[1])), _mm_mul_ps(e2, gs[2])), w);
+                    __m128 b = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e0, bs[0]), _mm_mul_ps(e1, bs[1])), _mm_mul_ps(e2, bs[2])), w);
+                    __m128i colorMask = _mm_castps_si128(mask);
+                    __m128i* colors = (__m128i*)&m_colors[row + x];
+                    __m128i oldColors = _mm_loadu_si128(colors);
+                    _mm_storeu_si128(colors, _mm_or_si128(_mm_and_si128(colorMask, nihilPackColors(r, g, b)), _mm_andnot_si128(colorMask, oldColors)));
+                    if (depthTest)
+                        _mm_storeu_ps(depths, _mm_or_ps(_mm_and_ps(mask, z), _mm_andnot_ps(mask, depth)));
+                }
+            }
+            e0 = _mm_add_ps(e0, stepX[0]);
+            e1 = _mm_add_ps(e1, stepX[1]);
+            e2 = _mm_add_ps(e2, stepX[2]);
+        }
+        rowEdges[0] = _mm_add_ps(rowEdges[0], stepY[0]);
+        rowEdges[1] = _mm_add_ps(rowEdges[1], stepY[1]);
+        rowEdges[2] = _mm_add_ps(rowEdges[2], stepY[2]);
+    }
+}
+
+void NihilSoftRenderer::drawLine(const Triangle& setup, int a, int b, int left, int top, int right, int bottom, bool depthTest)
+{
+    float x0 = setup.xs[a], y0 = setup.ys[a];
+    float dx = setup.xs[b] - x0, dy = setup.ys[b] - y0;
+    // count the steps over the whole line, so that the tiles draw the same pixels as a single pass would
+    int steps = std::max((int)ceilf(std::max(fabsf(dx), fabsf(dy))), 1);
+    float t0 = 0.f, t1 = 1.f;
+    if (!nihilClipSegment(x0, y0, dx, dy, (float)left - 1.f, (float)top - 1.f, (float)right + 2.f, (float)bottom + 2.f, t0, t1))
+        return;
+    int first = (int)floorf(t0 * steps);
+    int last = std::min((int)ceilf(t1 * steps), steps);
+    for (int s = first; s <= last; s ++)
+    {
+        float t = (float)s / steps;
+        int x = (int)floorf(x0 + dx * t);
+        int y = (int)floorf(y0 + dy * t);
+        if (x < left || x > right || y < top || y > bottom)
+            continue;
+        int p = y * m_pitch + x;
+        float z = setup.zs[a] + (setup.zs[b] - setup.zs[a]) * t;
+        if (depthTest && !(z < m_depths[p]))
+            continue;
+        float w = 1.f / (setup.rws[a] + (setup.rws[b] - setup.rws[a]) * t);
+        const gs::vec3& ca = setup.colors[a];
+        const gs::vec3& cb = setup.colors[b];
+        m_colors[p] = nihilPackColor((ca.x + (cb.x - ca.x) * t) * w, (ca.y + (cb.y - ca.y) * t) * w, (ca.z + (cb.z - ca.z) * t) * w);
+        if (depthTest)
+            m_depths[p] = z;
+    }
+}
+
+void NihilSoftRenderer::drawUIObject(const NihilRecordUIObject* uiObject)
+{
+    ASSERT(uiObject);
+    // the ui vertices are in the pixels of the view, drawn over the geometries without the depth test
+    const std::vector<NihilUIVertex>& vertices = uiObject->getVertices();
+    const NihilIndexList& indices = uiObject->getIndices();
+    if (vertices.empty())
+        return;
+    int count = uiObject->getIndicesCount();
+    auto getVertex = [&](int i)-> const NihilUIVertex& { return vertices.at(indices.empty() ? i : indices.at(i)); };
+    Triangle setup;
+    auto setVertex = [&](int k, const NihilUIVertex& v) {
+        setup.xs[k] = v.pos.x;
+        setup.ys[k] = v.pos.y;
+        setup.zs[k] = 0.f;
+        setup.rws[k] = 1.f;
+        setup.colors[k] = gs::vec3(v.color.x, v.color.y, v.color.z);
+    };
+    switch (uiObject->getTopology())
+    {
+    case NihilUIObject::Topo_Points:
+        for (int i = 0; i < count; i ++)
+        {
+            const NihilUIVertex& v = getVertex(i);
+            int x = (int)floorf(v.pos.x), y = (int)floorf(v.pos.y);
+            if (x >= 0 && y >= 0 && x < m_width && y < m_height)
+                m_colors[y * m_pitch + x] = nihilPackColor(v.color.x, v.color.y, v.color.z);
+        }
+        break;
+    case NihilUIObject::Topo_LineList:
+        for (int i = 0; i + 1 < count; i += 2)
+        {
+            setVertex(0, getVertex(i));
+            setVertex(1, getVertex(i + 1));
+            drawLine(setup, 0, 1, 0, 0, m_width - 1, m_height - 1, false);
+        }
+        break;
+    case NihilUIObject::Topo_TriangleList:
+        for (int i = 0; i + 2 < count; i += 3)
+        {
+            for (int k = 0; k < 3; k ++)
+                setVertex(k, getVertex(i + k));
+            if (nihilOrientTriangle(setup.xs, setup.ys, setup.zs, setup.rws, setup.colors, false))
+                fillTriangle(setup, 0, 0, m_width - 1, m_height - 1, false);
+        }
+        break;
+    default:
+        ASSERT(!"Unexpected topology.");
+        break;
+    }
+}
+
+void NihilSoftRenderer::resolveImage()
+{
+    for (int y = 0; y < m_height; y ++)
+        memcpy(m_image.get_data(0, y), &m_colors[y * m_pitch], sizeof(unsigned) * m_width);
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "recordrenderer.h"
+#include "threadpool.h"
+#include <pink/image.h>
+
+/*
+ * Renderer on the CPU, for the thumbnails and the turntables of the nodes without any GPU.
+ * The recording renderer keeps the streams, each frame draws into a pink image in these steps:
+ * the vertices are shaded as geometry.hlsl does, the triangles are clipped by the near plane and set up in screen space,
+ * then binned to the tiles, and the tiles rasterize over the thread pool, 4 pixels at a time by the edge functions,
+ * each one touched by a single thread. The ui objects draw over them at last.
+ */
+class NihilSoftRenderer :
+    public NihilRecordRenderer
+{
+public:
+    NihilSoftRenderer(UINT width, UINT height, NihilThreadPool* threadPool = nullptr);     // own a pool if not given
+    virtual bool setup(HWND hwnd) override;
+    virtual void render(const NihilCommandList& commands) override;
+    virtual void notifyResize() override;           // create the buffers again by the view size
+
+public:
+    const gs::pink::image& getImage() const { return m_image; }     // rgba, from the top row
+    float getDepth(int x, int y) const { return m_depths.at(y * m_pitch + x); }
+
+protected:
+    // a draw of the mesh streams, the vertices and the triangles of all the batches are numbered in a row
+    struct Batch
+    {
+        const NihilVertex*  vertices;
+        const int*          indices;
+        int                 firstVertex;
+        int                 vertexCount;
+        int                 firstTriangle;
+        int                 triangleCount;
+        gs::matrix          mvp;
+        gs::vec3            diffuseColor;
+    };
+
+    struct Vertex
+    {
+        gs::vec4            clip;                   // in clip space
+        gs::vec3            color;
+    };
+
+    // in the pixels, the colors are divided by w, so that they interpolate linearly with 1/w
+    struct Triangle
+    {
+        float               xs[3];
+        float               ys[3];
+        float               zs[3];
+        float               rws[3];
+        gs::vec3            colors[3];
+        bool                valid;
+    };
+
+    NihilThreadPool*        m_threadPool = nullptr;
+    NihilThreadPool         m_ownThreadPool;
+    gs::pink::image         m_image;
+    int                     m_width = 0;
+    int                     m_height = 0;
+    int                     m_pitch = 0;            // in pixels, padded to the groups of 4
+    int                     m_tileColumns = 0;
+    int                     m_tileRows = 0;
+    std::vector<unsigned>   m_colors;
+    std::vector<float>      m_depths;
+    std::vector<Batch>      m_batches;
+    std::vector<Vertex>     m_vertices;
+    std::vector<Triangle>   m_setups;               // 2 for each triangle, as the near plane may cut it into 2
+    std::vector<int>        m_binStarts;            // the bin of tile t is [m_binStarts[t], m_binStarts[t + 1]) of m_bins
+    std::vector<int>        m_bins;
+
+protected:
+    void createBuffers();
+    void collectBatches(const NihilCommandList& commands);
+    void shadeVertices(int first, int last);
+    void setupTriangles(int first, int last);
+    void getTileRange(const Triangle& setup, int& c0, int& c1, int& r0, int& r1) const;
+    void binTriangles();
+    void rasterizeTile(int tile);
+    void fillTriangle(const Triangle& setup, int left, int top, int right, int bottom, bool depthTest);
+    void drawLine(const Triangle& setup, int a, int b, int left, int top, int right, int bottom, bool depthTest);
+    void drawUIObject(const NihilRecordUIObject* uiObject);
+    void resolveImage();
+};
@@ -0,0 +1,87 @@
+#include <assert.h>
+#include <algorithm>
+#include "threadpool.h"
+
+#define ASSERT assert
+#undef min
+#undef max
+
+void NihilThreadPool::setup(int workers)
+{
+    ASSERT(m_workers.empty() && "DONOT setup twice.");
+    if (workers < 0)
+        workers = std::max((int)std::thread::hardware_concurrency() - 1, 0);
+    m_quit = false;
+    m_next = 0;
+    for (int i = 0; i < workers; i ++)
+        m_workers.push_back(std::thread(&NihilThreadPool::workerProc, this));
+}
+
+void NihilThreadPool::destroy()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_wakeup.notify_all();
+    for (auto& t : m_workers)
+        t.join();
+    m_workers.clear();
+}
+
+void NihilThreadPool::parallelFor(int count, int grain, const RangeTask& task)
+{
+    if (count <= 0)
+        return;
+    grain = std::max(grain, 1);
+    if (m_workers.empty() || count <= grain)
+    {
+        task(0, count);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ASSERT(!m_task && "Nested loops were not supported.");
+        m_task = &task;
+        m_count = count;
+        m_grain = grain;
+        m_next = 0;
+        m_busyWorkers = (int)m_workers.size();
+        m_generation ++;
+    }
+    m_wakeup.notify_all();
+    runChunks();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_finished.wait(lock, [this]()-> bool { return !m_busyWorkers; });
+    m_task = nullptr;
+}
+
+void NihilThreadPool::runChunks()
+{
+    for (;;)
+    {
+        int first = m_next.fetch_add(m_grain);
+        if (first >= m_count)
+            return;
+        (*m_task)(first, std::min(first + m_grain, m_count));
+    }
+}
+
+void NihilThreadPool::workerProc()
+{
+    unsigned generation = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wakeup.wait(lock, [&]()-> bool { return m_quit || m_generation != generation; });
+            if (m_quit)
+                return;
+            generation = m_generation;
+        }
+        runChunks();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!-- m_busyWorkers)
+            m_finished.notify_one();
+    }
+}
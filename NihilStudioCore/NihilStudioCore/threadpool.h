@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+/*
+ * A few worker threads for the data parallel loops, owned by the core so that they are joined before the exit.
+ * A loop splits into chunks taken by an atomic counter, the calling thread takes part as well.
+ * Only one loop runs at a time, DONOT start another one inside the tasks.
+ */
+class NihilThreadPool
+{
+public:
+    typedef std::function<void(int first, int last)> RangeTask;
+
+public:
+    ~NihilThreadPool() { destroy(); }
+    void setup(int workers = -1);                   // -1 for one less than the hardware threads
+    void destroy();
+    int getWorkerCount() const { return (int)m_workers.size(); }
+    void parallelFor(int count, int grain, const RangeTask& task);
+
+protected:
+    std::vector<std::thread> m_workers;
+    std::mutex              m_mutex;
+    std::condition_variable m_wakeup;
+    std::condition_variable m_finished;
+    const RangeTask*        m_task = nullptr;
+    int                     m_count = 0;
+    int                     m_grain = 1;
+    std::atomic<int>        m_next;
+    int                     m_busyWorkers = 0;
+    unsigned                m_generation = 0;       // bumped by each loop, the workers wait for it
+    bool                    m_quit = false;
+
+protected:
+    void workerProc();
+    void runChunks();
+};
@@ -0,0 +1,143 @@
+#include <assert.h>
+#include <thread>
+#include <algorithm>
+#include <gslib/file.h>
+#include <pink/imageio.h>
+#include "thumbnailbatch.h"
+
+#define ASSERT assert
+#undef min
+#undef max
+
+#define NIHIL_THUMBNAIL_MIN_NEAR 0.01f
+
+bool nihilReadSceneFile(const NihilString& path, NihilString& src)
+{
+    gs::file f(path.c_str(), _t("rb"));
+    if (!f.is_valid())
+        return false;
+    int size = f.size();
+    if (size <= 0)
+        return false;
+    std::unique_ptr<gs::byte[]> buf(new gs::byte[size]);
+    if (f.get(buf.get(), size) != size)
+        return false;
+    // the scene files are in ascii
+    src.resize(size);
+    for (int i = 0; i < size; i ++)
+        src.at(i) = (gs::gchar)buf[i];
+    return true;
+}
+
+bool NihilThumbnailBatch::setup(const NihilThumbnailOptions& options)
+{
+    ASSERT(m_slots.empty() && "DONOT setup twice.");
+    ASSERT(options.width > 0 && options.height > 0 && options.angles > 0);
+    m_options = options;
+    int threadsPerScene = std::max(options.threadsPerScene, 1);
+    int scenes = options.scenes;
+    if (scenes <= 0)
+        scenes = std::max((int)std::thread::hardware_concurrency() / threadsPerScene, 1);
+    for (int i = 0; i < scenes; i ++)
+    {
+        std::unique_ptr<Slot> slot(new Slot);
+        // the loops of the core and the rasterizer never overlap, so they share the threads
+        slot->renderer = new NihilSoftRenderer(options.width, options.height, &slot->core.getThreadPool());
+        if (!slot->core.setupHeadless(slot->renderer, threadsPerScene - 1))
+        {
+            destroy();
+            return false;
+        }
+        if (options.wireframe)
+            slot->core.showWireframeMode();
+        m_slots.push_back(std::move(slot));
+    }
+    return true;
+}
+
+void NihilThumbnailBatch::destroy()
+{
+    for (auto& slot : m_slots)
+        slot->core.destroy();
+    m_slots.clear();
+}
+
+int NihilThumbnailBatch::run(NihilThumbnailJobList& jobs)
+{
+    ASSERT(!m_slots.empty() && "Setup before running.");
+    m_nextJob = 0;
+    int count = std::min((int)m_slots.size(), (int)jobs.size());
+    if (count <= 1)
+    {
+        if (count)
+            runSlot(*m_slots.front(), jobs);
+    }
+    else
+    {
+        std::vector<std::thread> threads;
+        for (int i = 0; i < count; i ++)
+            threads.push_back(std::thread(&NihilThumbnailBatch::runSlot, this, std::ref(*m_slots.at(i)), std::ref(jobs)));
+        for (auto& t : threads)
+            t.join();
+    }
+    int succeeded = 0;
+    for (const auto& job : jobs)
+    {
+        if (job.succeeded)
+            succeeded ++;
+    }
+    return succeeded;
+}
+
+void NihilThumbnailBatch::runSlot(Slot& slot, NihilThumbnailJobList& jobs)
+{
+    for (;;)
+    {
+        int i = m_nextJob.fetch_add(1);
+        if (i >= (int)jobs.size())
+            return;
+        NihilThumbnailJob& job = jobs.at(i);
+        job.images = 0;
+        job.succeeded = runJob(slot, job);
+    }
+}
+
+bool NihilThumbnailBatch::runJob(Slot& slot, NihilThumbnailJob& job)
+{
+    // 1.load the scene, which removes the objects of the last one
+    double startTime = nihilGetMilliseconds();
+    NihilString src;
+    if (!nihilReadSceneFile(job.scenePath, src))
+        return false;
+    slot.core.clearScene();
+    if (!slot.core.loadFromTextStream(src))
+        return false;
+    NihilBoundingBox box;
+    if (!slot.core.getSceneBoundingBox(box))
+        return false;
+    double loadedTime = nihilGetMilliseconds();
+    job.loadTime = loadedTime - startTime;
+    // 2.frame the bounding sphere, then turn around it
+    gs::vec3 center = box.getCenter();
+    gs::vec3 diagonal;
+    diagonal.sub(box.maxpt, box.minpt);
+    float radius = std::max(diagonal.length() * 0.5f, 1e-3f) * m_options.margin;
+    NihilSceneConfig& sceneConfig = slot.core.getSceneConfig();
+    float distance = sceneConfig.calcFitDistance(radius, m_options.width, m_options.height);
+    // the depth only spans the sphere, so the small or the big scenes neither clip nor lose the precision
+    sceneConfig.setDepthRange(std::max(distance - radius, NIHIL_THUMBNAIL_MIN_NEAR), distance + radius);
+    sceneConfig.updateProjMatrix(m_options.width, m_options.height);
+    for (int i = 0; i < m_options.angles; i ++)
+    {
+        sceneConfig.setupOrbit(PI * 2.f * i / m_options.angles, m_options.elevation, distance, center);
+        slot.core.invalidate();
+        slot.core.render();
+        NihilString path;
+        path.format(_t("%s_%02d.bmp"), job.outputPrefix.c_str(), i);
+        if (!gs::pink::imageio::save_bmp_image(slot.renderer->getImage(), path))
+            return false;
+        job.images ++;
+    }
+    job.renderTime = nihilGetMilliseconds() - loadedTime;
+    return true;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include "softrenderer.h"
+
+struct NihilThumbnailOptions
+{
+    int                     width = 256;
+    int                     height = 256;
+    int                     angles = 8;             // around the y axis, evenly
+    float                   elevation = 0.4f;       // the second rotation of the camera
+    float                   margin = 1.1f;          // of the bounding sphere
+    int                     scenes = -1;            // loaded at the same time, -1 for the hardware threads
+    int                     threadsPerScene = 1;    // shared by the loading and the rasterizer of a scene
+    bool                    wireframe = false;
+};
+
+struct NihilThumbnailJob
+{
+    NihilString             scenePath;
+    NihilString             outputPrefix;           // the images are saved as <prefix>_<angle>.bmp
+    bool                    succeeded = false;
+    int                     images = 0;
+    double                  loadTime = 0.0;         // in milliseconds
+    double                  renderTime = 0.0;
+};
+typedef std::vector<NihilThumbnailJob> NihilThumbnailJobList;
+
+/*
+ * Renders the thumbnails and the turntables of many scene files on the CPU.
+ * A few slots run at the same time, each one takes the next job by an atomic counter, loads the scene into its own
+ * headless core and renders all the angles of it, so that a scene loads only once.
+ * The slots keep the cores, the software renderers and their buffers and threads for the following jobs.
+ */
+class NihilThumbnailBatch
+{
+public:
+    NihilThumbnailBatch() {}
+    NihilThumbnailBatch(const NihilThumbnailBatch&) = delete;
+    NihilThumbnailBatch& operator=(const NihilThumbnailBatch&) = delete;
+    ~NihilThumbnailBatch() { destroy(); }
+    bool setup(const NihilThumbnailOptions& options);
+    void destroy();
+    int run(NihilThumbnailJobList& jobs);          // return the count of the succeeded jobs
+    int getSlotCount() const { return (int)m_slots.size(); }
+
+protected:
+    struct Slot
+    {
+        NihilCore           core;
+        NihilSoftRenderer*  renderer = nullptr;     // owned by the core
+    };
+
+    NihilThumbnailOptions   m_options;
+    std::vector<std::unique_ptr<Slot>> m_slots;
+    std::atomic<int>        m_nextJob;
+
+protected:
+    void runSlot(Slot& slot, NihilThumbnailJobList& jobs);
+    bool runJob(Slot& slot, NihilThumbnailJob& job);
+};
+
+extern bool nihilReadSceneFile(const NihilString& path, NihilString& src);
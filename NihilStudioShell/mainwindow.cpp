@@ -6,6 +6,7 @@
 #include <qfiledialog.h>
 
 #define NIHIL_CLIENT_PADDING    1
+#define NIHIL_AUTOSAVE_INTERVAL 60000.0     // in milliseconds
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
@@ -21,8 +22,10 @@ MainWindow::MainWindow(QWidget *parent) :
     f->setUpdatesEnabled(false);
     WId wid = f->winId();
     m_core.setup((HWND)wid);
+    // poll at the display refresh; the core skips frames that have nothing to draw
     QObject::connect(&m_idleTimer, SIGNAL(timeout()), this, SLOT(onIdle()));
-    m_idleTimer.start(0);
+    m_idleTimer.setTimerType(Qt::PreciseTimer);
+    m_idleTimer.start(qMax((int)m_core.getFrameInterval(), 1));
 }
 
 MainWindow::~MainWindow()
@@ -48,8 +51,14 @@ void MainWindow::on_actionOpen_triggered(bool)
         return;
     wchar_t* pWchar = new wchar_t[src.length()];
     src.toWCharArray(pWchar);
-    m_core.loadFromTextStream(gs::string(pWchar));
+    // drop the objects and the autosave of the last file, the scenes are never merged
+    m_core.clearScene();
+    bool loaded = m_core.loadFromTextStream(gs::string(pWchar));
     delete [] pWchar;
+    if (!loaded)
+        return;
+    // write beside the opened file in the background, never touch the opened one
+    m_core.setupAutosave(gs::string((fileName + ".autosave").toStdWString().c_str()), NIHIL_AUTOSAVE_INTERVAL);
 }
 
 void MainWindow::resizeEvent(QResizeEvent *event)
@@ -116,3 +125,13 @@ void MainWindow::on_actionScale_triggered()
 {
     m_core.scaleModifier();
 }
+
+void MainWindow::on_actionUndo_triggered()
+{
+    m_core.undo();
+}
+
+void MainWindow::on_actionRedo_triggered()
+{
+    m_core.redo();
+}
@@ -29,6 +29,8 @@ private slots:
     void on_actionTranslate_triggered();
     void on_actionRotate_triggered();
     void on_actionScale_triggered();
+    void on_actionUndo_triggered();
+    void on_actionRedo_triggered();
 
 private:
     Ui::MainWindow *ui;
@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include "thumbnailbatch.h"
+
+/*
+ * NihilThumbnail [options] scene files...
+ *   -o dir         the directory of the images, the current one by default
+ *   -l file        read the scene files from the list, one per line
+ *   -s WxH         the size of the images, 256x256 by default
+ *   -n count       the angles around each scene, 8 by default
+ *   -e degrees     the elevation of the camera
+ *   -j count       the scenes loaded at the same time, the hardware threads by default
+ *   -t count       the threads of each scene, 1 by default
+ *   -w             wireframe
+ * The images are saved as <dir>/<scene name>_<angle>.bmp
+ */
+
+static NihilString nihilToString(const char* str)
+{
+    int len = MultiByteToWideChar(CP_ACP, 0, str, -1, nullptr, 0);
+    if (len <= 1)
+        return NihilString();
+    NihilString s;
+    s.resize(len - 1);
+    MultiByteToWideChar(CP_ACP, 0, str, -1, &s.front(), len);
+    return s;
+}
+
+static NihilString nihilGetSceneName(const NihilString& path)
+{
+    int start = 0;
+    int p = (int)path.find_last_of(_t("\\/"));
+    if (p != NihilString::npos)
+        start = p + 1;
+    int end = (int)path.find_last_of(_t('.'));
+    if (end == NihilString::npos || end < start)
+        end = (int)path.length();
+    return path.substr(start, end - start);
+}
+
+static bool nihilAddSceneList(NihilThumbnailJobList& jobs, const NihilString& listPath)
+{
+    NihilString src;
+    if (!nihilReadSceneFile(listPath, src))
+        return false;
+    int start = 0;
+    while (start < (int)src.length())
+    {
+        int end = (int)src.find_first_of(_t("\r\n"), start);
+        if (end == NihilString::npos)
+            end = (int)src.length();
+        if (end > start)
+        {
+            NihilThumbnailJob job;
+            job.scenePath = src.substr(start, end - start);
+            jobs.push_back(job);
+        }
+        start = end + 1;
+    }
+    return true;
+}
+
+static void nihilPrintUsage()
+{
+    wprintf(L"usage: NihilThumbnail [-o dir] [-l list] [-s WxH] [-n angles] [-e degrees] [-j scenes] [-t threads] [-w] scenes...\n");
+}
+
+int main(int argc, char* argv[])
+{
+    NihilThumbnailOptions options;
+    NihilThumbnailJobList jobs;
+    NihilString outputDir;
+    for (int i = 1; i < argc; i ++)
+    {
+        const char* arg = argv[i];
+        if (arg[0] != '-')
+        {
+            NihilThumbnailJob job;
+            job.scenePath = nihilToString(arg);
+            jobs.push_back(job);
+            continue;
+        }
+        if (!strcmp(arg, "-w"))
+        {
+            options.wireframe = true;
+            continue;
+        }
+        if (i + 1 >= argc)
+        {
+            nihilPrintUsage();
+            return 1;
+        }
+        const char* value = argv[++ i];
+        if (!strcmp(arg, "-o"))
+            outputDir = nihilToString(value);
+        else if (!strcmp(arg, "-l"))
+        {
+            NihilString listPath = nihilToString(value);
+            if (!nihilAddSceneList(jobs, listPath))
+            {
+                wprintf(L"failed to read the list %s\n", listPath.c_str());
+                return 1;
+            }
+        }
+        else if (!strcmp(arg, "-s"))
+        {
+            if (sscanf(value, "%dx%d", &options.width, &options.height) != 2 || options.width <= 0 || options.height <= 0)
+            {
+                nihilPrintUsage();
+                return 1;
+            }
+        }
+        else if (!strcmp(arg, "-n"))
+            options.angles = std::max(atoi(value), 1);
+        else if (!strcmp(arg, "-e"))
+            options.elevation = (float)atof(value) * PI / 180.f;
+        else if (!strcmp(arg, "-j"))
+            options.scenes = atoi(value);
+        else if (!strcmp(arg, "-t"))
+            options.threadsPerScene = atoi(value);
+        else
+        {
+            nihilPrintUsage();
+            return 1;
+        }
+    }
+    if (jobs.empty())
+    {
+        nihilPrintUsage();
+        return 1;
+    }
+    if (!outputDir.empty() && outputDir.back() != _t('\\') && outputDir.back() != _t('/'))
+        outputDir.push_back(_t('\\'));
+    for (auto& job : jobs)
+        job.outputPrefix = outputDir + nihilGetSceneName(job.scenePath);
+    NihilThumbnailBatch batch;
+    if (!batch.setup(options))
+    {
+        wprintf(L"failed to setup the renderers\n");
+        return 1;
+    }
+    double startTime = nihilGetMilliseconds();
+    int succeeded = batch.run(jobs);
+    double totalTime = nihilGetMilliseconds() - startTime;
+    for (const auto& job : jobs)
+    {
+        if (job.succeeded)
+            wprintf(L"%s: %d images, load %.1fms, render %.1fms\n", job.scenePath.c_str(), job.images, job.loadTime, job.renderTime);
+        else
+            wprintf(L"%s: failed\n", job.scenePath.c_str());
+    }
+    wprintf(L"%d of %d scenes by %d slots in %.1fms\n", succeeded, (int)jobs.size(), batch.getSlotCount(), totalTime);
+    batch.destroy();
+    return succeeded == (int)jobs.size() ? 0 : 2;
+}